@@ -0,0 +1,149 @@
+#include "admission.h"
+
+const char* rpc_class_names[RPC_CLASS_MAX] = {"critical", "normal", "bulk"};
+
+const char* rpc_class_name(int cls) {
+    return rpc_class_names[cls];
+}
+
+bool parse_rpc_class(const std::string& name, int* cls) {
+    for ( int i = 0; i < RPC_CLASS_MAX; i++ ) {
+        if ( name == rpc_class_names[i] ) {
+            *cls = i;
+            return true;
+        }
+    }
+    return false;
+}
+
+std::string peer_address(const std::string& peer) {
+    auto colon = peer.find(':');
+    if ( colon == std::string::npos ) {
+        return peer;
+    }
+    auto scheme = peer.substr(0, colon);
+    if ( scheme == "unix" ) {
+        return scheme;
+    }
+    auto addr = peer.substr(colon + 1);
+    auto port = addr.rfind(':');
+    if ( port != std::string::npos ) {
+        addr = addr.substr(0, port);
+    }
+    if ( addr.size() >= 2 && addr[0] == '[' && addr[addr.size() - 1] == ']' ) {
+        addr = addr.substr(1, addr.size() - 2);
+    }
+    return addr;
+}
+
+Admission& Admission::instance() {
+    static Admission a;
+    return a;
+}
+
+Admission::Admission() : max_active_(16), max_bulk_(1), running_(0) {
+    for ( int i = 0; i < RPC_CLASS_MAX; i++ ) {
+        waiting_[i] = 0;
+        active_[i] = 0;
+        wait_[i] = new telemetry::Metric(std::string("admission/") + rpc_class_names[i]);
+    }
+}
+
+void Admission::configure(int max_active, int max_bulk) {
+    std::unique_lock<std::mutex> mlock(mutex_);
+    max_active_ = max_active;
+    max_bulk_ = max_bulk;
+}
+
+void Admission::set_method_class(const std::string& method, int cls) {
+    std::unique_lock<std::mutex> mlock(mutex_);
+    methods_[method] = cls;
+}
+
+int Admission::method_class(const std::string& method, int cls) {
+    std::unique_lock<std::mutex> mlock(mutex_);
+    auto it = methods_.find(method);
+    if ( it != methods_.end() ) {
+        return it->second;
+    }
+    return cls;
+}
+
+void Admission::set_priority_peers(const std::vector<std::string>& peers) {
+    std::unique_lock<std::mutex> mlock(mutex_);
+    priority_peers_ = std::set<std::string>(peers.begin(), peers.end());
+}
+
+int Admission::call_class(grpc::ServerContext* context, int cls) {
+    auto& md = context->client_metadata();
+    auto it = md.find(RPC_CLASS_METADATA);
+    int c;
+    if ( it == md.end() || !parse_rpc_class(std::string(it->second.data(), it->second.size()), &c) ) {
+        return cls;
+    }
+    if ( c >= cls ) {
+        return c;
+    }
+    std::unique_lock<std::mutex> mlock(mutex_);
+    if ( priority_peers_.count(peer_address(context->peer())) == 0 ) {
+        return cls;
+    }
+    return c;
+}
+
+bool Admission::admissible(int cls) {
+    if ( cls == RPC_CLASS_CRITICAL ) {
+        return true;
+    }
+    if ( max_active_ > 0 && running_ >= max_active_ ) {
+        return false;
+    }
+    if ( cls == RPC_CLASS_BULK ) {
+        return waiting_[RPC_CLASS_NORMAL] == 0 && (max_bulk_ <= 0 || active_[RPC_CLASS_BULK] < max_bulk_);
+    }
+    return true;
+}
+
+void Admission::acquire(int cls) {
+    auto start = telemetry::now_ns();
+    {
+        std::unique_lock<std::mutex> mlock(mutex_);
+        if ( !admissible(cls) ) {
+            waiting_[cls]++;
+            while ( !admissible(cls) ) {
+                cond_.wait(mlock);
+            }
+            waiting_[cls]--;
+            // bulk calls may have been held back only by this one
+            if ( cls == RPC_CLASS_NORMAL && waiting_[cls] == 0 && waiting_[RPC_CLASS_BULK] > 0 ) {
+                cond_.notify_all();
+            }
+        }
+        active_[cls]++;
+        running_++;
+    }
+    wait_[cls]->record(telemetry::now_ns() - start);
+}
+
+void Admission::release(int cls) {
+    bool notify;
+    {
+        std::unique_lock<std::mutex> mlock(mutex_);
+        active_[cls]--;
+        running_--;
+        notify = waiting_[RPC_CLASS_NORMAL] > 0 || waiting_[RPC_CLASS_BULK] > 0;
+    }
+    if ( notify ) {
+        cond_.notify_all();
+    }
+}
+
+int Admission::waiting(int cls) {
+    std::unique_lock<std::mutex> mlock(mutex_);
+    return waiting_[cls];
+}
+
+int Admission::active(int cls) {
+    std::unique_lock<std::mutex> mlock(mutex_);
+    return active_[cls];
+}
@@ -0,0 +1,95 @@
+#ifndef ADMISSION_H
+#define ADMISSION_H
+
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <grpc++/server_context.h>
+
+#include "metrics.h"
+
+// Request classes, in the order they are served.
+enum rpc_class {
+    RPC_CLASS_CRITICAL,
+    RPC_CLASS_NORMAL,
+    RPC_CLASS_BULK,
+    RPC_CLASS_MAX,
+};
+
+// the SDK calls of an RPC are queued on the unit worker lane of its class
+static_assert(RPC_CLASS_MAX == UNIT_LANES, "every class needs a unit worker lane");
+
+// Clients override the class of a call with this metadata key, whose value
+// is critical, normal or bulk. Any client may lower the class of its calls;
+// only the peers set by set_priority_peers may raise it.
+const char* const RPC_CLASS_METADATA = "opennsl-priority";
+
+const char* rpc_class_name(int cls);
+bool parse_rpc_class(const std::string& name, int* cls);
+// peer_address strips the scheme and the port off a gRPC peer name, so that
+// ipv4:10.0.0.1:34567 becomes 10.0.0.1 and unix:/run/x.sock becomes unix.
+std::string peer_address(const std::string& peer);
+
+// Admission decides when an RPC may start. Critical calls are admitted at
+// once. Normal calls wait while max_active calls are running, and bulk
+// calls additionally wait while max_bulk bulk calls are running or any
+// normal call is waiting. A limit of 0 means no limit.
+class Admission {
+    public:
+        static Admission& instance();
+        void configure(int max_active, int max_bulk);
+        // set_method_class overrides the class of a method, named
+        // <Service>.<Method> as in the rpc/ metrics.
+        void set_method_class(const std::string& method, int cls);
+        int method_class(const std::string& method, int cls);
+        // set_priority_peers sets the peer addresses, as by peer_address,
+        // allowed to raise the class of their calls.
+        void set_priority_peers(const std::vector<std::string>& peers);
+        int call_class(grpc::ServerContext* context, int cls);
+        void acquire(int cls);
+        void release(int cls);
+        int waiting(int cls);
+        int active(int cls);
+    private:
+        Admission();
+        bool admissible(int cls);
+        std::mutex mutex_;
+        std::condition_variable cond_;
+        int max_active_;
+        int max_bulk_;
+        int running_;
+        int waiting_[RPC_CLASS_MAX];
+        int active_[RPC_CLASS_MAX];
+        std::map<std::string, int> methods_;
+        std::set<std::string> priority_peers_;
+        telemetry::Metric* wait_[RPC_CLASS_MAX];
+};
+
+class AdmissionTicket {
+    public:
+        AdmissionTicket(int cls) : cls_(cls), lane_(sdk_lane) {
+            Admission::instance().acquire(cls_);
+            sdk_lane = cls_;
+        }
+        ~AdmissionTicket() {
+            sdk_lane = lane_;
+            Admission::instance().release(cls_);
+        }
+    private:
+        int cls_;
+        int lane_;
+};
+
+// RPC_ADMIT(service, cls) holds the enclosing service method until the
+// admission policy lets it run. cls is the default class of the method;
+// --rpc-class and the client's opennsl-priority metadata override it. The
+// SDK calls of the method then run on the unit worker lane of its class.
+#define RPC_ADMIT(service, cls) \
+    static const int rpc_method_class_ = Admission::instance().method_class(std::string(service) + "." + __func__, cls); \
+    AdmissionTicket rpc_ticket_(Admission::instance().call_class(context, rpc_method_class_))
+
+#endif // ADMISSION_H
@@ -0,0 +1,553 @@
+// opennsl-bench drives the opennsl-server services with a configurable
+// request mix and reports throughput and latency percentiles per RPC. With
+// --monitor it also opens Monitor streams and measures the event delivery
+// latency from the SDK callback on the server to the receipt by the client,
+// using the timestamp carried in MonitorResponse (both ends must share a
+// clock, i.e. run on the same host).
+//
+// Typical use against the simulated SDK:
+//
+//   FAKE_OPENNSL_LATENCY_US=20 ./opennsl-server-fake &
+//   ./opennsl-bench -c 32 -d 10 -m port.link_status=4,stat.get=4,vlan.list=1
+//
+//   FAKE_OPENNSL_LINK_EVENTS=1000 ./opennsl-server-fake &
+//   ./opennsl-bench --monitor link -s 16 -d 10
+
+#include <getopt.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <grpc++/grpc++.h>
+
+#include "driverservice.grpc.pb.h"
+#include "portservice.grpc.pb.h"
+#include "statservice.grpc.pb.h"
+#include "linkservice.grpc.pb.h"
+#include "vlanservice.grpc.pb.h"
+#include "l2service.grpc.pb.h"
+#include "histogram.h"
+
+const int STAT_TYPE_FIRST = stat::STAT_TYPE_DOT1D_BASE_PORT_DELAY_EXCEEDED_DISCARDS;
+const int STAT_TYPE_LAST = stat::STAT_TYPE_IEEE8021_PFC_INDICATIONS;
+// VLANs used by vlan.create_destroy, one block per worker
+const int BENCH_VID_BASE = 100;
+const int BENCH_VIDS_PER_WORKER = 16;
+
+struct stubs {
+    stubs(std::shared_ptr<grpc::Channel> ch) :
+        driver(driverservice::Driver::NewStub(ch)),
+        port(portservice::Port::NewStub(ch)),
+        stat(statservice::Stat::NewStub(ch)),
+        link(linkservice::Link::NewStub(ch)),
+        vlan(vlanservice::VLAN::NewStub(ch)),
+        l2(l2service::L2::NewStub(ch)) {}
+    std::unique_ptr<driverservice::Driver::Stub> driver;
+    std::unique_ptr<portservice::Port::Stub> port;
+    std::unique_ptr<statservice::Stat::Stub> stat;
+    std::unique_ptr<linkservice::Link::Stub> link;
+    std::unique_ptr<vlanservice::VLAN::Stub> vlan;
+    std::unique_ptr<l2service::L2::Stub> l2;
+};
+
+struct worker {
+    int id;
+    stubs* s;
+    int64_t unit;
+    int ports;
+    std::mt19937 rng;
+    uint64_t seq;
+    std::string mac;
+};
+
+typedef grpc::Status (*op_fn)(worker& w);
+
+int64_t random_port(worker& w) {
+    return 1 + w.rng() % w.ports;
+}
+
+std::string worker_mac(int id, uint32_t n) {
+    char mac[6] = {0x0a, char(id >> 8), char(id), char(n >> 16), char(n >> 8), char(n)};
+    return std::string(mac, 6);
+}
+
+grpc::Status op_driver_version(worker& w) {
+    grpc::ClientContext ctx;
+    driver::GetVersionRequest req;
+    driver::GetVersionResponse res;
+    return w.s->driver->GetVersion(&ctx, req, &res);
+}
+
+grpc::Status op_port_config(worker& w) {
+    grpc::ClientContext ctx;
+    port::GetConfigRequest req;
+    port::GetConfigResponse res;
+    req.set_unit(w.unit);
+    return w.s->port->GetConfig(&ctx, req, &res);
+}
+
+grpc::Status op_port_name(worker& w) {
+    grpc::ClientContext ctx;
+    port::GetPortNameRequest req;
+    port::GetPortNameResponse res;
+    req.set_unit(w.unit);
+    req.set_port(random_port(w));
+    return w.s->port->GetPortName(&ctx, req, &res);
+}
+
+grpc::Status op_port_link_status(worker& w) {
+    grpc::ClientContext ctx;
+    port::PortLinkStatusGetRequest req;
+    port::PortLinkStatusGetResponse res;
+    req.set_unit(w.unit);
+    req.set_port(random_port(w));
+    return w.s->port->PortLinkStatusGet(&ctx, req, &res);
+}
+
+grpc::Status op_port_enable_get(worker& w) {
+    grpc::ClientContext ctx;
+    port::PortEnableGetRequest req;
+    port::PortEnableGetResponse res;
+    req.set_unit(w.unit);
+    req.set_port(random_port(w));
+    return w.s->port->PortEnableGet(&ctx, req, &res);
+}
+
+grpc::Status op_port_speed_get(worker& w) {
+    grpc::ClientContext ctx;
+    port::PortSpeedGetRequest req;
+    port::PortSpeedGetResponse res;
+    req.set_unit(w.unit);
+    req.set_port(random_port(w));
+    return w.s->port->PortSpeedGet(&ctx, req, &res);
+}
+
+grpc::Status op_port_speed_set(worker& w) {
+    grpc::ClientContext ctx;
+    port::PortSpeedSetRequest req;
+    port::PortSpeedSetResponse res;
+    req.set_unit(w.unit);
+    req.set_port(random_port(w));
+    req.set_speed(10000);
+    return w.s->port->PortSpeedSet(&ctx, req, &res);
+}
+
+grpc::Status op_stat_get(worker& w) {
+    grpc::ClientContext ctx;
+    stat::GetRequest req;
+    stat::GetResponse res;
+    req.set_unit(w.unit);
+    req.set_port(random_port(w));
+    req.set_type(stat::StatType(STAT_TYPE_FIRST + w.rng() % (STAT_TYPE_LAST - STAT_TYPE_FIRST + 1)));
+    return w.s->stat->Get(&ctx, req, &res);
+}
+
+grpc::Status op_stat_sync(worker& w) {
+    grpc::ClientContext ctx;
+    stat::SyncRequest req;
+    stat::SyncResponse res;
+    req.set_unit(w.unit);
+    return w.s->stat->Sync(&ctx, req, &res);
+}
+
+grpc::Status op_link_mode_get(worker& w) {
+    grpc::ClientContext ctx;
+    link::LinkscanModeGetRequest req;
+    link::LinkscanModeGetResponse res;
+    req.set_unit(w.unit);
+    req.set_port(random_port(w));
+    return w.s->link->LinkscanModeGet(&ctx, req, &res);
+}
+
+grpc::Status op_vlan_list(worker& w) {
+    grpc::ClientContext ctx;
+    vlan::ListRequest req;
+    vlan::ListResponse res;
+    req.set_unit(w.unit);
+    return w.s->vlan->List(&ctx, req, &res);
+}
+
+grpc::Status op_vlan_get(worker& w) {
+    grpc::ClientContext ctx;
+    vlan::GetVlanRequest req;
+    vlan::GetVlanResponse res;
+    req.set_unit(w.unit);
+    req.set_vid(1);
+    return w.s->vlan->GetVlan(&ctx, req, &res);
+}
+
+grpc::Status op_vlan_port_vlans(worker& w) {
+    grpc::ClientContext ctx;
+    vlan::GetPortVlansRequest req;
+    vlan::GetPortVlansResponse res;
+    req.set_unit(w.unit);
+    req.set_port(random_port(w));
+    return w.s->vlan->GetPortVlans(&ctx, req, &res);
+}
+
+// one sample covers both the Create and the Destroy call
+grpc::Status op_vlan_create_destroy(worker& w) {
+    auto vid = BENCH_VID_BASE + (w.id * BENCH_VIDS_PER_WORKER + w.seq++ % BENCH_VIDS_PER_WORKER) % (4094 - BENCH_VID_BASE);
+    {
+        grpc::ClientContext ctx;
+        vlan::CreateRequest req;
+        vlan::CreateResponse res;
+        req.set_unit(w.unit);
+        req.set_vid(vid);
+        auto status = w.s->vlan->Create(&ctx, req, &res);
+        if ( !status.ok() ) {
+            return status;
+        }
+    }
+    grpc::ClientContext ctx;
+    vlan::DestroyRequest req;
+    vlan::DestroyResponse res;
+    req.set_unit(w.unit);
+    req.set_vid(vid);
+    return w.s->vlan->Destroy(&ctx, req, &res);
+}
+
+grpc::Status op_l2_get(worker& w) {
+    grpc::ClientContext ctx;
+    l2::GetAddressRequest req;
+    l2::GetAddressResponse res;
+    req.set_unit(w.unit);
+    req.set_mac(w.mac);
+    req.set_vid(1);
+    return w.s->l2->GetAddress(&ctx, req, &res);
+}
+
+// one sample covers both the AddAddress and the DeleteAddress call
+grpc::Status op_l2_add_delete(worker& w) {
+    auto mac = worker_mac(w.id, 1 + w.seq++ % 0xffff);
+    {
+        grpc::ClientContext ctx;
+        l2::AddAddressRequest req;
+        l2::AddAddressResponse res;
+        req.set_unit(w.unit);
+        req.mutable_address()->set_mac(mac);
+        req.mutable_address()->set_vid(1);
+        req.mutable_address()->set_port(random_port(w));
+        auto status = w.s->l2->AddAddress(&ctx, req, &res);
+        if ( !status.ok() ) {
+            return status;
+        }
+    }
+    grpc::ClientContext ctx;
+    l2::DeleteAddressRequest req;
+    l2::DeleteAddressResponse res;
+    req.set_unit(w.unit);
+    req.set_mac(mac);
+    req.set_vid(1);
+    return w.s->l2->DeleteAddress(&ctx, req, &res);
+}
+
+grpc::Status op_l2_list(worker& w) {
+    grpc::ClientContext ctx;
+    l2::ListRequest req;
+    l2::ListResponse res;
+    req.set_unit(w.unit);
+    return w.s->l2->List(&ctx, req, &res);
+}
+
+struct op {
+    const char* name;
+    op_fn fn;
+};
+
+const op ops[] = {
+    {"driver.version", op_driver_version},
+    {"port.config", op_port_config},
+    {"port.name", op_port_name},
+    {"port.link_status", op_port_link_status},
+    {"port.enable_get", op_port_enable_get},
+    {"port.speed_get", op_port_speed_get},
+    {"port.speed_set", op_port_speed_set},
+    {"stat.get", op_stat_get},
+    {"stat.sync", op_stat_sync},
+    {"link.mode_get", op_link_mode_get},
+    {"vlan.list", op_vlan_list},
+    {"vlan.get", op_vlan_get},
+    {"vlan.port_vlans", op_vlan_port_vlans},
+    {"vlan.create_destroy", op_vlan_create_destroy},
+    {"l2.get", op_l2_get},
+    {"l2.add_delete", op_l2_add_delete},
+    {"l2.list", op_l2_list},
+};
+const int NUM_OPS = sizeof(ops) / sizeof(ops[0]);
+
+struct options {
+    std::string address;
+    int concurrency;
+    int channels;
+    int duration;
+    std::string mix;
+    int64_t unit;
+    int ports;
+    std::string monitor;
+    int streams;
+};
+
+struct result {
+    std::vector<Histogram> latency;
+    std::vector<uint64_t> errors;
+    result() : latency(NUM_OPS), errors(NUM_OPS, 0) {}
+};
+
+bool parse_mix(const std::string& mix, std::vector<int>* weights) {
+    weights->assign(NUM_OPS, mix.empty() ? 1 : 0);
+    std::istringstream in(mix);
+    std::string item;
+    while ( std::getline(in, item, ',') ) {
+        if ( item.empty() ) {
+            continue;
+        }
+        auto eq = item.find('=');
+        auto name = item.substr(0, eq);
+        auto weight = eq == std::string::npos ? 1 : std::atoi(item.c_str() + eq + 1);
+        int i = 0;
+        for ( ; i < NUM_OPS; i++ ) {
+            if ( name == ops[i].name ) {
+                break;
+            }
+        }
+        if ( i == NUM_OPS || weight < 0 ) {
+            std::cerr << "unknown operation in mix: " << item << std::endl;
+            return false;
+        }
+        (*weights)[i] = weight;
+    }
+    for ( auto w : *weights ) {
+        if ( w > 0 ) {
+            return true;
+        }
+    }
+    std::cerr << "empty mix" << std::endl;
+    return false;
+}
+
+void run_worker(worker w, const std::vector<int>& weights, std::chrono::steady_clock::time_point deadline, result* r) {
+    std::vector<int> cumulative;
+    int total = 0;
+    for ( auto weight : weights ) {
+        total += weight;
+        cumulative.push_back(total);
+    }
+    {
+        // target of l2.get
+        grpc::ClientContext ctx;
+        l2::AddAddressRequest req;
+        l2::AddAddressResponse res;
+        req.set_unit(w.unit);
+        req.mutable_address()->set_flags(l2::FLAG_STATIC);
+        req.mutable_address()->set_mac(w.mac);
+        req.mutable_address()->set_vid(1);
+        req.mutable_address()->set_port(1);
+        w.s->l2->AddAddress(&ctx, req, &res);
+    }
+    while ( std::chrono::steady_clock::now() < deadline ) {
+        int pick = w.rng() % total;
+        int i = std::upper_bound(cumulative.begin(), cumulative.end(), pick) - cumulative.begin();
+        auto start = std::chrono::steady_clock::now();
+        auto status = ops[i].fn(w);
+        auto elapsed = std::chrono::steady_clock::now() - start;
+        r->latency[i].record(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+        if ( !status.ok() ) {
+            r->errors[i]++;
+        }
+    }
+}
+
+void run_monitor(stubs* s, const options& opts, grpc::ClientContext* ctx, Histogram* h) {
+    auto now = []() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    };
+    if ( opts.monitor == "link" ) {
+        link::MonitorRequest req;
+        link::MonitorResponse res;
+        req.set_unit(opts.unit);
+        auto reader = s->link->Monitor(ctx, req);
+        while ( reader->Read(&res) ) {
+            auto d = now() - res.timestamp();
+            h->record(d > 0 ? d : 0);
+        }
+        reader->Finish();
+    } else {
+        l2::MonitorRequest req;
+        l2::MonitorResponse res;
+        req.set_unit(opts.unit);
+        auto reader = s->l2->Monitor(ctx, req);
+        while ( reader->Read(&res) ) {
+            auto d = now() - res.timestamp();
+            h->record(d > 0 ? d : 0);
+        }
+        reader->Finish();
+    }
+}
+
+void print_header() {
+    std::printf("%-22s %10s %8s %12s %10s %10s %10s %10s\n", "op", "count", "errors", "ops/s", "p50(us)", "p99(us)", "p999(us)", "max(us)");
+}
+
+void print_row(const char* name, const Histogram& h, uint64_t errors, double seconds) {
+    std::printf("%-22s %10llu %8llu %12.1f %10.1f %10.1f %10.1f %10.1f\n", name,
+            (unsigned long long)h.count(), (unsigned long long)errors, h.count() / seconds,
+            h.percentile(0.5) / 1e3, h.percentile(0.99) / 1e3, h.percentile(0.999) / 1e3, h.max() / 1e3);
+}
+
+void usage(const char* prog) {
+    std::cerr << "usage: " << prog << " [options]\n"
+        << "  -a, --address ADDR      server address (default 127.0.0.1:50051)\n"
+        << "  -c, --concurrency N     concurrent RPC workers (default 8, 0 with --monitor)\n"
+        << "  -n, --channels N        gRPC channels shared by the workers (default 1)\n"
+        << "  -d, --duration SEC      run time in seconds (default 10)\n"
+        << "  -m, --mix OP=W,...      request mix by weight (default all operations)\n"
+        << "  -u, --unit N            unit (default 0)\n"
+        << "  -p, --ports N           ports to spread requests over (default 32)\n"
+        << "  -M, --monitor link|l2   open Monitor streams and measure event latency\n"
+        << "  -s, --streams N         Monitor streams (default 1)\n"
+        << "operations:";
+    for ( int i = 0; i < NUM_OPS; i++ ) {
+        std::cerr << " " << ops[i].name;
+    }
+    std::cerr << std::endl;
+}
+
+int main(int argc, char** argv) {
+    options opts = {"127.0.0.1:50051", -1, 1, 10, "", 0, 32, "", 1};
+    static struct option long_options[] = {
+        {"address", required_argument, 0, 'a'},
+        {"concurrency", required_argument, 0, 'c'},
+        {"channels", required_argument, 0, 'n'},
+        {"duration", required_argument, 0, 'd'},
+        {"mix", required_argument, 0, 'm'},
+        {"unit", required_argument, 0, 'u'},
+        {"ports", required_argument, 0, 'p'},
+        {"monitor", required_argument, 0, 'M'},
+        {"streams", required_argument, 0, 's'},
+        {"help", no_argument, 0, 'h'},
+        {0, 0, 0, 0},
+    };
+    int c;
+    while ( (c = getopt_long(argc, argv, "a:c:n:d:m:u:p:M:s:h", long_options, NULL)) != -1 ) {
+        switch (c) {
+        case 'a': opts.address = optarg; break;
+        case 'c': opts.concurrency = std::atoi(optarg); break;
+        case 'n': opts.channels = std::atoi(optarg); break;
+        case 'd': opts.duration = std::atoi(optarg); break;
+        case 'm': opts.mix = optarg; break;
+        case 'u': opts.unit = std::atoll(optarg); break;
+        case 'p': opts.ports = std::atoi(optarg); break;
+        case 'M': opts.monitor = optarg; break;
+        case 's': opts.streams = std::atoi(optarg); break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if ( opts.concurrency < 0 ) {
+        opts.concurrency = opts.monitor.empty() ? 8 : 0;
+    }
+    if ( !opts.monitor.empty() && opts.monitor != "link" && opts.monitor != "l2" ) {
+        usage(argv[0]);
+        return 1;
+    }
+    if ( opts.channels < 1 || opts.ports < 1 || opts.duration < 1 ) {
+        usage(argv[0]);
+        return 1;
+    }
+    std::vector<int> weights;
+    if ( !parse_mix(opts.mix, &weights) ) {
+        return 1;
+    }
+
+    std::vector<std::unique_ptr<stubs> > channels;
+    for ( int i = 0; i < opts.channels; i++ ) {
+        grpc::ChannelArguments args;
+        // give every channel its own connection
+        args.SetInt(GRPC_ARG_USE_LOCAL_SUBCHANNEL_POOL, 1);
+        auto ch = grpc::CreateCustomChannel(opts.address, grpc::InsecureChannelCredentials(), args);
+        channels.emplace_back(new stubs(ch));
+        grpc::ClientContext ctx;
+        driver::GetVersionRequest req;
+        driver::GetVersionResponse res;
+        auto status = channels.back()->driver->GetVersion(&ctx, req, &res);
+        if ( !status.ok() ) {
+            std::cerr << "cannot reach " << opts.address << ": " << status.error_message() << std::endl;
+            return 1;
+        }
+    }
+
+    std::vector<std::unique_ptr<grpc::ClientContext> > contexts;
+    std::vector<Histogram> events;
+    std::vector<std::thread> monitors;
+    if ( !opts.monitor.empty() ) {
+        contexts.resize(opts.streams);
+        events.resize(opts.streams);
+        for ( int i = 0; i < opts.streams; i++ ) {
+            contexts[i].reset(new grpc::ClientContext());
+            monitors.emplace_back(run_monitor, channels[i % opts.channels].get(), std::cref(opts), contexts[i].get(), &events[i]);
+        }
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    auto deadline = start + std::chrono::seconds(opts.duration);
+    std::vector<result> results(opts.concurrency);
+    std::vector<std::thread> workers;
+    for ( int i = 0; i < opts.concurrency; i++ ) {
+        worker w{i, channels[i % opts.channels].get(), opts.unit, opts.ports, std::mt19937(i), 0, worker_mac(i, 0)};
+        workers.emplace_back(run_worker, w, std::cref(weights), deadline, &results[i]);
+    }
+    for ( auto& t : workers ) {
+        t.join();
+    }
+    std::this_thread::sleep_until(deadline);
+    for ( auto& ctx : contexts ) {
+        ctx->TryCancel();
+    }
+    for ( auto& t : monitors ) {
+        t.join();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    print_header();
+    if ( opts.concurrency > 0 ) {
+        Histogram total;
+        uint64_t total_errors = 0;
+        for ( int i = 0; i < NUM_OPS; i++ ) {
+            Histogram h;
+            uint64_t errors = 0;
+            for ( auto& r : results ) {
+                h.merge(r.latency[i]);
+                errors += r.errors[i];
+            }
+            if ( h.count() == 0 ) {
+                continue;
+            }
+            print_row(ops[i].name, h, errors, seconds);
+            total.merge(h);
+            total_errors += errors;
+        }
+        print_row("total", total, total_errors, seconds);
+    }
+    if ( !opts.monitor.empty() ) {
+        Histogram h;
+        for ( auto& e : events ) {
+            h.merge(e);
+        }
+        auto name = opts.monitor + ".monitor";
+        print_row(name.c_str(), h, 0, seconds);
+    }
+    return 0;
+}
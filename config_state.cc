@@ -0,0 +1,98 @@
+#include <cstring>
+
+#include "config_state.h"
+
+ConfigState& ConfigState::instance() {
+    static ConfigState s;
+    return s;
+}
+
+ConfigState::l2_key ConfigState::key(int unit, const uint8_t* mac, opennsl_vlan_t vid) {
+    uint64_t m = 0;
+    for ( int i = 0; i < 6; i++ ) {
+        m = (m << 8) | mac[i];
+    }
+    return std::make_tuple(unit, m, vid);
+}
+
+void ConfigState::l2_add(int unit, const opennsl_l2_addr_t& addr) {
+    std::unique_lock<std::mutex> mlock(mutex_);
+    auto k = key(unit, addr.mac, addr.vid);
+    // a dynamic add replaces a static entry in the hardware table
+    if ( (addr.flags & OPENNSL_L2_STATIC) == 0 ) {
+        if ( l2_.erase(k) > 0 ) {
+            generation_++;
+        }
+        return;
+    }
+    l2_static e;
+    e.unit = unit;
+    std::memcpy(e.mac, addr.mac, 6);
+    e.vid = addr.vid;
+    e.flags = addr.flags;
+    e.port = addr.port;
+    e.modid = addr.modid;
+    e.tgid = addr.tgid;
+    l2_[k] = e;
+    generation_++;
+}
+
+void ConfigState::l2_delete(int unit, const uint8_t* mac, opennsl_vlan_t vid) {
+    std::unique_lock<std::mutex> mlock(mutex_);
+    if ( l2_.erase(key(unit, mac, vid)) > 0 ) {
+        generation_++;
+    }
+}
+
+void ConfigState::port_set(int unit, int port, uint32_t field, int value) {
+    std::unique_lock<std::mutex> mlock(mutex_);
+    auto& p = ports_[std::make_pair(unit, port)];
+    p.unit = unit;
+    p.port = port;
+    p.mask |= field;
+    switch (field) {
+    case PORT_SETTING_ENABLE:
+        p.enable = value;
+        break;
+    case PORT_SETTING_SPEED:
+        p.speed = value;
+        break;
+    case PORT_SETTING_AUTONEG:
+        p.autoneg = value;
+        break;
+    }
+    generation_++;
+}
+
+std::mutex& ConfigState::unit_mutex(int unit) {
+    std::unique_lock<std::mutex> mlock(mutex_);
+    return units_[unit];
+}
+
+uint64_t ConfigState::generation() {
+    std::unique_lock<std::mutex> mlock(mutex_);
+    return generation_;
+}
+
+void ConfigState::snapshot(std::vector<l2_static>* l2, std::vector<port_settings>* ports) {
+    std::unique_lock<std::mutex> mlock(mutex_);
+    for ( auto& e : l2_ ) {
+        l2->push_back(e.second);
+    }
+    for ( auto& p : ports_ ) {
+        ports->push_back(p.second);
+    }
+}
+
+void ConfigState::restore(const std::vector<l2_static>& l2, const std::vector<port_settings>& ports) {
+    std::unique_lock<std::mutex> mlock(mutex_);
+    l2_.clear();
+    ports_.clear();
+    for ( auto& e : l2 ) {
+        l2_[key(e.unit, e.mac, e.vid)] = e;
+    }
+    for ( auto& p : ports ) {
+        ports_[std::make_pair(p.unit, p.port)] = p;
+    }
+    generation_++;
+}
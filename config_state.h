@@ -0,0 +1,75 @@
+#ifndef CONFIG_STATE_H
+#define CONFIG_STATE_H
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+extern "C" {
+#include "opennsl/l2.h"
+#include "opennsl/types.h"
+}
+
+// l2_static is a static L2 entry added through the L2 service.
+struct l2_static {
+    int unit;
+    uint8_t mac[6];
+    opennsl_vlan_t vid;
+    uint32_t flags;
+    int port;
+    int modid;
+    int tgid;
+};
+
+// fields of port_settings
+const uint32_t PORT_SETTING_ENABLE = 1 << 0;
+const uint32_t PORT_SETTING_SPEED = 1 << 1;
+const uint32_t PORT_SETTING_AUTONEG = 1 << 2;
+
+// port_settings holds the attributes set on a port through the Port service;
+// mask tells which of them were ever set.
+struct port_settings {
+    int unit;
+    int port;
+    uint32_t mask;
+    int enable;
+    int speed;
+    int autoneg;
+};
+
+// ConfigState records the configuration the server applied that it can't
+// read back cheaply: static L2 entries and port attributes. VLANs are kept
+// by VLANTable. generation() changes with every update.
+class ConfigState {
+    public:
+        static ConfigState& instance();
+        void l2_add(int unit, const opennsl_l2_addr_t& addr);
+        void l2_delete(int unit, const uint8_t* mac, opennsl_vlan_t vid);
+        void port_set(int unit, int port, uint32_t field, int value);
+        uint64_t generation();
+        void snapshot(std::vector<l2_static>* l2, std::vector<port_settings>* ports);
+        void restore(const std::vector<l2_static>& l2, const std::vector<port_settings>& ports);
+        // unit_mutex is held across a configuration change of unit and its
+        // record, here or in VLANTable, so that concurrent changes reach
+        // the hardware and the records in the same order.
+        std::mutex& unit_mutex(int unit);
+    private:
+        ConfigState() : generation_(0) {}
+        typedef std::tuple<int, uint64_t, opennsl_vlan_t> l2_key;
+        static l2_key key(int unit, const uint8_t* mac, opennsl_vlan_t vid);
+        std::mutex mutex_;
+        uint64_t generation_;
+        std::map<l2_key, l2_static> l2_;
+        std::map<std::pair<int, int>, port_settings> ports_;
+        std::map<int, std::mutex> units_;
+};
+
+// config_lock locks the unit_mutex of unit.
+inline std::unique_lock<std::mutex> config_lock(int unit) {
+    return std::unique_lock<std::mutex>(ConfigState::instance().unit_mutex(unit));
+}
+
+#endif // CONFIG_STATE_H
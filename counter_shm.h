@@ -0,0 +1,83 @@
+/*
+ * Layout of the shared-memory port counter table published by
+ * opennsl-server --counters-shm PATH. This header is plain C so that local
+ * readers can include it without the rest of the server.
+ *
+ * The file starts with a struct counter_shm_header, followed at types_offset
+ * by num_types uint32_t StatType numbers (stat.proto) giving the column
+ * order, followed at rows_offset by max_rows rows of row_size bytes, each a
+ * struct counter_shm_row whose values[] holds num_types counters. Only the
+ * first num_rows rows are valid. All offsets are from the start of the file
+ * and all integers are native endian.
+ *
+ * The table is guarded by a sequence lock: the writer makes seq odd before
+ * it updates any row and even again after the update. A reader samples seq,
+ * reads what it needs, and retries if seq was odd or has changed. Readers
+ * never block the writer and need no system call once the file is mapped.
+ * magic, layout_version, header_size, num_types, max_rows, row_size and the
+ * offsets are fixed for the lifetime of the file.
+ */
+#ifndef COUNTER_SHM_H
+#define COUNTER_SHM_H
+
+#include <stdint.h>
+
+#define COUNTER_SHM_MAGIC 0x52544e434c534e4fULL /* "ONSLCNTR" */
+#define COUNTER_SHM_LAYOUT_VERSION 1
+#define COUNTER_SHM_NAME_LEN 16
+
+struct counter_shm_header {
+    uint64_t magic;
+    uint32_t layout_version;
+    uint32_t header_size;
+    uint32_t num_types;
+    uint32_t max_rows;
+    uint32_t row_size;
+    uint32_t types_offset;
+    uint32_t rows_offset;
+    uint32_t num_rows;   /* guarded by seq */
+    uint64_t seq;
+    uint64_t version;    /* poll generation, guarded by seq */
+    int64_t timestamp;   /* nanoseconds since the epoch of the poll, guarded by seq */
+};
+
+struct counter_shm_row {
+    int32_t unit;
+    int32_t port;
+    char name[COUNTER_SHM_NAME_LEN]; /* NUL terminated opennsl_port_name() */
+    uint64_t values[];
+};
+
+static inline const uint32_t* counter_shm_get_types(const struct counter_shm_header* h) {
+    return (const uint32_t*)((const char*)h + h->types_offset);
+}
+
+static inline const struct counter_shm_row* counter_shm_get_row(const struct counter_shm_header* h, uint32_t i) {
+    return (const struct counter_shm_row*)((const char*)h + h->rows_offset + (uint64_t)i * h->row_size);
+}
+
+/* counter_shm_read_begin and counter_shm_read_retry bracket a consistent read:
+ *
+ *     uint64_t seq;
+ *     do {
+ *         seq = counter_shm_read_begin(h);
+ *         v = counter_shm_load(&counter_shm_get_row(h, i)->values[j]);
+ *     } while (counter_shm_read_retry(h, seq));
+ */
+static inline uint64_t counter_shm_read_begin(const struct counter_shm_header* h) {
+    uint64_t seq;
+    while ((seq = __atomic_load_n(&h->seq, __ATOMIC_ACQUIRE)) & 1) {
+    }
+    return seq;
+}
+
+static inline int counter_shm_read_retry(const struct counter_shm_header* h, uint64_t seq) {
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return __atomic_load_n(&h->seq, __ATOMIC_RELAXED) != seq;
+}
+
+static inline uint64_t counter_shm_load(const uint64_t* p) {
+    return __atomic_load_n(p, __ATOMIC_RELAXED);
+}
+
+#endif /* COUNTER_SHM_H */
@@ -0,0 +1,91 @@
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+#include "counter_table.h"
+
+bool SharedCounterTable::open() {
+    auto& types = stat_types();
+    size_t types_offset = sizeof(counter_shm_header);
+    size_t rows_offset = (types_offset + types.size() * sizeof(uint32_t) + 63) & ~size_t(63);
+    size_t row_size = sizeof(counter_shm_row) + types.size() * sizeof(uint64_t);
+    size_ = rows_offset + max_rows_ * row_size;
+
+    auto tmp = path_ + ".tmp";
+    int fd = ::open(tmp.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if ( fd < 0 ) {
+        std::cerr << "cannot create " << tmp << ": " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    if ( ftruncate(fd, size_) < 0 ) {
+        std::cerr << "cannot size " << tmp << ": " << std::strerror(errno) << std::endl;
+        close(fd);
+        return false;
+    }
+    auto p = mmap(NULL, size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if ( p == MAP_FAILED ) {
+        std::cerr << "cannot map " << tmp << ": " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    hdr_ = static_cast<counter_shm_header*>(p);
+    hdr_->magic = COUNTER_SHM_MAGIC;
+    hdr_->layout_version = COUNTER_SHM_LAYOUT_VERSION;
+    hdr_->header_size = sizeof(counter_shm_header);
+    hdr_->num_types = types.size();
+    hdr_->max_rows = max_rows_;
+    hdr_->row_size = row_size;
+    hdr_->types_offset = types_offset;
+    hdr_->rows_offset = rows_offset;
+    auto t = reinterpret_cast<uint32_t*>(static_cast<char*>(p) + types_offset);
+    for ( size_t i = 0; i < types.size(); i++ ) {
+        t[i] = types[i].type;
+    }
+    if ( rename(tmp.c_str(), path_.c_str()) < 0 ) {
+        std::cerr << "cannot rename " << tmp << " to " << path_ << ": " << std::strerror(errno) << std::endl;
+        munmap(p, size_);
+        hdr_ = NULL;
+        return false;
+    }
+    return true;
+}
+
+counter_shm_row* SharedCounterTable::row(size_t i) {
+    return reinterpret_cast<counter_shm_row*>(reinterpret_cast<char*>(hdr_) + hdr_->rows_offset + i * hdr_->row_size);
+}
+
+void SharedCounterTable::publish(const counter_snapshot& snap) {
+    if ( hdr_ == NULL ) {
+        return;
+    }
+    auto n = snap.ports.size() < max_rows_ ? snap.ports.size() : max_rows_;
+    auto seq = hdr_->seq;
+    __atomic_store_n(&hdr_->seq, seq + 1, __ATOMIC_RELAXED);
+    std::atomic_thread_fence(std::memory_order_release);
+    for ( size_t i = 0; i < n; i++ ) {
+        auto& p = snap.ports[i];
+        auto r = row(i);
+        if ( r->unit != p.unit || r->port != p.port || std::strncmp(r->name, p.name.c_str(), COUNTER_SHM_NAME_LEN - 1) != 0 ) {
+            __atomic_store_n(&r->unit, p.unit, __ATOMIC_RELAXED);
+            __atomic_store_n(&r->port, p.port, __ATOMIC_RELAXED);
+            char name[COUNTER_SHM_NAME_LEN] = {0};
+            std::strncpy(name, p.name.c_str(), COUNTER_SHM_NAME_LEN - 1);
+            for ( int j = 0; j < COUNTER_SHM_NAME_LEN; j++ ) {
+                __atomic_store_n(&r->name[j], name[j], __ATOMIC_RELAXED);
+            }
+        }
+        for ( size_t j = 0; j < p.values.size() && j < hdr_->num_types; j++ ) {
+            __atomic_store_n(&r->values[j], p.values[j], __ATOMIC_RELAXED);
+        }
+    }
+    __atomic_store_n(&hdr_->num_rows, uint32_t(n), __ATOMIC_RELAXED);
+    __atomic_store_n(&hdr_->version, snap.version, __ATOMIC_RELAXED);
+    __atomic_store_n(&hdr_->timestamp, snap.timestamp, __ATOMIC_RELAXED);
+    __atomic_store_n(&hdr_->seq, seq + 2, __ATOMIC_RELEASE);
+}
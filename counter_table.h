@@ -0,0 +1,27 @@
+#ifndef COUNTER_TABLE_H
+#define COUNTER_TABLE_H
+
+#include <string>
+
+#include "counters.h"
+#include "counter_shm.h"
+
+// SharedCounterTable publishes counter snapshots into the shared-memory
+// table described in counter_shm.h.
+class SharedCounterTable {
+    public:
+        SharedCounterTable(const std::string& path, size_t max_rows) : path_(path), max_rows_(max_rows), hdr_(NULL), size_(0) {}
+        // open creates the table file; an existing file is replaced, not
+        // truncated, so that readers still mapping it do not fault.
+        bool open();
+        // publish is a CounterPoller listener.
+        void publish(const counter_snapshot& snap);
+    private:
+        counter_shm_row* row(size_t i);
+        std::string path_;
+        size_t max_rows_;
+        counter_shm_header* hdr_;
+        size_t size_;
+};
+
+#endif // COUNTER_TABLE_H
@@ -0,0 +1,106 @@
+#include <cctype>
+#include <chrono>
+#include <iostream>
+
+#include "stat.pb.h"
+#include "counters.h"
+#include "metrics.h"
+
+extern "C" {
+#include "opennsl/error.h"
+#include "opennsl/port.h"
+#include "opennsl/stat.h"
+}
+
+const std::vector<stat_type>& stat_types() {
+    static std::vector<stat_type> types = []() {
+        std::vector<stat_type> ret;
+        auto desc = stat::StatType_descriptor();
+        const std::string prefix("STAT_TYPE_");
+        for ( int i = 0; i < desc->value_count(); i++ ) {
+            auto v = desc->value(i);
+            std::string name = v->name();
+            if ( name.compare(0, prefix.size(), prefix) == 0 ) {
+                name = name.substr(prefix.size());
+            }
+            for ( auto& c : name ) {
+                c = std::tolower(c);
+            }
+            ret.push_back(stat_type{v->number(), name});
+        }
+        return ret;
+    }();
+    return types;
+}
+
+void CounterPoller::start() {
+    if ( started_.exchange(true) ) {
+        return;
+    }
+    th_ = new std::thread(&CounterPoller::loop, this);
+}
+
+// poll refreshes the counters of unit into snapshot_.ports starting at
+// index *n, reusing the entries left by the previous poll.
+int CounterPoller::poll(int unit, size_t* n) {
+    opennsl_port_config_t config;
+    auto ret = SDK_CALL(opennsl_stat_sync, unit);
+    if ( ret != OPENNSL_E_NONE ) {
+        return ret;
+    }
+    ret = SDK_CALL(opennsl_port_config_get, unit, &config);
+    if ( ret != OPENNSL_E_NONE ) {
+        return ret;
+    }
+    auto& types = stat_types();
+    auto& ports = snapshot_.ports;
+    opennsl_port_t port;
+    OPENNSL_PBMP_ITER(config.port, port) {
+        if ( *n == ports.size() ) {
+            ports.push_back(port_counters());
+        }
+        auto& p = ports[(*n)++];
+        if ( p.unit != unit || p.port != port || p.name.empty() ) {
+            p.unit = unit;
+            p.port = port;
+            p.name = SDK_CALL(opennsl_port_name, unit, port);
+        }
+        p.values.resize(types.size());
+        for ( size_t i = 0; i < types.size(); i++ ) {
+            uint64 value = 0;
+            SDK_CALL(opennsl_stat_get, unit, port, opennsl_stat_val_t(types[i].type), &value);
+            p.values[i] = value;
+        }
+    }
+    return OPENNSL_E_NONE;
+}
+
+void CounterPoller::loop() {
+    static telemetry::Metric poll_metric("internal/counter_poll");
+    snapshot_.version = 0;
+    auto next = std::chrono::steady_clock::now();
+    while (true) {
+        {
+            telemetry::Timer t(poll_metric);
+            size_t n = 0;
+            for ( auto unit : units_ ) {
+                auto ret = poll(unit, &n);
+                if ( ret != OPENNSL_E_NONE ) {
+                    std::cerr << "counter poll of unit " << unit << " failed " << opennsl_errmsg(ret) << std::endl;
+                }
+            }
+            snapshot_.ports.resize(n);
+            snapshot_.version++;
+            snapshot_.timestamp = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+        }
+        for ( auto& l : listeners_ ) {
+            l(snapshot_);
+        }
+        next += std::chrono::milliseconds(interval_ms_);
+        auto now = std::chrono::steady_clock::now();
+        if ( next < now ) {
+            next = now;
+        }
+        std::this_thread::sleep_until(next);
+    }
+}
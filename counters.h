@@ -0,0 +1,60 @@
+#ifndef COUNTERS_H
+#define COUNTERS_H
+
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+extern "C" {
+#include "opennsl/types.h"
+}
+
+// stat_type is one counter of stat.proto's StatType, with the enum value
+// name lowercased and stripped of its STAT_TYPE_ prefix.
+struct stat_type {
+    int type;
+    std::string name;
+};
+
+const std::vector<stat_type>& stat_types();
+
+struct port_counters {
+    int unit;
+    opennsl_port_t port;
+    std::string name;
+    std::vector<uint64_t> values; // indexed like stat_types()
+};
+
+struct counter_snapshot {
+    uint64_t version;   // incremented by every poll
+    int64_t timestamp;  // nanoseconds since the epoch at the end of the poll
+    std::vector<port_counters> ports;
+};
+
+// CounterPoller reads all port counters of the configured units once per
+// interval and hands the snapshot to its listeners, so that consumers of
+// the counters share a single set of SDK calls. Polling starts with start(),
+// which must not be called before the SDK is initialized.
+class CounterPoller {
+    public:
+        typedef std::function<void(const counter_snapshot&)> listener;
+        CounterPoller(const std::vector<int>& units, int interval_ms) : units_(units), interval_ms_(interval_ms), started_(false), th_(NULL) {}
+        // add_listener must be called before start(). Listeners run on the
+        // poller thread and must not keep references into the snapshot.
+        void add_listener(const listener& l) { listeners_.push_back(l); }
+        void start();
+    private:
+        void loop();
+        int poll(int unit, size_t* n);
+        std::vector<int> units_;
+        int interval_ms_;
+        std::atomic<bool> started_;
+        std::thread* th_;
+        std::vector<listener> listeners_;
+        counter_snapshot snapshot_;
+};
+
+#endif // COUNTERS_H
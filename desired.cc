@@ -0,0 +1,276 @@
+#include <limits>
+#include <map>
+#include <sstream>
+
+#include <grpc++/server.h>
+
+#include "desiredservice.grpc.pb.h"
+#include "desired.h"
+#include "port.h"
+#include "metrics.h"
+#include "admission.h"
+#include "config_state.h"
+
+extern "C" {
+#include "opennsl/error.h"
+#include "opennsl/port.h"
+#include "opennsl/vlan.h"
+}
+
+desired::Change vlan_change(desired::ChangeType type, opennsl_vlan_t vid) {
+    desired::Change c;
+    c.set_type(type);
+    c.set_vid(vid);
+    return c;
+}
+
+desired::Change port_change(desired::ChangeType type, int64_t port, int64_t value) {
+    desired::Change c;
+    c.set_type(type);
+    c.set_port(port);
+    c.set_value(value);
+    return c;
+}
+
+// plan_port appends the change of one port attribute, reading the current
+// value with get. Attributes already at the intended value are skipped.
+template <typename F>
+int plan_port(desired::ChangeType type, int64_t port, int64_t value, F get, std::vector<desired::Change>* changes) {
+    int current;
+    auto ret = get(&current);
+    if (ret != OPENNSL_E_NONE) {
+        return ret;
+    }
+    if (current != value) {
+        changes->push_back(port_change(type, port, value));
+    }
+    return OPENNSL_E_NONE;
+}
+
+int DesiredStateServiceImpl::plan(const desired::ApplyDesiredStateRequest* req, std::vector<desired::Change>* changes) {
+    int unit = req->unit();
+    auto ret = vlans_->sync(unit);
+    if (ret != OPENNSL_E_NONE) {
+        return ret;
+    }
+    std::vector<vlan_entry> entries;
+    vlans_->list(unit, &entries);
+    std::map<opennsl_vlan_t, vlan_entry> current;
+    for (auto& e : entries) {
+        current[e.vid] = e;
+    }
+    std::map<opennsl_vlan_t, vlan_entry> intended;
+    for (auto& v : req->vlans()) {
+        auto& e = intended[v.vid()];
+        e.vid = v.vid();
+        e.pbmp = get_port_config(v.pbmp());
+        e.ut_pbmp = get_port_config(v.ut_pbmp());
+        OPENNSL_PBMP_AND(e.ut_pbmp, e.pbmp);
+    }
+
+    for (auto& p : req->ports()) {
+        if (p.enable() == desired::PORT_ENABLE_OFF) {
+            ret = plan_port(desired::PORT_ENABLE, p.port(), 0, [&](int* v) { return SDK_CALL(opennsl_port_enable_get, unit, p.port(), v); }, changes);
+            if (ret != OPENNSL_E_NONE) {
+                return ret;
+            }
+        }
+    }
+    for (auto& i : intended) {
+        if (current.count(i.first) == 0) {
+            changes->push_back(vlan_change(desired::VLAN_CREATE, i.first));
+        }
+    }
+    for (auto& i : intended) {
+        auto& want = i.second;
+        opennsl_pbmp_t have, have_ut;
+        OPENNSL_PBMP_CLEAR(have);
+        OPENNSL_PBMP_CLEAR(have_ut);
+        auto it = current.find(i.first);
+        if (it != current.end()) {
+            have = it->second.pbmp;
+            have_ut = it->second.ut_pbmp;
+        }
+        // ports joining the VLAN or changing between tagged and untagged
+        opennsl_pbmp_t add;
+        OPENNSL_PBMP_CLEAR(add);
+        int port;
+        OPENNSL_PBMP_ITER(want.pbmp, port) {
+            if (!OPENNSL_PBMP_MEMBER(have, port) || OPENNSL_PBMP_MEMBER(want.ut_pbmp, port) != OPENNSL_PBMP_MEMBER(have_ut, port)) {
+                OPENNSL_PBMP_PORT_ADD(add, port);
+            }
+        }
+        if (OPENNSL_PBMP_NOT_NULL(add)) {
+            auto c = vlan_change(desired::VLAN_PORT_ADD, i.first);
+            opennsl_pbmp_t ut = want.ut_pbmp;
+            OPENNSL_PBMP_AND(ut, add);
+            set_protobuf_port_config(c.mutable_pbmp(), add);
+            set_protobuf_port_config(c.mutable_ut_pbmp(), ut);
+            changes->push_back(c);
+        }
+    }
+    for (auto& i : intended) {
+        auto it = current.find(i.first);
+        if (it == current.end()) {
+            continue;
+        }
+        opennsl_pbmp_t remove = it->second.pbmp;
+        OPENNSL_PBMP_REMOVE(remove, i.second.pbmp);
+        if (OPENNSL_PBMP_NOT_NULL(remove)) {
+            auto c = vlan_change(desired::VLAN_PORT_REMOVE, i.first);
+            set_protobuf_port_config(c.mutable_pbmp(), remove);
+            changes->push_back(c);
+        }
+    }
+    auto default_vid = vlans_->default_vid(unit);
+    for (auto& c : current) {
+        if (intended.count(c.first) == 0 && c.first != default_vid) {
+            changes->push_back(vlan_change(desired::VLAN_DESTROY, c.first));
+        }
+    }
+    for (auto& p : req->ports()) {
+        if (p.speed() != 0) {
+            ret = plan_port(desired::PORT_SPEED, p.port(), p.speed(), [&](int* v) { return SDK_CALL(opennsl_port_speed_get, unit, p.port(), v); }, changes);
+            if (ret != OPENNSL_E_NONE) {
+                return ret;
+            }
+        }
+        if (p.autoneg() != desired::PORT_AUTONEG_UNCHANGED) {
+            int autoneg = p.autoneg() == desired::PORT_AUTONEG_ON ? 1 : 0;
+            ret = plan_port(desired::PORT_AUTONEG, p.port(), autoneg, [&](int* v) { return SDK_CALL(opennsl_port_autoneg_get, unit, p.port(), v); }, changes);
+            if (ret != OPENNSL_E_NONE) {
+                return ret;
+            }
+        }
+    }
+    for (auto& p : req->ports()) {
+        if (p.enable() == desired::PORT_ENABLE_ON) {
+            ret = plan_port(desired::PORT_ENABLE, p.port(), 1, [&](int* v) { return SDK_CALL(opennsl_port_enable_get, unit, p.port(), v); }, changes);
+            if (ret != OPENNSL_E_NONE) {
+                return ret;
+            }
+        }
+    }
+    return OPENNSL_E_NONE;
+}
+
+// apply makes one planned change and updates the VLAN table, the
+// ConfigState and the Port service's in-flight reads the way the VLAN and
+// Port services do.
+int DesiredStateServiceImpl::apply(int unit, const desired::Change& c) {
+    int ret = OPENNSL_E_PARAM;
+    switch (c.type()) {
+    case desired::VLAN_CREATE:
+        ret = SDK_CALL(opennsl_vlan_create, unit, c.vid());
+        if (ret == OPENNSL_E_NONE) {
+            vlans_->create(unit, c.vid());
+        }
+        break;
+    case desired::VLAN_DESTROY:
+        ret = SDK_CALL(opennsl_vlan_destroy, unit, c.vid());
+        if (ret == OPENNSL_E_NONE) {
+            vlans_->destroy(unit, c.vid());
+        }
+        break;
+    case desired::VLAN_PORT_ADD: {
+        auto pbmp = get_port_config(c.pbmp());
+        auto ubmp = get_port_config(c.ut_pbmp());
+        ret = SDK_CALL(opennsl_vlan_port_add, unit, c.vid(), pbmp, ubmp);
+        if (ret == OPENNSL_E_NONE) {
+            vlans_->port_add(unit, c.vid(), pbmp, ubmp);
+        }
+        break;
+    }
+    case desired::VLAN_PORT_REMOVE: {
+        auto pbmp = get_port_config(c.pbmp());
+        ret = SDK_CALL(opennsl_vlan_port_remove, unit, c.vid(), pbmp);
+        if (ret == OPENNSL_E_NONE) {
+            vlans_->port_remove(unit, c.vid(), pbmp);
+        }
+        break;
+    }
+    case desired::PORT_ENABLE:
+        ret = SDK_CALL(opennsl_port_enable_set, unit, c.port(), c.value());
+        ports_->changed(unit, c.port());
+        if (ret == OPENNSL_E_NONE) {
+            ConfigState::instance().port_set(unit, c.port(), PORT_SETTING_ENABLE, c.value());
+        }
+        break;
+    case desired::PORT_SPEED:
+        ret = SDK_CALL(opennsl_port_speed_set, unit, c.port(), c.value());
+        ports_->changed(unit, c.port());
+        if (ret == OPENNSL_E_NONE) {
+            ConfigState::instance().port_set(unit, c.port(), PORT_SETTING_SPEED, c.value());
+        }
+        break;
+    case desired::PORT_AUTONEG:
+        ret = SDK_CALL(opennsl_port_autoneg_set, unit, c.port(), c.value());
+        ports_->changed(unit, c.port());
+        if (ret == OPENNSL_E_NONE) {
+            ConfigState::instance().port_set(unit, c.port(), PORT_SETTING_AUTONEG, c.value());
+        }
+        break;
+    default:
+        break;
+    }
+    return ret;
+}
+
+grpc::Status DesiredStateServiceImpl::ApplyDesiredState(grpc::ServerContext* context, const desired::ApplyDesiredStateRequest* req, desired::ApplyDesiredStateResponse* res) {
+    RPC_TIMER("DesiredState");
+    RPC_ADMIT("DesiredState", RPC_CLASS_BULK);
+    for (auto& v : req->vlans()) {
+        if (v.vid() < 1 || v.vid() >= OPENNSL_VLAN_MAX) {
+            std::ostringstream err;
+            err << "invalid vid " << v.vid();
+            return grpc::Status(grpc::INVALID_ARGUMENT, err.str());
+        }
+    }
+    if (req->ports_size() > 0) {
+        opennsl_port_config_t config;
+        auto ret = SDK_CALL(opennsl_port_config_get, req->unit(), &config);
+        if (ret != OPENNSL_E_NONE) {
+            std::ostringstream err;
+            err << "opennsl_port_config_get() failed " << opennsl_errmsg(ret);
+            return grpc::Status(grpc::UNAVAILABLE, err.str());
+        }
+        for (auto& p : req->ports()) {
+            if (p.port() < 0 || p.port() >= _SHR_PBMP_WORD_MAX * _SHR_PBMP_WORD_WIDTH || !OPENNSL_PBMP_MEMBER(config.port, p.port())) {
+                std::ostringstream err;
+                err << "invalid port " << p.port();
+                return grpc::Status(grpc::INVALID_ARGUMENT, err.str());
+            }
+            // the SDK takes the speed as an int
+            if (p.speed() < 0 || p.speed() > std::numeric_limits<int>::max()) {
+                std::ostringstream err;
+                err << "invalid speed " << p.speed();
+                return grpc::Status(grpc::INVALID_ARGUMENT, err.str());
+            }
+        }
+    }
+    // no other change of the unit may come between the plan and its apply
+    auto lock = config_lock(req->unit());
+    std::vector<desired::Change> changes;
+    auto ret = plan(req, &changes);
+    if (ret != OPENNSL_E_NONE) {
+        std::ostringstream err;
+        err << "reading the current state failed " << opennsl_errmsg(ret);
+        return grpc::Status(grpc::UNAVAILABLE, err.str());
+    }
+    for (auto& c : changes) {
+        if (req->dry_run()) {
+            *res->add_applied() = c;
+            continue;
+        }
+        ret = apply(req->unit(), c);
+        if (ret != OPENNSL_E_NONE) {
+            auto f = res->add_failed();
+            *f = c;
+            f->set_code(ret);
+            f->set_message(opennsl_errmsg(ret));
+            continue;
+        }
+        *res->add_applied() = c;
+    }
+    return grpc::Status::OK;
+}
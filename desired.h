@@ -0,0 +1,29 @@
+#ifndef DESIRED_H
+#define DESIRED_H
+
+#include <vector>
+
+#include <grpc++/server.h>
+
+#include "desiredservice.grpc.pb.h"
+#include "vlan.h"
+
+class PortServiceImpl;
+
+// DesiredStateServiceImpl applies a declarative VLAN and port configuration:
+// it compares the request with the current state, plans the smallest set of
+// changes and applies them in an order that keeps traffic flowing, ports
+// being shut first and ports being brought up last, and members added to a
+// VLAN before stale ones are removed.
+class DesiredStateServiceImpl final : public desiredservice::DesiredState::Service {
+    public:
+        DesiredStateServiceImpl(VLANTable* vlans, PortServiceImpl* ports) : vlans_(vlans), ports_(ports) {}
+        grpc::Status ApplyDesiredState(grpc::ServerContext* context, const desired::ApplyDesiredStateRequest* req, desired::ApplyDesiredStateResponse* res);
+    private:
+        int plan(const desired::ApplyDesiredStateRequest* req, std::vector<desired::Change>* changes);
+        int apply(int unit, const desired::Change& c);
+        VLANTable* vlans_;
+        PortServiceImpl* ports_;
+};
+
+#endif // DESIRED_H
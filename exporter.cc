@@ -0,0 +1,198 @@
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+#include "exporter.h"
+#include "metrics.h"
+#include "admission.h"
+
+const char* OPENMETRICS_CONTENT_TYPE = "application/openmetrics-text; version=1.0.0; charset=utf-8";
+const size_t HTTP_REQUEST_MAX = 4096;
+
+bool parse_inet_address(const std::string& address, sockaddr_in* sa) {
+    auto colon = address.rfind(':');
+    if ( colon == std::string::npos ) {
+        return false;
+    }
+    auto host = address.substr(0, colon);
+    auto port = std::atoi(address.c_str() + colon + 1);
+    if ( port <= 0 || port > 65535 ) {
+        return false;
+    }
+    std::memset(sa, 0, sizeof(*sa));
+    sa->sin_family = AF_INET;
+    sa->sin_port = htons(port);
+    if ( host.empty() || host == "*" ) {
+        sa->sin_addr.s_addr = htonl(INADDR_ANY);
+        return true;
+    }
+    if ( host == "localhost" ) {
+        host = "127.0.0.1";
+    }
+    return inet_pton(AF_INET, host.c_str(), &sa->sin_addr) == 1;
+}
+
+bool MetricsExporter::start() {
+    sockaddr_in sa;
+    if ( !parse_inet_address(address_, &sa) ) {
+        std::cerr << "invalid metrics address " << address_ << std::endl;
+        return false;
+    }
+    fd_ = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if ( fd_ < 0 ) {
+        return false;
+    }
+    int on = 1;
+    setsockopt(fd_, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    if ( bind(fd_, (sockaddr*)&sa, sizeof(sa)) < 0 || listen(fd_, 16) < 0 ) {
+        std::cerr << "cannot listen on metrics address " << address_ << ": " << std::strerror(errno) << std::endl;
+        close(fd_);
+        fd_ = -1;
+        return false;
+    }
+    th_ = new std::thread(&MetricsExporter::serve, this);
+    return true;
+}
+
+void MetricsExporter::serve() {
+    while (true) {
+        int fd = accept4(fd_, NULL, NULL, SOCK_CLOEXEC);
+        if ( fd < 0 ) {
+            continue;
+        }
+        handle(fd);
+        close(fd);
+    }
+}
+
+// send_all writes to a scraper connection. MSG_NOSIGNAL turns a scraper
+// that went away into EPIPE, which drops the scrape, instead of a SIGPIPE
+// that would kill the server.
+bool send_all(int fd, const char* p, size_t n) {
+    while ( n > 0 ) {
+        auto w = send(fd, p, n, MSG_NOSIGNAL);
+        if ( w < 0 ) {
+            if ( errno == EINTR ) {
+                continue;
+            }
+            return false;
+        }
+        p += w;
+        n -= w;
+    }
+    return true;
+}
+
+void MetricsExporter::handle(int fd) {
+    timeval tv = {1, 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+    char req[HTTP_REQUEST_MAX + 1];
+    size_t n = 0;
+    while ( n < HTTP_REQUEST_MAX ) {
+        auto r = read(fd, req + n, HTTP_REQUEST_MAX - n);
+        if ( r <= 0 ) {
+            break;
+        }
+        n += r;
+        req[n] = '\0';
+        if ( std::strstr(req, "\r\n\r\n") != NULL ) {
+            break;
+        }
+    }
+    req[n] = '\0';
+    char header[256];
+    if ( std::strncmp(req, "GET /metrics ", 13) != 0 && std::strncmp(req, "GET / ", 6) != 0 ) {
+        auto len = std::snprintf(header, sizeof(header), "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\nConnection: close\r\n\r\n");
+        send_all(fd, header, len);
+        return;
+    }
+    std::shared_ptr<std::string> page;
+    {
+        std::unique_lock<std::mutex> mlock(mutex_);
+        page = page_;
+    }
+    auto len = std::snprintf(header, sizeof(header), "HTTP/1.1 200 OK\r\nContent-Type: %s\r\nContent-Length: %zu\r\nConnection: close\r\n\r\n", OPENMETRICS_CONTENT_TYPE, page->size());
+    if ( send_all(fd, header, len) ) {
+        send_all(fd, page->data(), page->size());
+    }
+}
+
+void MetricsExporter::render(const counter_snapshot& snap) {
+    auto& types = stat_types();
+    if ( families_.empty() ) {
+        for ( auto& t : types ) {
+            families_.push_back("opennsl_port_" + t.name);
+        }
+    }
+    std::shared_ptr<std::string> buf;
+    {
+        std::unique_lock<std::mutex> mlock(mutex_);
+        // reuse the previous page unless a scrape is still writing it out
+        if ( spare_.use_count() == 1 ) {
+            buf = spare_;
+        } else {
+            buf = std::make_shared<std::string>();
+            buf->reserve(page_->capacity());
+        }
+    }
+    auto& out = *buf;
+    out.clear();
+    char line[256];
+
+    for ( size_t i = 0; i < types.size(); i++ ) {
+        out += "# TYPE ";
+        out += families_[i];
+        out += " counter\n";
+        for ( auto& p : snap.ports ) {
+            std::snprintf(line, sizeof(line), "_total{unit=\"%d\",port=\"%s\"} %llu\n", p.unit, p.name.c_str(), (unsigned long long)p.values[i]);
+            out += families_[i];
+            out += line;
+        }
+    }
+    out += "# TYPE opennsl_port_counters_timestamp_seconds gauge\n";
+    std::snprintf(line, sizeof(line), "opennsl_port_counters_timestamp_seconds %.3f\n", snap.timestamp / 1e9);
+    out += line;
+
+    telemetry::Registry::instance().snapshot(&internal_);
+    out += "# TYPE opennsl_server_latency_seconds summary\n";
+    out += "# UNIT opennsl_server_latency_seconds seconds\n";
+    const double quantiles[] = {0.5, 0.9, 0.99, 0.999};
+    for ( auto& m : internal_ ) {
+        auto& h = m.second;
+        if ( h.count() == 0 ) {
+            continue;
+        }
+        for ( auto q : quantiles ) {
+            std::snprintf(line, sizeof(line), "opennsl_server_latency_seconds{name=\"%s\",quantile=\"%g\"} %.9f\n", m.first.c_str(), q, h.percentile(q) / 1e9);
+            out += line;
+        }
+        std::snprintf(line, sizeof(line), "opennsl_server_latency_seconds_count{name=\"%s\"} %llu\n", m.first.c_str(), (unsigned long long)h.count());
+        out += line;
+        std::snprintf(line, sizeof(line), "opennsl_server_latency_seconds_sum{name=\"%s\"} %.9f\n", m.first.c_str(), h.sum() / 1e9);
+        out += line;
+    }
+    out += "# TYPE opennsl_server_admission_waiting gauge\n";
+    for ( int c = 0; c < RPC_CLASS_MAX; c++ ) {
+        std::snprintf(line, sizeof(line), "opennsl_server_admission_waiting{class=\"%s\"} %d\n", rpc_class_name(c), Admission::instance().waiting(c));
+        out += line;
+    }
+    out += "# TYPE opennsl_server_admission_active gauge\n";
+    for ( int c = 0; c < RPC_CLASS_MAX; c++ ) {
+        std::snprintf(line, sizeof(line), "opennsl_server_admission_active{class=\"%s\"} %d\n", rpc_class_name(c), Admission::instance().active(c));
+        out += line;
+    }
+    out += "# EOF\n";
+
+    std::unique_lock<std::mutex> mlock(mutex_);
+    spare_ = page_;
+    page_ = buf;
+}
@@ -0,0 +1,39 @@
+#ifndef EXPORTER_H
+#define EXPORTER_H
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "counters.h"
+#include "histogram.h"
+
+// MetricsExporter serves the port counters and the server's own latency
+// metrics as an OpenMetrics text page over HTTP. The page is rendered on the
+// counter poller thread after every poll into a reused buffer, so a scrape
+// only copies out the last rendering and never calls into the SDK.
+class MetricsExporter {
+    public:
+        MetricsExporter(const std::string& address) : address_(address), fd_(-1), th_(NULL), page_(new std::string()), spare_(new std::string()) {}
+        // start binds the listening socket and starts serving; it returns
+        // false if the address is invalid or cannot be bound.
+        bool start();
+        // render is a CounterPoller listener.
+        void render(const counter_snapshot& snap);
+    private:
+        void serve();
+        void handle(int fd);
+        std::string address_;
+        int fd_;
+        std::thread* th_;
+        std::mutex mutex_;
+        std::shared_ptr<std::string> page_;
+        std::shared_ptr<std::string> spare_;
+        std::vector<std::string> families_;
+        std::vector<std::pair<std::string, Histogram> > internal_;
+};
+
+#endif // EXPORTER_H
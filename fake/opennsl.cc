@@ -0,0 +1,982 @@
+// Simulated OpenNSL SDK.
+//
+// Implements the subset of the opennsl_* API used by the server on top of
+// in-memory port, VLAN, FDB and counter state, so that opennsl-server-fake can
+// be run and measured on a host without a Broadcom ASIC. The simulation is
+// configured through environment variables:
+//
+//   FAKE_OPENNSL_PORTS       number of front panel ports (default 32)
+//   FAKE_OPENNSL_LATENCY_US  delay added to every SDK call (default 0)
+//   FAKE_OPENNSL_LINK_EVENTS link flaps per second per unit (default 0)
+//   FAKE_OPENNSL_L2_EVENTS   learn events per second per unit (default 0)
+//   FAKE_OPENNSL_L2_MAX      learned entries kept before aging (default 4096)
+//
+// Like the real SDK, a call holds the lock of its unit for its whole duration,
+// including the configured latency, so calls on the same unit serialize.
+// Registered callbacks are invoked from a generator thread without any unit
+// lock held.
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+extern "C" {
+#include "opennsl/error.h"
+#include "opennsl/port.h"
+#include "opennsl/stat.h"
+#include "opennsl/vlan.h"
+#include "opennsl/l2.h"
+#include "opennsl/link.h"
+#include "sal/driver.h"
+}
+
+extern "C" {
+char *_shr_errmsg[] = {
+    (char*)"Ok",
+    (char*)"Internal error",
+    (char*)"Out of memory",
+    (char*)"Invalid unit",
+    (char*)"Invalid parameter",
+    (char*)"Table empty",
+    (char*)"Table full",
+    (char*)"Entry not found",
+    (char*)"Entry exists",
+    (char*)"Operation timed out",
+    (char*)"Operation still running",
+    (char*)"Operation failed",
+    (char*)"Operation disabled",
+    (char*)"Invalid identifier",
+    (char*)"No resources for operation",
+    (char*)"Invalid configuration",
+    (char*)"Feature unavailable",
+    (char*)"Feature not initialized",
+    (char*)"Invalid port",
+    (char*)"Unknown error",
+};
+}
+
+namespace {
+
+const int FAKE_MAX_UNITS = 8;
+const int FAKE_CPU_PORT = 0;
+const int FAKE_DEFAULT_SPEED = 10000;
+// local port gports use the _SHR_GPORT_TYPE_LOCAL encoding
+const int FAKE_GPORT_LOCAL = 1 << 26;
+const int FAKE_VLAN_GPORT_ADD_UNTAGGED = 0x1;
+
+typedef std::pair<opennsl_vlan_t, uint64_t> fdb_key;
+
+struct fake_port {
+    int enable;
+    int link;
+    int autoneg;
+    int speed;
+    int linkscan;
+    opennsl_port_if_t intf;
+    opennsl_port_abil_t advert;
+    opennsl_port_ability_t ability_advert;
+    std::map<int, int> controls;
+    std::chrono::steady_clock::time_point stat_cleared;
+};
+
+struct fake_vlan {
+    opennsl_pbmp_t pbmp;
+    opennsl_pbmp_t ubmp;
+};
+
+struct fake_unit {
+    std::mutex mutex;
+    bool initialized;
+    std::vector<fake_port> ports;
+    std::map<opennsl_vlan_t, fake_vlan> vlans;
+    opennsl_vlan_t default_vid;
+    std::map<int, int> vlan_controls;
+    std::map<std::pair<int, int>, int> vlan_port_controls;
+    std::map<fdb_key, opennsl_l2_addr_t> fdb;
+    std::deque<fdb_key> learned;
+    uint64_t next_mac;
+    int linkscan_interval;
+    std::vector<opennsl_linkscan_handler_t> link_handlers;
+    std::vector<std::pair<opennsl_l2_addr_callback_t, void*> > l2_handlers;
+};
+
+struct fake_config {
+    int ports;
+    int latency_us;
+    int link_events;
+    int l2_events;
+    size_t l2_max;
+};
+
+int env_int(const char* name, int def) {
+    auto v = std::getenv(name);
+    if ( v == NULL || *v == '\0' ) {
+        return def;
+    }
+    return std::atoi(v);
+}
+
+fake_config load_config() {
+    fake_config c = {
+        env_int("FAKE_OPENNSL_PORTS", 32),
+        env_int("FAKE_OPENNSL_LATENCY_US", 0),
+        env_int("FAKE_OPENNSL_LINK_EVENTS", 0),
+        env_int("FAKE_OPENNSL_L2_EVENTS", 0),
+        size_t(env_int("FAKE_OPENNSL_L2_MAX", 4096)),
+    };
+    if ( c.ports < 1 ) {
+        c.ports = 1;
+    }
+    if ( c.ports >= _SHR_PBMP_WORD_MAX * 32 ) {
+        c.ports = _SHR_PBMP_WORD_MAX * 32 - 1;
+    }
+    return c;
+}
+
+const fake_config& config() {
+    static const fake_config c = load_config();
+    return c;
+}
+
+fake_unit units[FAKE_MAX_UNITS];
+std::atomic<bool> generator_started(false);
+// units with registered callbacks, so that the generator does not pay the
+// call latency for units nobody listens to
+std::atomic<unsigned> event_units(0);
+
+void delay() {
+    auto us = config().latency_us;
+    if ( us > 0 ) {
+        std::this_thread::sleep_for(std::chrono::microseconds(us));
+    }
+}
+
+// caller must hold u.mutex
+void init_unit(fake_unit& u) {
+    if ( u.initialized ) {
+        return;
+    }
+    auto n = config().ports;
+    auto now = std::chrono::steady_clock::now();
+    u.ports.clear();
+    u.ports.resize(n + 1);
+    for ( auto& p : u.ports ) {
+        p.enable = 1;
+        p.link = 1;
+        p.autoneg = 0;
+        p.speed = FAKE_DEFAULT_SPEED;
+        p.linkscan = 0;
+        p.intf = 0;
+        p.advert = 0;
+        std::memset(&p.ability_advert, 0, sizeof(p.ability_advert));
+        p.stat_cleared = now;
+    }
+    fake_vlan v;
+    OPENNSL_PBMP_CLEAR(v.pbmp);
+    for ( int i = 0; i <= n; i++ ) {
+        OPENNSL_PBMP_PORT_ADD(v.pbmp, i);
+    }
+    v.ubmp = v.pbmp;
+    u.vlans.clear();
+    u.vlans[OPENNSL_VLAN_DEFAULT] = v;
+    u.default_vid = OPENNSL_VLAN_DEFAULT;
+    u.next_mac = 1;
+    u.linkscan_interval = 0;
+    u.initialized = true;
+}
+
+// Scoped access to a unit: validates the unit number, takes its lock and
+// charges the configured latency.
+class unit_call {
+    public:
+        unit_call(int unit) : u_(NULL) {
+            if ( unit < 0 || unit >= FAKE_MAX_UNITS ) {
+                return;
+            }
+            u_ = &units[unit];
+            lock_ = std::unique_lock<std::mutex>(u_->mutex);
+            init_unit(*u_);
+            delay();
+        }
+        fake_unit* get() { return u_; }
+        bool valid_port(opennsl_port_t port) {
+            return port >= 0 && port < int(u_->ports.size());
+        }
+        fake_port* port(opennsl_port_t port) {
+            return valid_port(port) ? &u_->ports[port] : NULL;
+        }
+    private:
+        fake_unit* u_;
+        std::unique_lock<std::mutex> lock_;
+};
+
+uint64_t mac_to_u64(const opennsl_mac_t mac) {
+    uint64_t v = 0;
+    for ( int i = 0; i < 6; i++ ) {
+        v = (v << 8) | mac[i];
+    }
+    return v;
+}
+
+void u64_to_mac(uint64_t v, opennsl_mac_t mac) {
+    for ( int i = 5; i >= 0; i-- ) {
+        mac[i] = v & 0xff;
+        v >>= 8;
+    }
+}
+
+// Counters grow linearly from the last clear at a rate derived from the port
+// and the counter type, which is enough to make deltas and rates non-trivial.
+uint64_t stat_value(const fake_port& p, opennsl_port_t port, int type) {
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - p.stat_cleared).count();
+    uint64_t rate = 1 + ((port * 31 + type * 7) % 97);
+    return uint64_t(elapsed) * rate;
+}
+
+void link_event(int unit) {
+    std::vector<opennsl_linkscan_handler_t> handlers;
+    opennsl_port_t port;
+    opennsl_port_info_t info;
+    {
+        unit_call c(unit);
+        auto u = c.get();
+        if ( u->link_handlers.empty() ) {
+            return;
+        }
+        port = 1 + std::rand() % (u->ports.size() - 1);
+        auto& p = u->ports[port];
+        p.link = !p.link;
+        std::memset(&info, 0, sizeof(info));
+        info.enable = p.enable;
+        info.linkstatus = p.link;
+        info.autoneg = p.autoneg;
+        info.speed = p.speed;
+        info.linkscan = p.linkscan;
+        handlers = u->link_handlers;
+    }
+    for ( auto h : handlers ) {
+        h(unit, port, &info);
+    }
+}
+
+void l2_event(int unit) {
+    std::vector<std::pair<opennsl_l2_addr_callback_t, void*> > handlers;
+    std::vector<std::pair<opennsl_l2_addr_t, int> > events;
+    {
+        unit_call c(unit);
+        auto u = c.get();
+        if ( u->l2_handlers.empty() ) {
+            return;
+        }
+        opennsl_mac_t mac;
+        opennsl_l2_addr_t addr;
+        u64_to_mac(0x020000000000ULL | u->next_mac++, mac);
+        opennsl_l2_addr_t_init(&addr, mac, u->default_vid);
+        addr.port = 1 + std::rand() % (u->ports.size() - 1);
+        auto key = fdb_key(addr.vid, mac_to_u64(mac));
+        u->fdb[key] = addr;
+        u->learned.push_back(key);
+        events.push_back(std::make_pair(addr, OPENNSL_L2_CALLBACK_LEARN_EVENT));
+        while ( u->learned.size() > config().l2_max ) {
+            auto it = u->fdb.find(u->learned.front());
+            u->learned.pop_front();
+            if ( it == u->fdb.end() ) {
+                continue;
+            }
+            events.push_back(std::make_pair(it->second, OPENNSL_L2_CALLBACK_AGE_EVENT));
+            u->fdb.erase(it);
+        }
+        handlers = u->l2_handlers;
+    }
+    for ( auto& e : events ) {
+        for ( auto& h : handlers ) {
+            h.first(unit, &e.first, e.second, h.second);
+        }
+    }
+}
+
+void generator_loop() {
+    typedef std::chrono::steady_clock clock;
+    auto& c = config();
+    auto link_period = c.link_events > 0 ? std::chrono::microseconds(1000000 / c.link_events) : std::chrono::microseconds(0);
+    auto l2_period = c.l2_events > 0 ? std::chrono::microseconds(1000000 / c.l2_events) : std::chrono::microseconds(0);
+    auto next_link = clock::now();
+    auto next_l2 = clock::now();
+    while (true) {
+        auto now = clock::now();
+        if ( c.link_events > 0 && now >= next_link ) {
+            for ( int unit = 0; unit < FAKE_MAX_UNITS; unit++ ) {
+                if ( event_units & (1u << unit) ) {
+                    link_event(unit);
+                }
+            }
+            next_link += link_period;
+        }
+        if ( c.l2_events > 0 && now >= next_l2 ) {
+            for ( int unit = 0; unit < FAKE_MAX_UNITS; unit++ ) {
+                if ( event_units & (1u << unit) ) {
+                    l2_event(unit);
+                }
+            }
+            next_l2 += l2_period;
+        }
+        auto next = next_link;
+        if ( c.link_events <= 0 || (c.l2_events > 0 && next_l2 < next) ) {
+            next = next_l2;
+        }
+        std::this_thread::sleep_until(next);
+    }
+}
+
+void start_generator() {
+    if ( config().link_events <= 0 && config().l2_events <= 0 ) {
+        return;
+    }
+    if ( generator_started.exchange(true) ) {
+        return;
+    }
+    std::thread(generator_loop).detach();
+}
+
+} // namespace
+
+#define FAKE_UNIT(c, unit) \
+    unit_call c(unit); \
+    if ( c.get() == NULL ) { return OPENNSL_E_UNIT; }
+
+#define FAKE_PORT(c, p, port) \
+    auto p = c.port(port); \
+    if ( p == NULL ) { return OPENNSL_E_PORT; }
+
+extern "C" {
+
+int opennsl_driver_init(opennsl_init_t *init) {
+    for ( int unit = 0; unit < FAKE_MAX_UNITS; unit++ ) {
+        unit_call c(unit);
+    }
+    start_generator();
+    return OPENNSL_E_NONE;
+}
+
+char *opennsl_version_get(void) {
+    return (char*)"fake-opennsl";
+}
+
+// port
+
+int opennsl_port_init(int unit) {
+    FAKE_UNIT(c, unit);
+    return OPENNSL_E_NONE;
+}
+
+int opennsl_port_clear(int unit) {
+    FAKE_UNIT(c, unit);
+    auto u = c.get();
+    u->initialized = false;
+    init_unit(*u);
+    return OPENNSL_E_NONE;
+}
+
+int opennsl_port_probe(int unit, opennsl_pbmp_t pbmp, opennsl_pbmp_t *okay_pbmp) {
+    FAKE_UNIT(c, unit);
+    int port;
+    OPENNSL_PBMP_CLEAR(*okay_pbmp);
+    OPENNSL_PBMP_ITER(pbmp, port) {
+        if ( c.valid_port(port) ) {
+            OPENNSL_PBMP_PORT_ADD(*okay_pbmp, port);
+        }
+    }
+    return OPENNSL_E_NONE;
+}
+
+int opennsl_port_detach(int unit, opennsl_pbmp_t pbmp, opennsl_pbmp_t *detached) {
+    FAKE_UNIT(c, unit);
+    int port;
+    OPENNSL_PBMP_CLEAR(*detached);
+    OPENNSL_PBMP_ITER(pbmp, port) {
+        if ( c.valid_port(port) ) {
+            c.port(port)->enable = 0;
+            OPENNSL_PBMP_PORT_ADD(*detached, port);
+        }
+    }
+    return OPENNSL_E_NONE;
+}
+
+int opennsl_port_config_get(int unit, opennsl_port_config_t *config) {
+    FAKE_UNIT(c, unit);
+    std::memset(config, 0, sizeof(*config));
+    for ( int port = 0; port < int(c.get()->ports.size()); port++ ) {
+        if ( port == FAKE_CPU_PORT ) {
+            OPENNSL_PBMP_PORT_ADD(config->cpu, port);
+        } else {
+            OPENNSL_PBMP_PORT_ADD(config->xe, port);
+            OPENNSL_PBMP_PORT_ADD(config->e, port);
+            OPENNSL_PBMP_PORT_ADD(config->port, port);
+        }
+        OPENNSL_PBMP_PORT_ADD(config->all, port);
+    }
+    return OPENNSL_E_NONE;
+}
+
+char *opennsl_port_name(int unit, int port) {
+    static char names[_SHR_PBMP_WORD_MAX * 32][8];
+    static std::once_flag once;
+    std::call_once(once, []() {
+        for ( int i = 0; i < _SHR_PBMP_WORD_MAX * 32; i++ ) {
+            if ( i == FAKE_CPU_PORT ) {
+                std::strcpy(names[i], "cpu0");
+            } else {
+                std::snprintf(names[i], sizeof(names[i]), "xe%d", i - 1);
+            }
+        }
+    });
+    if ( port < 0 || port >= _SHR_PBMP_WORD_MAX * 32 ) {
+        return (char*)"?";
+    }
+    return names[port];
+}
+
+int opennsl_port_enable_set(int unit, opennsl_port_t port, int enable) {
+    FAKE_UNIT(c, unit);
+    FAKE_PORT(c, p, port);
+    p->enable = enable;
+    return OPENNSL_E_NONE;
+}
+
+int opennsl_port_enable_get(int unit, opennsl_port_t port, int *enable) {
+    FAKE_UNIT(c, unit);
+    FAKE_PORT(c, p, port);
+    *enable = p->enable;
+    return OPENNSL_E_NONE;
+}
+
+int opennsl_port_advert_set(int unit, opennsl_port_t port, opennsl_port_abil_t ability_mask) {
+    FAKE_UNIT(c, unit);
+    FAKE_PORT(c, p, port);
+    p->advert = ability_mask;
+    return OPENNSL_E_NONE;
+}
+
+int opennsl_port_advert_get(int unit, opennsl_port_t port, opennsl_port_abil_t *ability_mask) {
+    FAKE_UNIT(c, unit);
+    FAKE_PORT(c, p, port);
+    *ability_mask = p->advert;
+    return OPENNSL_E_NONE;
+}
+
+int opennsl_port_ability_advert_set(int unit, opennsl_port_t port, opennsl_port_ability_t *ability_mask) {
+    FAKE_UNIT(c, unit);
+    FAKE_PORT(c, p, port);
+    p->ability_advert = *ability_mask;
+    return OPENNSL_E_NONE;
+}
+
+int opennsl_port_ability_advert_get(int unit, opennsl_port_t port, opennsl_port_ability_t *ability_mask) {
+    FAKE_UNIT(c, unit);
+    FAKE_PORT(c, p, port);
+    *ability_mask = p->ability_advert;
+    return OPENNSL_E_NONE;
+}
+
+int opennsl_port_advert_remote_get(int unit, opennsl_port_t port, opennsl_port_abil_t *ability_mask) {
+    FAKE_UNIT(c, unit);
+    FAKE_PORT(c, p, port);
+    *ability_mask = p->advert;
+    return OPENNSL_E_NONE;
+}
+
+int opennsl_port_ability_remote_get(int unit, opennsl_port_t port, opennsl_port_ability_t *ability_mask) {
+    FAKE_UNIT(c, unit);
+    FAKE_PORT(c, p, port);
+    *ability_mask = p->ability_advert;
+    return OPENNSL_E_NONE;
+}
+
+int opennsl_port_ability_get(int unit, opennsl_port_t port, opennsl_port_abil_t *local_ability_mask) {
+    FAKE_UNIT(c, unit);
+    FAKE_PORT(c, p, port);
+    *local_ability_mask = p->advert;
+    return OPENNSL_E_NONE;
+}
+
+int opennsl_port_ability_local_get(int unit, opennsl_port_t port, opennsl_port_ability_t *local_ability_mask) {
+    FAKE_UNIT(c, unit);
+    FAKE_PORT(c, p, port);
+    *local_ability_mask = p->ability_advert;
+    return OPENNSL_E_NONE;
+}
+
+int opennsl_port_linkscan_set(int unit, opennsl_port_t port, int linkscan) {
+    FAKE_UNIT(c, unit);
+    FAKE_PORT(c, p, port);
+    p->linkscan = linkscan;
+    return OPENNSL_E_NONE;
+}
+
+int opennsl_port_linkscan_get(int unit, opennsl_port_t port, int *linkscan) {
+    FAKE_UNIT(c, unit);
+    FAKE_PORT(c, p, port);
+    *linkscan = p->linkscan;
+    return OPENNSL_E_NONE;
+}
+
+int opennsl_port_autoneg_set(int unit, opennsl_port_t port, int autoneg) {
+    FAKE_UNIT(c, unit);
+    FAKE_PORT(c, p, port);
+    p->autoneg = autoneg;
+    return OPENNSL_E_NONE;
+}
+
+int opennsl_port_autoneg_get(int unit, opennsl_port_t port, int *autoneg) {
+    FAKE_UNIT(c, unit);
+    FAKE_PORT(c, p, port);
+    *autoneg = p->autoneg;
+    return OPENNSL_E_NONE;
+}
+
+int opennsl_port_speed_max(int unit, opennsl_port_t port, int *speed) {
+    FAKE_UNIT(c, unit);
+    FAKE_PORT(c, p, port);
+    *speed = FAKE_DEFAULT_SPEED;
+    return OPENNSL_E_NONE;
+}
+
+int opennsl_port_speed_set(int unit, opennsl_port_t port, int speed) {
+    FAKE_UNIT(c, unit);
+    FAKE_PORT(c, p, port);
+    if ( speed < 0 || speed > FAKE_DEFAULT_SPEED ) {
+        return OPENNSL_E_PARAM;
+    }
+    p->speed = speed;
+    return OPENNSL_E_NONE;
+}
+
+int opennsl_port_speed_get(int unit, opennsl_port_t port, int *speed) {
+    FAKE_UNIT(c, unit);
+    FAKE_PORT(c, p, port);
+    *speed = p->speed;
+    return OPENNSL_E_NONE;
+}
+
+int opennsl_port_interface_set(int unit, opennsl_port_t port, opennsl_port_if_t intf) {
+    FAKE_UNIT(c, unit);
+    FAKE_PORT(c, p, port);
+    p->intf = intf;
+    return OPENNSL_E_NONE;
+}
+
+int opennsl_port_interface_get(int unit, opennsl_port_t port, opennsl_port_if_t *intf) {
+    FAKE_UNIT(c, unit);
+    FAKE_PORT(c, p, port);
+    *intf = p->intf;
+    return OPENNSL_E_NONE;
+}
+
+int opennsl_port_link_status_get(int unit, opennsl_port_t port, int *status) {
+    FAKE_UNIT(c, unit);
+    FAKE_PORT(c, p, port);
+    *status = p->enable && p->link;
+    return OPENNSL_E_NONE;
+}
+
+int opennsl_port_link_failed_clear(int unit, opennsl_port_t port) {
+    FAKE_UNIT(c, unit);
+    FAKE_PORT(c, p, port);
+    return OPENNSL_E_NONE;
+}
+
+int opennsl_port_control_set(int unit, opennsl_port_t port, opennsl_port_control_t type, int value) {
+    FAKE_UNIT(c, unit);
+    FAKE_PORT(c, p, port);
+    p->controls[type] = value;
+    return OPENNSL_E_NONE;
+}
+
+int opennsl_port_control_get(int unit, opennsl_port_t port, opennsl_port_control_t type, int *value) {
+    FAKE_UNIT(c, unit);
+    FAKE_PORT(c, p, port);
+    auto it = p->controls.find(type);
+    *value = it == p->controls.end() ? 0 : it->second;
+    return OPENNSL_E_NONE;
+}
+
+int opennsl_port_gport_get(int unit, opennsl_port_t port, opennsl_gport_t *gport) {
+    FAKE_UNIT(c, unit);
+    FAKE_PORT(c, p, port);
+    *gport = FAKE_GPORT_LOCAL | port;
+    return OPENNSL_E_NONE;
+}
+
+int opennsl_port_local_get(int unit, opennsl_gport_t gport, opennsl_port_t *local_port) {
+    FAKE_UNIT(c, unit);
+    auto port = gport & ~FAKE_GPORT_LOCAL;
+    if ( !c.valid_port(port) ) {
+        return OPENNSL_E_PORT;
+    }
+    *local_port = port;
+    return OPENNSL_E_NONE;
+}
+
+// stat
+
+int opennsl_stat_init(int unit) {
+    FAKE_UNIT(c, unit);
+    return OPENNSL_E_NONE;
+}
+
+int opennsl_stat_clear(int unit, opennsl_port_t port) {
+    FAKE_UNIT(c, unit);
+    FAKE_PORT(c, p, port);
+    p->stat_cleared = std::chrono::steady_clock::now();
+    return OPENNSL_E_NONE;
+}
+
+int opennsl_stat_sync(int unit) {
+    FAKE_UNIT(c, unit);
+    return OPENNSL_E_NONE;
+}
+
+int opennsl_stat_get(int unit, opennsl_port_t port, opennsl_stat_val_t type, uint64 *value) {
+    FAKE_UNIT(c, unit);
+    FAKE_PORT(c, p, port);
+    if ( int(type) < 0 ) {
+        return OPENNSL_E_PARAM;
+    }
+    *value = stat_value(*p, port, int(type));
+    return OPENNSL_E_NONE;
+}
+
+// vlan
+
+int opennsl_vlan_create(int unit, opennsl_vlan_t vid) {
+    FAKE_UNIT(c, unit);
+    if ( !OPENNSL_VLAN_VALID(vid) ) {
+        return OPENNSL_E_PARAM;
+    }
+    auto u = c.get();
+    if ( u->vlans.count(vid) ) {
+        return OPENNSL_E_EXISTS;
+    }
+    fake_vlan v;
+    OPENNSL_PBMP_CLEAR(v.pbmp);
+    OPENNSL_PBMP_CLEAR(v.ubmp);
+    u->vlans[vid] = v;
+    return OPENNSL_E_NONE;
+}
+
+int opennsl_vlan_destroy(int unit, opennsl_vlan_t vid) {
+    FAKE_UNIT(c, unit);
+    auto u = c.get();
+    if ( vid == u->default_vid ) {
+        return OPENNSL_E_BADID;
+    }
+    if ( u->vlans.erase(vid) == 0 ) {
+        return OPENNSL_E_NOT_FOUND;
+    }
+    return OPENNSL_E_NONE;
+}
+
+int opennsl_vlan_destroy_all(int unit) {
+    FAKE_UNIT(c, unit);
+    auto u = c.get();
+    for ( auto it = u->vlans.begin(); it != u->vlans.end(); ) {
+        if ( it->first == u->default_vid ) {
+            ++it;
+        } else {
+            it = u->vlans.erase(it);
+        }
+    }
+    return OPENNSL_E_NONE;
+}
+
+int opennsl_vlan_port_add(int unit, opennsl_vlan_t vid, opennsl_pbmp_t pbmp, opennsl_pbmp_t ubmp) {
+    FAKE_UNIT(c, unit);
+    auto it = c.get()->vlans.find(vid);
+    if ( it == c.get()->vlans.end() ) {
+        return OPENNSL_E_NOT_FOUND;
+    }
+    auto& v = it->second;
+    OPENNSL_PBMP_OR(v.pbmp, pbmp);
+    OPENNSL_PBMP_REMOVE(v.ubmp, pbmp);
+    OPENNSL_PBMP_AND(ubmp, pbmp);
+    OPENNSL_PBMP_OR(v.ubmp, ubmp);
+    return OPENNSL_E_NONE;
+}
+
+int opennsl_vlan_port_remove(int unit, opennsl_vlan_t vid, opennsl_pbmp_t pbmp) {
+    FAKE_UNIT(c, unit);
+    auto it = c.get()->vlans.find(vid);
+    if ( it == c.get()->vlans.end() ) {
+        return OPENNSL_E_NOT_FOUND;
+    }
+    OPENNSL_PBMP_REMOVE(it->second.pbmp, pbmp);
+    OPENNSL_PBMP_REMOVE(it->second.ubmp, pbmp);
+    return OPENNSL_E_NONE;
+}
+
+int opennsl_vlan_port_get(int unit, opennsl_vlan_t vid, opennsl_pbmp_t *pbmp, opennsl_pbmp_t *ubmp) {
+    FAKE_UNIT(c, unit);
+    auto it = c.get()->vlans.find(vid);
+    if ( it == c.get()->vlans.end() ) {
+        return OPENNSL_E_NOT_FOUND;
+    }
+    if ( pbmp != NULL ) {
+        *pbmp = it->second.pbmp;
+    }
+    if ( ubmp != NULL ) {
+        *ubmp = it->second.ubmp;
+    }
+    return OPENNSL_E_NONE;
+}
+
+int opennsl_vlan_gport_add(int unit, opennsl_vlan_t vlan, opennsl_gport_t port, int flags) {
+    FAKE_UNIT(c, unit);
+    auto it = c.get()->vlans.find(vlan);
+    if ( it == c.get()->vlans.end() ) {
+        return OPENNSL_E_NOT_FOUND;
+    }
+    auto local = port & ~FAKE_GPORT_LOCAL;
+    if ( !c.valid_port(local) ) {
+        return OPENNSL_E_PORT;
+    }
+    OPENNSL_PBMP_PORT_ADD(it->second.pbmp, local);
+    if ( flags & FAKE_VLAN_GPORT_ADD_UNTAGGED ) {
+        OPENNSL_PBMP_PORT_ADD(it->second.ubmp, local);
+    } else {
+        OPENNSL_PBMP_PORT_REMOVE(it->second.ubmp, local);
+    }
+    return OPENNSL_E_NONE;
+}
+
+int opennsl_vlan_gport_delete(int unit, opennsl_vlan_t vlan, opennsl_gport_t port) {
+    FAKE_UNIT(c, unit);
+    auto it = c.get()->vlans.find(vlan);
+    if ( it == c.get()->vlans.end() ) {
+        return OPENNSL_E_NOT_FOUND;
+    }
+    auto local = port & ~FAKE_GPORT_LOCAL;
+    if ( !c.valid_port(local) ) {
+        return OPENNSL_E_PORT;
+    }
+    OPENNSL_PBMP_PORT_REMOVE(it->second.pbmp, local);
+    OPENNSL_PBMP_PORT_REMOVE(it->second.ubmp, local);
+    return OPENNSL_E_NONE;
+}
+
+int opennsl_vlan_gport_delete_all(int unit, opennsl_vlan_t vlan) {
+    FAKE_UNIT(c, unit);
+    auto it = c.get()->vlans.find(vlan);
+    if ( it == c.get()->vlans.end() ) {
+        return OPENNSL_E_NOT_FOUND;
+    }
+    OPENNSL_PBMP_CLEAR(it->second.pbmp);
+    OPENNSL_PBMP_CLEAR(it->second.ubmp);
+    return OPENNSL_E_NONE;
+}
+
+int opennsl_vlan_list(int unit, opennsl_vlan_data_t **listp, int *countp) {
+    FAKE_UNIT(c, unit);
+    auto& vlans = c.get()->vlans;
+    *countp = vlans.size();
+    *listp = NULL;
+    if ( vlans.empty() ) {
+        return OPENNSL_E_NONE;
+    }
+    auto list = static_cast<opennsl_vlan_data_t*>(std::malloc(sizeof(opennsl_vlan_data_t) * vlans.size()));
+    if ( list == NULL ) {
+        return OPENNSL_E_MEMORY;
+    }
+    int i = 0;
+    for ( auto& v : vlans ) {
+        list[i].vlan_tag = v.first;
+        list[i].port_bitmap = v.second.pbmp;
+        list[i].ut_port_bitmap = v.second.ubmp;
+        i++;
+    }
+    *listp = list;
+    return OPENNSL_E_NONE;
+}
+
+int opennsl_vlan_list_destroy(int unit, opennsl_vlan_data_t *list, int count) {
+    FAKE_UNIT(c, unit);
+    std::free(list);
+    return OPENNSL_E_NONE;
+}
+
+int opennsl_vlan_default_get(int unit, opennsl_vlan_t *vid_ptr) {
+    FAKE_UNIT(c, unit);
+    *vid_ptr = c.get()->default_vid;
+    return OPENNSL_E_NONE;
+}
+
+int opennsl_vlan_default_set(int unit, opennsl_vlan_t vid) {
+    FAKE_UNIT(c, unit);
+    if ( c.get()->vlans.count(vid) == 0 ) {
+        return OPENNSL_E_NOT_FOUND;
+    }
+    c.get()->default_vid = vid;
+    return OPENNSL_E_NONE;
+}
+
+int opennsl_vlan_control_set(int unit, opennsl_vlan_control_t type, int arg) {
+    FAKE_UNIT(c, unit);
+    c.get()->vlan_controls[type] = arg;
+    return OPENNSL_E_NONE;
+}
+
+int opennsl_vlan_control_port_set(int unit, int port, opennsl_vlan_control_port_t type, int arg) {
+    FAKE_UNIT(c, unit);
+    if ( port != -1 && !c.valid_port(port) ) {
+        return OPENNSL_E_PORT;
+    }
+    c.get()->vlan_port_controls[std::make_pair(port, int(type))] = arg;
+    return OPENNSL_E_NONE;
+}
+
+// l2
+
+void opennsl_l2_addr_t_init(opennsl_l2_addr_t *l2addr, const opennsl_mac_t mac_addr, opennsl_vlan_t vid) {
+    std::memset(l2addr, 0, sizeof(*l2addr));
+    std::memcpy(l2addr->mac, mac_addr, sizeof(opennsl_mac_t));
+    l2addr->vid = vid;
+}
+
+int opennsl_l2_addr_add(int unit, opennsl_l2_addr_t *l2addr) {
+    FAKE_UNIT(c, unit);
+    if ( !OPENNSL_VLAN_VALID(l2addr->vid) ) {
+        return OPENNSL_E_PARAM;
+    }
+    c.get()->fdb[fdb_key(l2addr->vid, mac_to_u64(l2addr->mac))] = *l2addr;
+    return OPENNSL_E_NONE;
+}
+
+int opennsl_l2_addr_delete(int unit, opennsl_mac_t mac, opennsl_vlan_t vid) {
+    FAKE_UNIT(c, unit);
+    if ( c.get()->fdb.erase(fdb_key(vid, mac_to_u64(mac))) == 0 ) {
+        return OPENNSL_E_NOT_FOUND;
+    }
+    return OPENNSL_E_NONE;
+}
+
+int opennsl_l2_addr_get(int unit, opennsl_mac_t mac_addr, opennsl_vlan_t vid, opennsl_l2_addr_t *l2addr) {
+    FAKE_UNIT(c, unit);
+    auto& fdb = c.get()->fdb;
+    auto it = fdb.find(fdb_key(vid, mac_to_u64(mac_addr)));
+    if ( it == fdb.end() ) {
+        return OPENNSL_E_NOT_FOUND;
+    }
+    *l2addr = it->second;
+    return OPENNSL_E_NONE;
+}
+
+int opennsl_l2_traverse(int unit, opennsl_l2_traverse_cb trav_fn, void *user_data) {
+    std::vector<opennsl_l2_addr_t> entries;
+    {
+        FAKE_UNIT(c, unit);
+        auto& fdb = c.get()->fdb;
+        entries.reserve(fdb.size());
+        for ( auto& e : fdb ) {
+            entries.push_back(e.second);
+        }
+    }
+    for ( auto& e : entries ) {
+        auto ret = trav_fn(unit, &e, user_data);
+        if ( ret < 0 ) {
+            return ret;
+        }
+    }
+    return OPENNSL_E_NONE;
+}
+
+int opennsl_l2_matched_traverse(int unit, uint32 flags, opennsl_l2_addr_t *match_addr, opennsl_l2_traverse_cb trav_fn, void *user_data) {
+    std::vector<opennsl_l2_addr_t> entries;
+    {
+        FAKE_UNIT(c, unit);
+        auto& fdb = c.get()->fdb;
+        auto it = fdb.begin();
+        auto end = fdb.end();
+        if ( flags & OPENNSL_L2_TRAVERSE_MATCH_VLAN ) {
+            it = fdb.lower_bound(fdb_key(match_addr->vid, 0));
+            end = fdb.upper_bound(fdb_key(match_addr->vid, UINT64_MAX));
+        }
+        for ( ; it != end; it++ ) {
+            auto& e = it->second;
+            if ( (flags & OPENNSL_L2_TRAVERSE_MATCH_MAC) && std::memcmp(e.mac, match_addr->mac, sizeof(opennsl_mac_t)) != 0 ) {
+                continue;
+            }
+            if ( (flags & OPENNSL_L2_TRAVERSE_MATCH_STATIC) && !(e.flags & OPENNSL_L2_STATIC) ) {
+                continue;
+            }
+            entries.push_back(e);
+        }
+    }
+    for ( auto& e : entries ) {
+        auto ret = trav_fn(unit, &e, user_data);
+        if ( ret < 0 ) {
+            return ret;
+        }
+    }
+    return OPENNSL_E_NONE;
+}
+
+int opennsl_l2_addr_register(int unit, opennsl_l2_addr_callback_t callback, void *userdata) {
+    FAKE_UNIT(c, unit);
+    c.get()->l2_handlers.push_back(std::make_pair(callback, userdata));
+    event_units |= 1u << unit;
+    start_generator();
+    return OPENNSL_E_NONE;
+}
+
+// link
+
+int opennsl_linkscan_detach(int unit) {
+    FAKE_UNIT(c, unit);
+    c.get()->linkscan_interval = 0;
+    c.get()->link_handlers.clear();
+    return OPENNSL_E_NONE;
+}
+
+int opennsl_linkscan_enable_set(int unit, int us) {
+    FAKE_UNIT(c, unit);
+    c.get()->linkscan_interval = us;
+    return OPENNSL_E_NONE;
+}
+
+int opennsl_linkscan_enable_get(int unit, int *us) {
+    FAKE_UNIT(c, unit);
+    *us = c.get()->linkscan_interval;
+    return OPENNSL_E_NONE;
+}
+
+int opennsl_linkscan_mode_set(int unit, opennsl_port_t port, int mode) {
+    FAKE_UNIT(c, unit);
+    FAKE_PORT(c, p, port);
+    p->linkscan = mode;
+    return OPENNSL_E_NONE;
+}
+
+int opennsl_linkscan_mode_get(int unit, opennsl_port_t port, int *mode) {
+    FAKE_UNIT(c, unit);
+    FAKE_PORT(c, p, port);
+    *mode = p->linkscan;
+    return OPENNSL_E_NONE;
+}
+
+int opennsl_linkscan_register(int unit, opennsl_linkscan_handler_t f) {
+    FAKE_UNIT(c, unit);
+    c.get()->link_handlers.push_back(f);
+    event_units |= 1u << unit;
+    start_generator();
+    return OPENNSL_E_NONE;
+}
+
+} // extern "C"
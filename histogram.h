@@ -0,0 +1,111 @@
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <cstdint>
+#include <cstring>
+
+// Histogram is a log-linear histogram of unsigned 64bit values. Values below
+// SUB_BUCKETS are counted exactly; above that every power of two is split into
+// SUB_BUCKETS linear buckets, so a reported value is within 1/SUB_BUCKETS of
+// the recorded one while the whole histogram stays a fixed size array.
+class Histogram {
+    public:
+        static const int SUB_BITS = 5;
+        static const int SUB_BUCKETS = 1 << SUB_BITS;
+        static const int BUCKETS = (64 - SUB_BITS + 1) * SUB_BUCKETS;
+
+        Histogram() { clear(); }
+
+        void clear() {
+            std::memset(counts_, 0, sizeof(counts_));
+            count_ = 0;
+            sum_ = 0;
+            max_ = 0;
+        }
+
+        void record(uint64_t v) {
+            counts_[index(v)]++;
+            count_++;
+            sum_ += v;
+            if ( v > max_ ) {
+                max_ = v;
+            }
+        }
+
+        void merge(const Histogram& h) {
+            for ( int i = 0; i < BUCKETS; i++ ) {
+                counts_[i] += h.counts_[i];
+            }
+            count_ += h.count_;
+            sum_ += h.sum_;
+            if ( h.max_ > max_ ) {
+                max_ = h.max_;
+            }
+        }
+
+        // add_bucket and add_totals fold in counts collected elsewhere, e.g.
+        // by a concurrently updated copy of the same bucket layout.
+        void add_bucket(int i, uint64_t n) {
+            counts_[i] += n;
+            count_ += n;
+        }
+
+        void add_totals(uint64_t sum, uint64_t max) {
+            sum_ += sum;
+            if ( max > max_ ) {
+                max_ = max;
+            }
+        }
+
+        // percentile returns the value at or below which p (0..1) of the
+        // recorded values fall.
+        uint64_t percentile(double p) const {
+            if ( count_ == 0 ) {
+                return 0;
+            }
+            uint64_t rank = uint64_t(p * count_);
+            if ( rank >= count_ ) {
+                rank = count_ - 1;
+            }
+            uint64_t seen = 0;
+            for ( int i = 0; i < BUCKETS; i++ ) {
+                seen += counts_[i];
+                if ( seen > rank ) {
+                    auto v = value(i);
+                    return v < max_ ? v : max_;
+                }
+            }
+            return max_;
+        }
+
+        uint64_t count() const { return count_; }
+        uint64_t sum() const { return sum_; }
+        uint64_t max() const { return max_; }
+        uint64_t bucket(int i) const { return counts_[i]; }
+
+        static int index(uint64_t v) {
+            if ( v < uint64_t(SUB_BUCKETS) ) {
+                return int(v);
+            }
+            int shift = 63 - __builtin_clzll(v) - SUB_BITS;
+            return (shift + 1) * SUB_BUCKETS + int((v >> shift) - SUB_BUCKETS);
+        }
+
+        // value returns the midpoint of bucket i.
+        static uint64_t value(int i) {
+            if ( i < SUB_BUCKETS ) {
+                return uint64_t(i);
+            }
+            int shift = i / SUB_BUCKETS - 1;
+            uint64_t low = uint64_t(i % SUB_BUCKETS + SUB_BUCKETS) << shift;
+            return low + ((uint64_t(1) << shift) >> 1);
+        }
+
+    private:
+        uint64_t counts_[BUCKETS];
+        uint64_t count_;
+        uint64_t sum_;
+        uint64_t max_;
+};
+
+#endif // HISTOGRAM_H
@@ -1,3 +1,4 @@
+#include <chrono>
 #include <cstring>
 #include <sstream>
 #include <future>
@@ -6,10 +7,14 @@
 
 #include "l2.grpc.pb.h"
 #include "l2.h"
+#include "metrics.h"
+#include "admission.h"
+#include "config_state.h"
 
 extern "C" {
 #include "opennsl/error.h"
 #include "opennsl/l2.h"
+#include "opennsl/vlan.h"
 }
 
 opennsl_l2_addr_t get_l2_addr(const l2::Address& addr) {
@@ -32,33 +37,41 @@ void set_protobuf_l2_address(l2::Address* dst, const opennsl_l2_addr_t& src) {
 }
 
 grpc::Status L2ServiceImpl::AddAddress(grpc::ServerContext* context, const l2::AddAddressRequest* req, l2::AddAddressResponse* res){
+    RPC_TIMER("L2");
+    RPC_ADMIT("L2", RPC_CLASS_CRITICAL);
     auto addr = get_l2_addr(req->address());
-    auto ret = opennsl_l2_addr_add(req->unit(), &addr);
+    auto ret = SDK_CALL(opennsl_l2_addr_add, req->unit(), &addr);
     if ( ret != OPENNSL_E_NONE ) {
         std::ostringstream err;
         err << "opennsl_l2_addr_add() failed " << opennsl_errmsg(ret);
         return grpc::Status(grpc::UNAVAILABLE, err.str());
     }
+    ConfigState::instance().l2_add(req->unit(), addr);
     return grpc::Status::OK;
 }
 
 grpc::Status L2ServiceImpl::DeleteAddress(grpc::ServerContext* context, const l2::DeleteAddressRequest* req, l2::DeleteAddressResponse* res){
+    RPC_TIMER("L2");
+    RPC_ADMIT("L2", RPC_CLASS_CRITICAL);
     opennsl_mac_t mac;
     std::memcpy(mac, req->mac().c_str(), 6);
-    auto ret = opennsl_l2_addr_delete(req->unit(), mac, req->vid());
+    auto ret = SDK_CALL(opennsl_l2_addr_delete, req->unit(), mac, req->vid());
     if ( ret != OPENNSL_E_NONE ) {
         std::ostringstream err;
         err << "opennsl_l2_addr_delete() failed " << opennsl_errmsg(ret);
         return grpc::Status(grpc::UNAVAILABLE, err.str());
     }
+    ConfigState::instance().l2_delete(req->unit(), mac, req->vid());
     return grpc::Status::OK;
 }
 
 grpc::Status L2ServiceImpl::GetAddress(grpc::ServerContext* context, const l2::GetAddressRequest* req, l2::GetAddressResponse* res){
+    RPC_TIMER("L2");
+    RPC_ADMIT("L2", RPC_CLASS_NORMAL);
     opennsl_mac_t mac;
     opennsl_l2_addr_t addr;
     std::memcpy(mac, req->mac().c_str(), 6);
-    auto ret = opennsl_l2_addr_get(req->unit(), mac, req->vid(), &addr);
+    auto ret = SDK_CALL(opennsl_l2_addr_get, req->unit(), mac, req->vid(), &addr);
     if ( ret != OPENNSL_E_NONE ) {
         std::ostringstream err;
         err << "opennsl_l2_addr_get() failed " << opennsl_errmsg(ret);
@@ -76,13 +89,36 @@ int trav_fn(int unit, opennsl_l2_addr_t *info, void *user_data) {
     return 0;
 }
 
+// List walks the L2 table one VLAN at a time. Each VLAN is a separate SDK
+// call on the unit worker, so calls of higher classes, such as AddAddress,
+// run between them instead of waiting for a traverse of the whole table.
 grpc::Status L2ServiceImpl::List(grpc::ServerContext* context, const l2::ListRequest* req, l2::ListResponse* res){
-    auto ret = opennsl_l2_traverse(req->unit(), trav_fn, res);
+    RPC_TIMER("L2");
+    RPC_ADMIT("L2", RPC_CLASS_BULK);
+    opennsl_vlan_data_t* p;
+    int count;
+    auto ret = SDK_CALL(opennsl_vlan_list, req->unit(), &p, &count);
     if ( ret != OPENNSL_E_NONE ) {
         std::ostringstream err;
-        err << "opennsl_l2_traverse() failed " << opennsl_errmsg(ret);
+        err << "opennsl_vlan_list() failed " << opennsl_errmsg(ret);
         return grpc::Status(grpc::UNAVAILABLE, err.str());
     }
+    std::vector<opennsl_vlan_t> vids;
+    for ( int i = 0; i < count; i++ ) {
+        vids.push_back(p[i].vlan_tag);
+    }
+    SDK_CALL(opennsl_vlan_list_destroy, req->unit(), p, count);
+    for ( auto vid : vids ) {
+        opennsl_mac_t mac = {0};
+        opennsl_l2_addr_t match;
+        opennsl_l2_addr_t_init(&match, mac, vid);
+        ret = SDK_CALL(opennsl_l2_matched_traverse, req->unit(), OPENNSL_L2_TRAVERSE_MATCH_VLAN, &match, trav_fn, res);
+        if ( ret != OPENNSL_E_NONE ) {
+            std::ostringstream err;
+            err << "opennsl_l2_matched_traverse() failed " << opennsl_errmsg(ret);
+            return grpc::Status(grpc::UNAVAILABLE, err.str());
+        }
+    }
     return grpc::Status::OK;
 }
 
@@ -90,8 +126,9 @@ void L2ServiceImpl::handle_info(const l2_info& info) {
     grpc::WriteOptions option;
     l2::MonitorResponse res;
     res.set_unit(info.unit);
-    set_protobuf_l2_address(res.mutable_address(), *info.l2addr);
+    set_protobuf_l2_address(res.mutable_address(), info.l2addr);
     res.set_operation(static_cast<l2::L2Operation>(info.operation));
+    res.set_timestamp(info.timestamp);
     std::vector<l2_request*> _reqs;
     std::unique_lock<std::mutex> mlock(mutex_);
     for ( auto req : reqs ) {
@@ -112,14 +149,17 @@ void L2ServiceImpl::loop() {
 
 void l2_addr_handler(int unit, opennsl_l2_addr_t *l2addr, int op, void *userdata) {
     auto q = static_cast<Queue<l2_info>*>(userdata);
-    l2_info i{unit, l2addr, op};
+    // the SDK owns l2addr only for the duration of the callback
+    auto now = std::chrono::system_clock::now().time_since_epoch();
+    l2_info i{unit, *l2addr, op, userdata, std::chrono::duration_cast<std::chrono::nanoseconds>(now).count()};
     q->push(i);
 }
 
 grpc::Status L2ServiceImpl::Monitor(grpc::ServerContext* context, const l2::MonitorRequest* req, grpc::ServerWriter< l2::MonitorResponse>* writer){
+    RPC_TIMER("L2");
     if ( !monitoring ) {
         th = new std::thread(&L2ServiceImpl::loop, this);
-        auto ret = opennsl_l2_addr_register(req->unit(), l2_addr_handler, static_cast<void*>(info_q));
+        auto ret = SDK_CALL(opennsl_l2_addr_register, req->unit(), l2_addr_handler, static_cast<void*>(info_q));
         if ( ret != OPENNSL_E_NONE ) {
             return grpc::Status(grpc::UNAVAILABLE, "opennsl_l2_addr_register() failed");
         }
@@ -12,9 +12,10 @@ extern "C" {
 
 struct l2_info {
     int unit;
-    opennsl_l2_addr_t *l2addr;
+    opennsl_l2_addr_t l2addr;
     int operation;
     void *userdata;
+    int64_t timestamp;
 };
 
 struct l2_request {
@@ -24,6 +25,7 @@ struct l2_request {
 
 class L2ServiceImpl final : public l2service::L2::Service {
     public:
+        L2ServiceImpl() : monitoring(false), th(NULL), info_q(new Queue<l2_info>()) {}
         grpc::Status AddAddress(grpc::ServerContext* context, const l2::AddAddressRequest* req, l2::AddAddressResponse* res);
         grpc::Status DeleteAddress(grpc::ServerContext* context, const l2::DeleteAddressRequest* req, l2::DeleteAddressResponse* res);
         grpc::Status GetAddress(grpc::ServerContext* context, const l2::GetAddressRequest* req, l2::GetAddressResponse* res);
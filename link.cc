@@ -1,3 +1,4 @@
+#include <chrono>
 #include <future>
 
 #include <grpc++/server.h>
@@ -5,6 +6,8 @@
 
 #include "linkservice.grpc.pb.h"
 #include "link.h"
+#include "metrics.h"
+#include "admission.h"
 
 extern "C" {
 #include "opennsl/error.h"
@@ -14,7 +17,9 @@ extern "C" {
 Queue<linkscan_info> q;
 
 grpc::Status LinkServiceImpl::Detach(grpc::ServerContext* context, const link::DetachRequest* req, link::DetachResponse* res) {
-    auto ret = opennsl_linkscan_detach(req->unit());
+    RPC_TIMER("Link");
+    RPC_ADMIT("Link", RPC_CLASS_NORMAL);
+    auto ret = SDK_CALL(opennsl_linkscan_detach, req->unit());
     if (ret != OPENNSL_E_NONE) {
         return grpc::Status(grpc::UNAVAILABLE, "opennsl_linkscan_detach() failed");
     }
@@ -22,7 +27,9 @@ grpc::Status LinkServiceImpl::Detach(grpc::ServerContext* context, const link::D
 }
 
 grpc::Status LinkServiceImpl::LinkscanEnableSet(grpc::ServerContext* context, const link::LinkscanEnableSetRequest* req, link::LinkscanEnableSetResponse* res) {
-    auto ret = opennsl_linkscan_enable_set(req->unit(), req->interval());
+    RPC_TIMER("Link");
+    RPC_ADMIT("Link", RPC_CLASS_NORMAL);
+    auto ret = SDK_CALL(opennsl_linkscan_enable_set, req->unit(), req->interval());
     if (ret != OPENNSL_E_NONE) {
         return grpc::Status(grpc::UNAVAILABLE, "opennsl_linkscan_enable_set() failed");
     }
@@ -30,8 +37,10 @@ grpc::Status LinkServiceImpl::LinkscanEnableSet(grpc::ServerContext* context, co
 }
 
 grpc::Status LinkServiceImpl::LinkscanEnableGet(grpc::ServerContext* context, const link::LinkscanEnableGetRequest* req, link::LinkscanEnableGetResponse* res) {
+    RPC_TIMER("Link");
+    RPC_ADMIT("Link", RPC_CLASS_NORMAL);
     int interval;
-    auto ret = opennsl_linkscan_enable_get(req->unit(), &interval);
+    auto ret = SDK_CALL(opennsl_linkscan_enable_get, req->unit(), &interval);
     if (ret != OPENNSL_E_NONE) {
         return grpc::Status(grpc::UNAVAILABLE, "opennsl_linkscan_enable_set() failed");
     }
@@ -40,7 +49,9 @@ grpc::Status LinkServiceImpl::LinkscanEnableGet(grpc::ServerContext* context, co
 }
 
 grpc::Status LinkServiceImpl::LinkscanModeSet(grpc::ServerContext* context, const link::LinkscanModeSetRequest* req, link::LinkscanModeSetResponse* res) {
-    auto ret = opennsl_linkscan_mode_set(req->unit(), req->port(), int(req->mode()));
+    RPC_TIMER("Link");
+    RPC_ADMIT("Link", RPC_CLASS_NORMAL);
+    auto ret = SDK_CALL(opennsl_linkscan_mode_set, req->unit(), req->port(), int(req->mode()));
     if (ret != OPENNSL_E_NONE) {
         return grpc::Status(grpc::UNAVAILABLE, "opennsl_linkscan_mode_set() failed");
     }
@@ -48,8 +59,10 @@ grpc::Status LinkServiceImpl::LinkscanModeSet(grpc::ServerContext* context, cons
 }
 
 grpc::Status LinkServiceImpl::LinkscanModeGet(grpc::ServerContext* context, const link::LinkscanModeGetRequest* req, link::LinkscanModeGetResponse* res) {
+    RPC_TIMER("Link");
+    RPC_ADMIT("Link", RPC_CLASS_NORMAL);
     int mode;
-    auto ret = opennsl_linkscan_mode_get(req->unit(), req->port(), &mode);
+    auto ret = SDK_CALL(opennsl_linkscan_mode_get, req->unit(), req->port(), &mode);
     if (ret != OPENNSL_E_NONE) {
         return grpc::Status(grpc::UNAVAILABLE, "opennsl_linkscan_mode_get() failed");
     }
@@ -58,6 +71,8 @@ grpc::Status LinkServiceImpl::LinkscanModeGet(grpc::ServerContext* context, cons
 }
 
 grpc::Status LinkServiceImpl::LinkscanModeSetPBM(grpc::ServerContext* context, const link::LinkscanModeSetPBMRequest* req, link::LinkscanModeSetPBMResponse* res) {
+    RPC_TIMER("Link");
+    RPC_ADMIT("Link", RPC_CLASS_NORMAL);
 }
 
 void LinkServiceImpl::handle_info(const linkscan_info& info) {
@@ -65,6 +80,7 @@ void LinkServiceImpl::handle_info(const linkscan_info& info) {
     link::MonitorResponse res;
     res.set_unit(info.unit);
     res.set_port(info.port);
+    res.set_timestamp(info.timestamp);
     std::vector<linkscan_request*> _reqs;
     std::unique_lock<std::mutex> mlock(mutex_);
     for ( auto req : reqs ) {
@@ -84,14 +100,19 @@ void LinkServiceImpl::loop() {
 }
 
 void linkscan_handler(int unit, opennsl_port_t port, opennsl_port_info_t *info) {
-    linkscan_info i{unit, port, info};
+    auto now = std::chrono::system_clock::now().time_since_epoch();
+    linkscan_info i{unit, port, opennsl_port_info_t(), std::chrono::duration_cast<std::chrono::nanoseconds>(now).count()};
+    if ( info != NULL ) {
+        i.info = *info;
+    }
     q.push(i);
 }
 
 grpc::Status LinkServiceImpl::Monitor(grpc::ServerContext* context, const link::MonitorRequest* req, grpc::ServerWriter<link::MonitorResponse>* writer) {
+    RPC_TIMER("Link");
     if ( !monitoring ) {
         th = new std::thread(&LinkServiceImpl::loop, this);
-        auto ret = opennsl_linkscan_register(req->unit(), linkscan_handler);
+        auto ret = SDK_CALL(opennsl_linkscan_register, req->unit(), linkscan_handler);
         if ( ret != OPENNSL_E_NONE ) {
             return grpc::Status(grpc::UNAVAILABLE, "opennsl_linkscan_register() failed");
         }
@@ -13,7 +13,8 @@ extern "C" {
 struct linkscan_info {
     int unit;
     opennsl_port_t port;
-    opennsl_port_info_t *info;
+    opennsl_port_info_t info; // copied, the SDK's is only valid during the callback
+    int64_t timestamp;
 };
 
 struct linkscan_request {
@@ -23,6 +24,7 @@ struct linkscan_request {
 
 class LinkServiceImpl final : public linkservice::Link::Service {
     public:
+        LinkServiceImpl() : monitoring(false), th(NULL) {}
         grpc::Status Detach(grpc::ServerContext* context, const link::DetachRequest* req, link::DetachResponse* res);
         grpc::Status LinkscanEnableSet(grpc::ServerContext* context, const link::LinkscanEnableSetRequest* req, link::LinkscanEnableSetResponse* res);
         grpc::Status LinkscanEnableGet(grpc::ServerContext* context, const link::LinkscanEnableGetRequest* req, link::LinkscanEnableGetResponse* res);
@@ -0,0 +1,160 @@
+#include <signal.h>
+
+#include <cstdio>
+#include <iostream>
+
+#include <grpc++/server.h>
+
+#include "metricsservice.grpc.pb.h"
+#include "metrics.h"
+
+namespace telemetry {
+
+ThreadHistogram::ThreadHistogram() : count_(0), sum_(0), max_(0) {
+    for ( auto& c : counts_ ) {
+        c.store(0, std::memory_order_relaxed);
+    }
+}
+
+void ThreadHistogram::snapshot(Histogram* h) const {
+    for ( int i = 0; i < Histogram::BUCKETS; i++ ) {
+        auto n = counts_[i].load(std::memory_order_relaxed);
+        if ( n > 0 ) {
+            h->add_bucket(i, n);
+        }
+    }
+    h->add_totals(sum_.load(std::memory_order_relaxed), max_.load(std::memory_order_relaxed));
+}
+
+thread_slot::thread_slot() : in_use(true) {
+    for ( auto& h : histograms ) {
+        h.store(NULL, std::memory_order_relaxed);
+    }
+}
+
+// slot_holder releases the slot of a thread when it exits.
+struct slot_holder {
+    slot_holder() : slot(Registry::instance().acquire()) {}
+    ~slot_holder() { slot->in_use.store(false, std::memory_order_release); }
+    thread_slot* slot;
+};
+
+Registry& Registry::instance() {
+    static Registry r;
+    return r;
+}
+
+int Registry::id(const std::string& name) {
+    std::unique_lock<std::mutex> mlock(mutex_);
+    for ( size_t i = 0; i < names_.size(); i++ ) {
+        if ( names_[i] == name ) {
+            return i;
+        }
+    }
+    if ( names_.size() == MAX_METRICS ) {
+        return -1;
+    }
+    names_.push_back(name);
+    return names_.size() - 1;
+}
+
+thread_slot* Registry::acquire() {
+    std::unique_lock<std::mutex> mlock(mutex_);
+    for ( auto s : slots_ ) {
+        bool free = false;
+        if ( s->in_use.compare_exchange_strong(free, true, std::memory_order_acquire) ) {
+            return s;
+        }
+    }
+    auto s = new thread_slot();
+    slots_.push_back(s);
+    return s;
+}
+
+void Registry::record(int id, uint64_t ns) {
+    static thread_local slot_holder holder;
+    auto& p = holder.slot->histograms[id];
+    auto h = p.load(std::memory_order_relaxed);
+    if ( h == NULL ) {
+        h = new ThreadHistogram();
+        p.store(h, std::memory_order_release);
+    }
+    h->record(ns);
+}
+
+void Registry::snapshot(std::vector<std::pair<std::string, Histogram> >* out) {
+    std::vector<std::string> names;
+    std::vector<thread_slot*> slots;
+    {
+        std::unique_lock<std::mutex> mlock(mutex_);
+        names = names_;
+        slots = slots_;
+    }
+    // entries of a previous snapshot are reused, so that periodic callers
+    // do not reallocate the histograms
+    out->resize(names.size());
+    for ( size_t i = 0; i < names.size(); i++ ) {
+        (*out)[i].first = names[i];
+        (*out)[i].second.clear();
+        for ( auto s : slots ) {
+            auto h = s->histograms[i].load(std::memory_order_acquire);
+            if ( h != NULL ) {
+                h->snapshot(&(*out)[i].second);
+            }
+        }
+    }
+}
+
+void Registry::dump(std::ostream& os) {
+    std::vector<std::pair<std::string, Histogram> > snap;
+    snapshot(&snap);
+    char line[256];
+    std::snprintf(line, sizeof(line), "%-48s %10s %10s %10s %10s %10s %10s\n", "metric", "count", "p50(us)", "p90(us)", "p99(us)", "p999(us)", "max(us)");
+    os << line;
+    for ( auto& m : snap ) {
+        auto& h = m.second;
+        if ( h.count() == 0 ) {
+            continue;
+        }
+        std::snprintf(line, sizeof(line), "%-48s %10llu %10.1f %10.1f %10.1f %10.1f %10.1f\n", m.first.c_str(),
+                (unsigned long long)h.count(), h.percentile(0.5) / 1e3, h.percentile(0.9) / 1e3,
+                h.percentile(0.99) / 1e3, h.percentile(0.999) / 1e3, h.max() / 1e3);
+        os << line;
+    }
+    os.flush();
+}
+
+void dump_on_signal(int sig) {
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, sig);
+    while (true) {
+        int got;
+        if ( sigwait(&set, &got) == 0 && got == sig ) {
+            Registry::instance().dump(std::cerr);
+        }
+    }
+}
+
+} // namespace telemetry
+
+grpc::Status MetricsServiceImpl::Get(grpc::ServerContext* context, const metrics::GetRequest* req, metrics::GetResponse* res) {
+    std::vector<std::pair<std::string, Histogram> > snap;
+    telemetry::Registry::instance().snapshot(&snap);
+    for ( auto& m : snap ) {
+        auto& h = m.second;
+        if ( h.count() == 0 || m.first.compare(0, req->prefix().size(), req->prefix()) != 0 ) {
+            continue;
+        }
+        auto metric = res->add_metrics();
+        metric->set_name(m.first);
+        metric->set_count(h.count());
+        metric->set_sum(h.sum());
+        metric->set_p50(h.percentile(0.5));
+        metric->set_p90(h.percentile(0.9));
+        metric->set_p99(h.percentile(0.99));
+        metric->set_p999(h.percentile(0.999));
+        metric->set_max(h.max());
+    }
+    return grpc::Status::OK;
+}
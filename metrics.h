@@ -0,0 +1,126 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <grpc++/server.h>
+
+#include "metricsservice.grpc.pb.h"
+#include "histogram.h"
+#include "unit_worker.h"
+
+namespace telemetry {
+
+const int MAX_METRICS = 1024;
+
+// ThreadHistogram has the bucket layout of Histogram but is written by a
+// single thread and read concurrently by snapshots. Updates are plain
+// relaxed load/store pairs, so recording costs no locked instruction.
+class ThreadHistogram {
+    public:
+        ThreadHistogram();
+        void record(uint64_t v) {
+            inc(counts_[Histogram::index(v)], 1);
+            inc(count_, 1);
+            inc(sum_, v);
+            if ( v > max_.load(std::memory_order_relaxed) ) {
+                max_.store(v, std::memory_order_relaxed);
+            }
+        }
+        void snapshot(Histogram* h) const;
+    private:
+        static void inc(std::atomic<uint64_t>& c, uint64_t n) {
+            c.store(c.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+        }
+        std::atomic<uint64_t> counts_[Histogram::BUCKETS];
+        std::atomic<uint64_t> count_;
+        std::atomic<uint64_t> sum_;
+        std::atomic<uint64_t> max_;
+};
+
+// thread_slot holds the histograms of one thread. Slots are never freed; a
+// slot released by an exiting thread is reused by the next new thread.
+struct thread_slot {
+    thread_slot();
+    std::atomic<bool> in_use;
+    std::atomic<ThreadHistogram*> histograms[MAX_METRICS];
+};
+
+// Registry maps metric names to ids and owns the per-thread slots.
+class Registry {
+    public:
+        static Registry& instance();
+        int id(const std::string& name);
+        void record(int id, uint64_t ns);
+        void snapshot(std::vector<std::pair<std::string, Histogram> >* out);
+        void dump(std::ostream& os);
+        thread_slot* acquire();
+    private:
+        Registry() {}
+        std::mutex mutex_;
+        std::vector<std::string> names_;
+        std::vector<thread_slot*> slots_;
+};
+
+class Metric {
+    public:
+        Metric(const std::string& name) : id_(Registry::instance().id(name)) {}
+        void record(uint64_t ns) {
+            if ( id_ >= 0 ) {
+                Registry::instance().record(id_, ns);
+            }
+        }
+    private:
+        int id_;
+};
+
+inline uint64_t now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+class Timer {
+    public:
+        Timer(Metric& m) : metric_(m), start_(now_ns()) {}
+        ~Timer() { metric_.record(now_ns() - start_); }
+    private:
+        Metric& metric_;
+        uint64_t start_;
+};
+
+template <typename F>
+auto timed(Metric& m, F f) -> decltype(f()) {
+    Timer t(m);
+    return f();
+}
+
+// dump_on_signal dumps the registry to stderr every time sig is delivered.
+// sig must be blocked in all threads before this is started.
+void dump_on_signal(int sig);
+
+} // namespace telemetry
+
+// RPC_TIMER times the enclosing service method as rpc/<service>.<method>.
+#define RPC_TIMER(service) \
+    static telemetry::Metric rpc_metric_(std::string("rpc/") + service + "." + __func__); \
+    telemetry::Timer rpc_timer_(rpc_metric_)
+
+// SDK_CALL(fn, args...) calls fn(args...) on the worker of its unit (see
+// UnitWorkers) and times the call itself as sdk/<fn>.
+#define SDK_CALL(fn, ...) \
+    UnitWorkers::instance().run(sdk_unit(__VA_ARGS__), [&]() { \
+        return telemetry::timed([]() -> telemetry::Metric& { static telemetry::Metric m("sdk/" #fn); return m; }(), \
+                [&]() { return fn(__VA_ARGS__); }); \
+    })
+
+class MetricsServiceImpl final : public metricsservice::Metrics::Service {
+    public:
+        grpc::Status Get(grpc::ServerContext* context, const metrics::GetRequest* req, metrics::GetResponse* res);
+};
+
+#endif // METRICS_H
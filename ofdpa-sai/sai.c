@@ -10,6 +10,8 @@
 
 #include <sys/ioctl.h>
 #include <sys/socket.h>
+#include <sys/epoll.h>
+#include <errno.h>
 
 #include <linux/if.h>
 #include <linux/if_tun.h>
@@ -23,18 +25,72 @@
 #include <arpa/inet.h>
 
 #include <pthread.h>
+#include <semaphore.h>
+#include <stdarg.h>
+#include <time.h>
 
 #define OBJECT_TYPE_SHIFT 48
 #define VLAN_OFFSET 10
 
+#define ETHER_TYPE_IPV4 0x0800
+#define ETHER_TYPE_ARP 0x0806
 #define ETHER_TYPE_VLAN 0x8100
-
-#define printf(...)          \
-    do {                     \
-        printf(__VA_ARGS__); \
-        fflush(stdout);      \
+#define ETHER_TYPE_IPV6 0x86dd
+#define ETHER_TYPE_SLOW 0x8809 // LACP
+#define ETHER_TYPE_LLDP 0x88cc
+
+#define IP_PROTO_OSPF 89
+#define IP_PROTO_VRRP 112
+#define BGP_PORT 179
+
+// Messages at or above log_level are formatted by the caller into a slot
+// of log_ring and written to stdout by the log thread, so logging never
+// blocks on the terminal and costs a comparison when the level is off.
+// Each call site logs at most LOG_BURST messages per second and reports
+// how many it suppressed with the next one.
+#define LOG_RING_SIZE 1024 // power of 2
+#define LOG_MSG_SIZE 256
+#define LOG_BURST 20
+
+typedef struct ofdpa_sai_log_slot_s {
+    uint32_t seq;
+    int level;
+    char msg[LOG_MSG_SIZE];
+} ofdpa_sai_log_slot_t;
+
+typedef struct ofdpa_sai_ratelimit_s {
+    uint32_t sec;
+    uint32_t cnt;
+    uint32_t suppressed;
+} ofdpa_sai_ratelimit_t;
+
+static ofdpa_sai_log_slot_t log_ring[LOG_RING_SIZE];
+static uint32_t log_head; // next slot to fill, shared by the callers
+static uint32_t log_tail; // next slot to write, owned by the log thread
+static uint32_t log_dropped;
+static sem_t log_sem;
+static bool log_started = false; // set by sai_api_initialize
+static pthread_t pt_log;
+
+static int log_level = SAI_LOG_LEVEL_NOTICE;
+static int log_levels[SAI_API_MAX];
+
+static void ofdpa_sai_log_write(int level, ofdpa_sai_ratelimit_t *rl, const char *fmt, ...);
+
+#define ofdpa_sai_log(level, ...)                            \
+    do {                                                     \
+        static ofdpa_sai_ratelimit_t _rl;                    \
+        if ( (level) >= log_level ) {                        \
+            ofdpa_sai_log_write((level), &_rl, __VA_ARGS__); \
+        }                                                    \
     } while(0)
 
+#define log_debug(...) ofdpa_sai_log(SAI_LOG_LEVEL_DEBUG, __VA_ARGS__)
+#define log_info(...) ofdpa_sai_log(SAI_LOG_LEVEL_INFO, __VA_ARGS__)
+#define log_notice(...) ofdpa_sai_log(SAI_LOG_LEVEL_NOTICE, __VA_ARGS__)
+#define log_warn(...) ofdpa_sai_log(SAI_LOG_LEVEL_WARN, __VA_ARGS__)
+#define log_error(...) ofdpa_sai_log(SAI_LOG_LEVEL_ERROR, __VA_ARGS__)
+
 static sai_status_t ofdpa_sai_add_vlan_flow_entry(int vid, int port, bool tagged);
 static sai_status_t ofdpa_sai_add_untagged_vlan_flow_entry(int vid, int port);
 static sai_status_t ofdpa_sai_add_tagged_vlan_flow_entry(int vid, int port);
@@ -43,6 +99,7 @@ static sai_status_t ofdpa_sai_delete_untagged_vlan_flow_entry(int vid, int port)
 static sai_status_t ofdpa_sai_delete_tagged_vlan_flow_entry(int vid, int port);
 
 static sai_status_t ofdpa_sai_add_bridging_flow(int vid, int port, ofdpaMacAddr_t dst, int idle_timeout);
+static sai_status_t ofdpa_sai_modify_bridging_flow(int vid, int port, ofdpaMacAddr_t dst, int idle_timeout);
 static sai_status_t ofdpa_sai_flush_bridging_flows(int vid, int port);
 
 static sai_status_t ofdpa_sai_add_dlf_flow(int vid);
@@ -86,22 +143,102 @@ static sai_fdb_event_notification_fn g_fdb_event_callback = NULL;
 static uint32_t max_pkt_size = 0;
 static uint32_t port_num = 0;
 static int l3_unicast_idx = 0;
-static pthread_mutex_t m;
 
-#define MAX_NEIGHBORS 1024
 #define MAX_PORTS 128
+#define TAP_EVENTS 64
+#define TAP_BATCH 32 // frames read from one TAP per wakeup
 
 static pthread_t pt;
 static pthread_t pt_notification;
+static pthread_t pt_tap;
+static int tap_epfd = -1;
+
+// Punted packets go through a pipeline: the receive thread reads them
+// from OF-DPA, hands the source MAC to the learn thread when it has to be
+// learned and queues the packet to the TAP of its port on one of the RX
+// queues. Control protocols use their own queue and worker so that they
+// are neither stuck behind bridging flow RPCs nor behind a burst of data
+// traffic. Every ring has a single producer and a single consumer.
+#define RX_RING_SIZE 512 // power of 2
+#define LEARN_RING_SIZE 1024 // power of 2
+#define LEARN_BATCH 64
+// a MAC seen again on the same port within LEARN_HOLD_SEC isn't queued to
+// the learn thread
+#define LEARN_HOLD_SEC 2
+#define LEARN_CACHE_MAX 16384
+#define LAST_SEEN_MAX 4096
+
+enum {
+    RX_QUEUE_CONTROL,
+    RX_QUEUE_DATA,
+    RX_QUEUE_MAX,
+};
+
+typedef struct ofdpa_sai_ring_s {
+    uint32_t head; // next slot to fill, owned by the producer
+    uint32_t tail; // next slot to consume, owned by the consumer
+    uint32_t size;
+    uint64_t dropped; // entries dropped because the ring was full
+    sem_t sem;
+} ofdpa_sai_ring_t;
+
+typedef struct ofdpa_sai_rx_slot_s {
+    struct ofdpa_sai_port_s *port;
+    uint32_t size;
+    char *data; // max_pkt_size buffer, swapped with the receive buffer
+} ofdpa_sai_rx_slot_t;
+
+typedef struct ofdpa_sai_rx_queue_s {
+    const char *name;
+    ofdpa_sai_ring_t ring;
+    ofdpa_sai_rx_slot_t slots[RX_RING_SIZE];
+    uint64_t errors; // failed TAP writes
+    pthread_t pt;
+} ofdpa_sai_rx_queue_t;
+
+typedef struct ofdpa_sai_learn_req_s {
+    int vid;
+    ofdpaMacAddr_t mac;
+    struct ofdpa_sai_port_s *port;
+} ofdpa_sai_learn_req_t;
+
+typedef struct ofdpa_sai_learned_s {
+    struct ofdpa_sai_port_s *port;
+    time_t time;
+} ofdpa_sai_learned_t;
+
+// FDB events are collected into the pending batch by the learn thread and
+// the event thread and delivered to g_fdb_event_callback by the FDB
+// notification thread, one batch per call, while the other batch fills.
+#define FDB_BATCH_SIZE 256
+#define FDB_EVENT_ATTRS 2
+
+typedef struct ofdpa_sai_fdb_batch_s {
+    uint32_t count;
+    sai_fdb_event_notification_data_t data[FDB_BATCH_SIZE];
+    sai_attribute_t attrs[FDB_BATCH_SIZE][FDB_EVENT_ATTRS];
+} ofdpa_sai_fdb_batch_t;
+
+static ofdpa_sai_fdb_batch_t fdb_batches[2];
+static ofdpa_sai_fdb_batch_t *fdb_pending = &fdb_batches[0];
+static uint64_t fdb_dropped; // events dropped because the batch was full
+static pthread_mutex_t fdb_m;
+static pthread_cond_t fdb_cond;
+static pthread_t pt_fdb;
+
+static ofdpa_sai_rx_queue_t rx_queues[RX_QUEUE_MAX];
+static ofdpa_sai_ring_t learn_ring;
+static ofdpa_sai_learn_req_t learn_reqs[LEARN_RING_SIZE];
+static pthread_t pt_learn;
 
 struct ofdpa_sai_neighbor_s;
 
 typedef struct ofdpa_sai_neighbor_s {
+    sai_object_id_t rif_oid; // SAI ROUTER INTERFACE oid
     uint32_t ip;
     ofdpaMacAddr_t mac;
     int gid;  // OFDPA l3 unicast group id
     sai_object_id_t oid; // SAI NEXTHOP oid
-    struct ofdpa_sai_neighbor_s *next;
 } ofdpa_sai_neighbor_t;
 
 struct ofdpa_sai_port_s;
@@ -109,34 +246,30 @@ struct ofdpa_sai_vlan_member_s;
 
 typedef struct ofdpa_sai_vlan_member_s {
     sai_object_id_t oid; // SAI VLAN MEMBER oid
+    sai_object_id_t vlan_oid; // SAI VLAN oid
     int vid;
     bool tagged;
     struct ofdpa_sai_port_s *port;
     struct ofdpa_sai_vlan_member_s *next;
 } ofdpa_sai_vlan_member_t;
 
-typedef struct ofdpa_sai_neighbor_db_s {
-    ofdpa_sai_neighbor_t *head;
-    int cnt;
-} ofdpa_sai_neighbor_db_t;
-
 typedef struct ofdpa_sai_port_s {
     int index; // OFDPA PORT NUM
     char name[32];
     int fd;
     sai_object_id_t port_oid;
     sai_object_id_t hostif_oid;
-    pthread_t pt;
+    // frames sent from the host interface, updated by the send loop
+    uint64_t tx_packets;
+    uint64_t tx_bytes;
+    uint64_t tx_errors;
     sai_object_id_t router_if_oid;
-    int num_neighbor;
-    ofdpa_sai_neighbor_t neighbors[MAX_NEIGHBORS];
     ofdpaMacAddr_t mac;
     sai_object_id_t bridge_port_oid;
     int i; // index of the list
     int vid; // current access vid
     bool disabled;
     ofdpa_sai_vlan_member_t *vlans;
-    ofdpa_sai_neighbor_db_t *neigh_db;
 } ofdpa_sai_port_t;
 
 struct ofdpa_sai_vlan_s;
@@ -145,127 +278,626 @@ typedef struct ofdpa_sai_vlan_s {
     sai_object_id_t oid; // SAI VLAN OID
     int vid;
     int num_ports;
-    ofdpa_sai_port_t ports[MAX_PORTS];
-    int num_neighbor;
-    ofdpa_sai_neighbor_t neighbors[MAX_NEIGHBORS];
+    uint32_t members[MAX_PORTS / 32]; // bitmap of ofdpa_sai_port_t.i
     sai_object_id_t router_if_oid;
-    struct ofdpa_sai_vlan_s *next;
     ofdpaMacAddr_t mac;
 } ofdpa_sai_vlan_t;
 
+// ofdpa_sai_map_t is a chained hash table from a 64bit key (an object id
+// or an OF-DPA port number) to an object of this shim. It doubles its
+// buckets when it gets as many entries as buckets.
+typedef struct ofdpa_sai_map_entry_s {
+    uint64_t key;
+    void *value;
+    struct ofdpa_sai_map_entry_s *next;
+} ofdpa_sai_map_entry_t;
+
+typedef struct ofdpa_sai_map_s {
+    ofdpa_sai_map_entry_t **buckets;
+    uint32_t size; // power of 2
+    uint32_t cnt;
+} ofdpa_sai_map_t;
+
+// ofdpa_sai_flood_group_t keeps track of the buckets of the L2 flood
+// group of a vid, so a bucket is added or deleted without probing the
+// group for a free index or for the bucket of a port.
+typedef struct ofdpa_sai_flood_group_s {
+    uint32_t used[MAX_PORTS / 32]; // bitmap of bucket indexes
+    ofdpa_sai_map_t index_by_ref_gid; // L2 interface group id -> bucket index + 1
+} ofdpa_sai_flood_group_t;
+
+// ofdpa_sai_last_seen_t is a MAC whose bridging flow aged out and the port
+// it was learned on.
+typedef struct ofdpa_sai_last_seen_s {
+    uint64_t key; // vid << 48 | MAC
+    ofdpa_sai_port_t *port; // NULL when unused
+} ofdpa_sai_last_seen_t;
+
+// ofdpa_sai_neighbor_db_t indexes the neighbors of all router interfaces
+// by (rif, IP) and by the next hop created on them. VLAN next hops resolve
+// their egress port from fdb.by_mac, and for a MAC whose flow aged out
+// from the last LAST_SEEN_MAX aged MACs. Those are kept in a ring, the
+// oldest being replaced first, and are dropped when the MAC is learned
+// again or its (vid, port) is flushed.
+typedef struct ofdpa_sai_neighbor_db_s {
+    ofdpa_sai_map_t by_rif; // rif oid -> ofdpa_sai_map_t of IP -> neighbor
+    ofdpa_sai_map_t by_next_hop; // next hop oid -> neighbor
+    ofdpa_sai_last_seen_t last_seen[LAST_SEEN_MAX];
+    uint32_t last_seen_next; // slot replaced by the next aged MAC
+    ofdpa_sai_map_t last_seen_by_mac; // vid << 48 | MAC -> slot + 1
+} ofdpa_sai_neighbor_db_t;
+
+// ofdpa_sai_fdb_t indexes the MACs whose bridging flows the learn thread
+// added, by (vid, MAC) and by (vid, port) to flush them. Entries are
+// removed when the flows age out or are flushed.
+typedef struct ofdpa_sai_fdb_s {
+    ofdpa_sai_map_t by_mac; // vid << 48 | MAC -> port
+    ofdpa_sai_map_t by_vid_port; // vid << 32 | OF-DPA port -> ofdpa_sai_map_t of vid << 48 | MAC -> port
+} ofdpa_sai_fdb_t;
+
+#define MAP_INITIAL_SIZE 64
+
 static ofdpa_sai_port_t *ports;
-static ofdpa_sai_vlan_t *vlans;
 
-static void print_mac(ofdpaMacAddr_t mac) {
-    int i;
-    for( i = 0; i < OFDPA_MAC_ADDR_LEN; i++ ) {
-        printf("%02x:", mac.addr[i] & 0xff);
+static ofdpa_sai_map_t port_by_index;
+static ofdpa_sai_map_t port_by_oid;
+static ofdpa_sai_map_t port_by_bridge_port_oid;
+static ofdpa_sai_map_t port_by_rif_oid;
+static ofdpa_sai_map_t vlan_by_oid;
+static ofdpa_sai_map_t vlan_by_rif_oid;
+static ofdpa_sai_map_t vlan_member_by_oid;
+static ofdpa_sai_map_t flood_group_by_vid;
+
+static ofdpa_sai_neighbor_db_t neigh_db;
+static ofdpa_sai_fdb_t fdb;
+// SAI VLAN oid of each vid, read by the learn and event threads
+static sai_object_id_t vlan_oid_by_vid[OFDPA_VID_EXACT_MASK + 1];
+// (vid, MAC) -> ofdpa_sai_learned_t of the MACs recently queued to the
+// learn thread, only used by the receive thread
+static ofdpa_sai_map_t learn_cache;
+// guards the last seen MACs of neigh_db and fdb, which are written by the
+// learn and event threads
+static pthread_mutex_t neigh_db_m;
+
+static uint32_t ofdpa_sai_map_hash(uint64_t key) {
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    key *= 0xc4ceb9fe1a85ec53ULL;
+    key ^= key >> 33;
+    return (uint32_t)key;
+}
+
+static void ofdpa_sai_map_init(ofdpa_sai_map_t *map) {
+    map->size = MAP_INITIAL_SIZE;
+    map->cnt = 0;
+    map->buckets = calloc(map->size, sizeof(ofdpa_sai_map_entry_t *));
+}
+
+static void ofdpa_sai_map_grow(ofdpa_sai_map_t *map) {
+    ofdpa_sai_map_entry_t **buckets, *e, *next;
+    uint32_t size = map->size * 2, i, h;
+    buckets = calloc(size, sizeof(ofdpa_sai_map_entry_t *));
+    if ( buckets == NULL ) {
+        return;
+    }
+    for ( i = 0; i < map->size; i++ ) {
+        for ( e = map->buckets[i]; e != NULL; e = next ) {
+            next = e->next;
+            h = ofdpa_sai_map_hash(e->key) & (size - 1);
+            e->next = buckets[h];
+            buckets[h] = e;
+        }
+    }
+    free(map->buckets);
+    map->buckets = buckets;
+    map->size = size;
+}
+
+static void* ofdpa_sai_map_get(ofdpa_sai_map_t *map, uint64_t key) {
+    ofdpa_sai_map_entry_t *e;
+    if ( map->buckets == NULL ) {
+        return NULL;
+    }
+    e = map->buckets[ofdpa_sai_map_hash(key) & (map->size - 1)];
+    while ( e != NULL ) {
+        if ( e->key == key ) {
+            return e->value;
+        }
+        e = e->next;
     }
-    printf("\n");
+    return NULL;
 }
 
-static ofdpa_sai_port_t* get_ofdpa_sai_port_by_port_index(int index) {
-    int i;
-    for ( i = 0; i < port_num; i++ ) {
-        if ( ports[i].index == index ) {
-            return &ports[i];
+static int ofdpa_sai_map_set(ofdpa_sai_map_t *map, uint64_t key, void *value) {
+    ofdpa_sai_map_entry_t *e;
+    uint32_t h;
+    if ( map->buckets == NULL ) {
+        ofdpa_sai_map_init(map);
+    }
+    h = ofdpa_sai_map_hash(key) & (map->size - 1);
+    for ( e = map->buckets[h]; e != NULL; e = e->next ) {
+        if ( e->key == key ) {
+            e->value = value;
+            return 0;
         }
     }
-    return NULL;
+    e = malloc(sizeof(ofdpa_sai_map_entry_t));
+    if ( e == NULL ) {
+        return -1;
+    }
+    e->key = key;
+    e->value = value;
+    e->next = map->buckets[h];
+    map->buckets[h] = e;
+    if ( ++map->cnt > map->size ) {
+        ofdpa_sai_map_grow(map);
+    }
+    return 0;
 }
 
-static ofdpa_sai_port_t* get_ofdpa_sai_port_by_port_oid(sai_object_id_t oid) {
-    int i;
-    for ( i = 0; i < port_num; i++ ) {
-        if ( ports[i].port_oid == oid ) {
-            return &ports[i];
+static void* ofdpa_sai_map_delete(ofdpa_sai_map_t *map, uint64_t key) {
+    ofdpa_sai_map_entry_t *e, *prev = NULL;
+    void *value;
+    uint32_t h;
+    if ( map->buckets == NULL ) {
+        return NULL;
+    }
+    h = ofdpa_sai_map_hash(key) & (map->size - 1);
+    for ( e = map->buckets[h]; e != NULL; prev = e, e = e->next ) {
+        if ( e->key != key ) {
+            continue;
         }
+        if ( prev != NULL ) {
+            prev->next = e->next;
+        } else {
+            map->buckets[h] = e->next;
+        }
+        value = e->value;
+        free(e);
+        map->cnt--;
+        return value;
     }
     return NULL;
 }
 
-static ofdpa_sai_port_t* get_ofdpa_sai_port_by_bridge_port_oid(sai_object_id_t oid) {
-    int i;
-    for ( i = 0; i < port_num; i++ ) {
-        if ( ports[i].bridge_port_oid == oid ) {
-            return &ports[i];
+static void ofdpa_sai_map_clear(ofdpa_sai_map_t *map, void (*free_value)(void *)) {
+    ofdpa_sai_map_entry_t *e, *next;
+    uint32_t i;
+    if ( map->buckets == NULL ) {
+        return;
+    }
+    for ( i = 0; i < map->size; i++ ) {
+        for ( e = map->buckets[i]; e != NULL; e = next ) {
+            next = e->next;
+            if ( free_value != NULL ) {
+                free_value(e->value);
+            }
+            free(e);
         }
     }
-    return NULL;
+    free(map->buckets);
+    memset(map, 0, sizeof(ofdpa_sai_map_t));
 }
 
-static ofdpa_sai_port_t* get_ofdpa_sai_port_by_vlan_member_id(sai_object_id_t oid) {
-    int i;
-    ofdpa_sai_vlan_member_t *vlan = NULL;
-    for ( i = 0; i < port_num; i++ ) {
-        vlan = ports[i].vlans;
-        while ( vlan != NULL ) {
-            if ( vlan->oid == oid ) {
-                return &ports[i];
-            }
-            vlan = vlan->next;
-        }
+static const char* ofdpa_sai_log_level_name(int level) {
+    switch ( level ) {
+    case SAI_LOG_LEVEL_DEBUG:
+        return "DEBUG";
+    case SAI_LOG_LEVEL_INFO:
+        return "INFO";
+    case SAI_LOG_LEVEL_NOTICE:
+        return "NOTICE";
+    case SAI_LOG_LEVEL_WARN:
+        return "WARN";
+    case SAI_LOG_LEVEL_ERROR:
+        return "ERROR";
     }
-    return NULL;
+    return "CRITICAL";
 }
 
-static ofdpa_sai_neighbor_t* get_ofdpa_sai_mac_by_mac(ofdpa_sai_neighbor_db_t *db, ofdpaMacAddr_t mac) {
-    printf("db: %p\n", db);
-    ofdpa_sai_neighbor_t *n = db->head;
-    int i;
-    bool found;
-    while ( n != NULL ) {
-        found = true;
-        printf("n->mac:");
-        print_mac(n->mac);
-        printf("mac:");
-        print_mac(mac);
-        for ( i = 0; i < OFDPA_MAC_ADDR_LEN; i++ ) {
-            if ( n->mac.addr[i] != mac.addr[i] ) {
-                found = false;
+static bool ofdpa_sai_log_ratelimit(ofdpa_sai_ratelimit_t *rl, uint32_t *suppressed) {
+    uint32_t now = (uint32_t)time(NULL);
+    if ( __atomic_load_n(&rl->sec, __ATOMIC_RELAXED) != now ) {
+        __atomic_store_n(&rl->sec, now, __ATOMIC_RELAXED);
+        __atomic_store_n(&rl->cnt, 0, __ATOMIC_RELAXED);
+        *suppressed = __atomic_exchange_n(&rl->suppressed, 0, __ATOMIC_RELAXED);
+    }
+    if ( __atomic_fetch_add(&rl->cnt, 1, __ATOMIC_RELAXED) < LOG_BURST ) {
+        return true;
+    }
+    __atomic_fetch_add(&rl->suppressed, 1, __ATOMIC_RELAXED);
+    return false;
+}
+
+// ofdpa_sai_log_write claims a slot of log_ring the way a bounded MPMC
+// queue does: a slot is free for position pos when its seq is pos, and it
+// is published by setting seq to pos + 1. A full ring drops the message.
+static void ofdpa_sai_log_write(int level, ofdpa_sai_ratelimit_t *rl, const char *fmt, ...) {
+    ofdpa_sai_log_slot_t *slot;
+    uint32_t pos, seq, suppressed = 0;
+    int n = 0, len;
+    va_list ap;
+
+    if ( !log_started || !ofdpa_sai_log_ratelimit(rl, &suppressed) ) {
+        return;
+    }
+
+    pos = __atomic_load_n(&log_head, __ATOMIC_RELAXED);
+    while ( true ) {
+        slot = &log_ring[pos & (LOG_RING_SIZE - 1)];
+        seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+        if ( seq == pos ) {
+            if ( __atomic_compare_exchange_n(&log_head, &pos, pos + 1, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED) ) {
                 break;
             }
+        } else if ( (int32_t)(seq - pos) < 0 ) {
+            __atomic_fetch_add(&log_dropped, 1, __ATOMIC_RELAXED);
+            return;
+        } else {
+            pos = __atomic_load_n(&log_head, __ATOMIC_RELAXED);
         }
+    }
 
-        if ( found == true ) {
-            return n;
+    slot->level = level;
+    if ( suppressed > 0 ) {
+        n = snprintf(slot->msg, LOG_MSG_SIZE, "(%u suppressed) ", suppressed);
+    }
+    va_start(ap, fmt);
+    vsnprintf(slot->msg + n, LOG_MSG_SIZE - n, fmt, ap);
+    va_end(ap);
+    len = strlen(slot->msg);
+    if ( len > 0 && slot->msg[len - 1] != '\n' ) {
+        if ( len == LOG_MSG_SIZE - 1 ) {
+            len--;
         }
+        slot->msg[len] = '\n';
+        slot->msg[len + 1] = '\0';
+    }
 
-        n = n->next;
+    __atomic_store_n(&slot->seq, pos + 1, __ATOMIC_RELEASE);
+    sem_post(&log_sem);
+}
+
+void *ofdpa_sai_log_loop(void *arg) {
+    ofdpa_sai_log_slot_t *slot;
+    uint32_t dropped;
+
+    while ( true ) {
+        sem_wait(&log_sem);
+        while ( true ) {
+            slot = &log_ring[log_tail & (LOG_RING_SIZE - 1)];
+            if ( __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != log_tail + 1 ) {
+                break;
+            }
+            fprintf(stdout, "[%s] %s", ofdpa_sai_log_level_name(slot->level), slot->msg);
+            __atomic_store_n(&slot->seq, log_tail + LOG_RING_SIZE, __ATOMIC_RELEASE);
+            log_tail++;
+        }
+        dropped = __atomic_exchange_n(&log_dropped, 0, __ATOMIC_RELAXED);
+        if ( dropped > 0 ) {
+            fprintf(stdout, "[WARN] %u log messages dropped\n", dropped);
+        }
+        fflush(stdout);
     }
     return NULL;
 }
 
-static ofdpa_sai_port_t* get_ofdpa_sai_port_by_mac(int vid, ofdpaMacAddr_t mac) {
+static void ofdpa_sai_log_init() {
+    uint32_t i;
+    for ( i = 0; i < LOG_RING_SIZE; i++ ) {
+        log_ring[i].seq = i;
+    }
+    for ( i = 0; i < SAI_API_MAX; i++ ) {
+        log_levels[i] = SAI_LOG_LEVEL_NOTICE;
+    }
+    sem_init(&log_sem, 0, 0);
+    log_started = true;
+    pthread_create(&pt_log, NULL, &ofdpa_sai_log_loop, NULL);
+}
+
+static uint64_t ofdpa_sai_mac_key(int vid, ofdpaMacAddr_t mac) {
+    uint64_t key = (uint64_t)(vid & 0xfff);
     int i;
-    for ( i = 0; i < port_num; i++ ) {
-        if ( get_ofdpa_sai_mac_by_mac(ports[i].neigh_db, mac) != NULL ) {
-            return &ports[i];
+    for ( i = 0; i < OFDPA_MAC_ADDR_LEN; i++ ) {
+        key = (key << 8) | (mac.addr[i] & 0xff);
+    }
+    return key;
+}
+
+static ofdpa_sai_neighbor_t* get_ofdpa_sai_neighbor(sai_object_id_t rif, uint32_t ip) {
+    ofdpa_sai_map_t *neighbors = ofdpa_sai_map_get(&neigh_db.by_rif, rif);
+    if ( neighbors == NULL ) {
+        return NULL;
+    }
+    return ofdpa_sai_map_get(neighbors, (uint64_t)ip);
+}
+
+static ofdpa_sai_neighbor_t* get_ofdpa_sai_neighbor_by_next_hop_oid(sai_object_id_t oid) {
+    return ofdpa_sai_map_get(&neigh_db.by_next_hop, oid);
+}
+
+static ofdpa_sai_neighbor_t* ofdpa_sai_add_neighbor(sai_object_id_t rif, uint32_t ip, ofdpaMacAddr_t mac) {
+    ofdpa_sai_map_t *neighbors = ofdpa_sai_map_get(&neigh_db.by_rif, rif);
+    ofdpa_sai_neighbor_t *n;
+    if ( neighbors == NULL ) {
+        neighbors = calloc(1, sizeof(ofdpa_sai_map_t));
+        if ( neighbors == NULL ) {
+            return NULL;
+        }
+        if ( ofdpa_sai_map_set(&neigh_db.by_rif, rif, neighbors) != 0 ) {
+            free(neighbors);
+            return NULL;
         }
     }
-    return NULL;
+    n = ofdpa_sai_map_get(neighbors, (uint64_t)ip);
+    if ( n != NULL ) {
+        n->mac = mac;
+        return n;
+    }
+    n = malloc(sizeof(ofdpa_sai_neighbor_t));
+    if ( n == NULL ) {
+        return NULL;
+    }
+    memset(n, 0, sizeof(ofdpa_sai_neighbor_t));
+    n->rif_oid = rif;
+    n->ip = ip;
+    n->mac = mac;
+    if ( ofdpa_sai_map_set(neighbors, (uint64_t)ip, n) != 0 ) {
+        free(n);
+        return NULL;
+    }
+    return n;
 }
 
-static ofdpa_sai_vlan_member_t* get_ofdpa_sai_vlan_member_by_vlan_member_id(sai_object_id_t oid) {
+static int ofdpa_sai_set_neighbor_next_hop(ofdpa_sai_neighbor_t *n, sai_object_id_t oid) {
+    if ( n->oid != 0 ) {
+        ofdpa_sai_map_delete(&neigh_db.by_next_hop, n->oid);
+    }
+    n->oid = oid;
+    return ofdpa_sai_map_set(&neigh_db.by_next_hop, oid, n);
+}
+
+static void ofdpa_sai_free_neighbor(void *value) {
+    ofdpa_sai_neighbor_t *n = value;
+    if ( n->oid != 0 ) {
+        ofdpa_sai_map_delete(&neigh_db.by_next_hop, n->oid);
+    }
+    free(n);
+}
+
+static int ofdpa_sai_delete_neighbor(sai_object_id_t rif, uint32_t ip) {
+    ofdpa_sai_map_t *neighbors = ofdpa_sai_map_get(&neigh_db.by_rif, rif);
+    ofdpa_sai_neighbor_t *n;
+    if ( neighbors == NULL ) {
+        return -1;
+    }
+    n = ofdpa_sai_map_delete(neighbors, (uint64_t)ip);
+    if ( n == NULL ) {
+        return -1;
+    }
+    ofdpa_sai_free_neighbor(n);
+    return 0;
+}
+
+static void ofdpa_sai_clear_neighbors(sai_object_id_t rif) {
+    ofdpa_sai_map_t *neighbors;
+    if ( rif == 0 ) {
+        return;
+    }
+    neighbors = ofdpa_sai_map_delete(&neigh_db.by_rif, rif);
+    if ( neighbors == NULL ) {
+        return;
+    }
+    ofdpa_sai_map_clear(neighbors, ofdpa_sai_free_neighbor);
+    free(neighbors);
+}
+
+static ofdpaMacAddr_t ofdpa_sai_mac_from_key(uint64_t key) {
+    ofdpaMacAddr_t mac;
     int i;
-    ofdpa_sai_vlan_member_t *vlan = NULL;
-    for ( i = 0; i < port_num; i++ ) {
-        vlan = ports[i].vlans;
-        while ( vlan != NULL ) {
-            if ( vlan->oid == oid ) {
-                return vlan;
+    for ( i = OFDPA_MAC_ADDR_LEN - 1; i >= 0; i-- ) {
+        mac.addr[i] = key & 0xff;
+        key >>= 8;
+    }
+    return mac;
+}
+
+static uint64_t ofdpa_sai_vid_port_key(int vid, int port) {
+    return (uint64_t)(vid & 0xfff) << 32 | (uint32_t)port;
+}
+
+// ofdpa_sai_unindex_mac removes a learned MAC from fdb.by_vid_port. The caller
+// holds neigh_db_m.
+static void ofdpa_sai_unindex_mac(uint64_t key, ofdpa_sai_port_t *port) {
+    uint64_t vid_port = ofdpa_sai_vid_port_key((int)(key >> 48), port->index);
+    ofdpa_sai_map_t *macs = ofdpa_sai_map_get(&fdb.by_vid_port, vid_port);
+    if ( macs == NULL ) {
+        return;
+    }
+    ofdpa_sai_map_delete(macs, key);
+    if ( macs->cnt == 0 ) {
+        ofdpa_sai_map_delete(&fdb.by_vid_port, vid_port);
+        ofdpa_sai_map_clear(macs, NULL);
+        free(macs);
+    }
+}
+
+// ofdpa_sai_forget_last_seen drops the last seen port of a MAC. The caller
+// holds neigh_db_m.
+static void ofdpa_sai_forget_last_seen(uint64_t key) {
+    uintptr_t slot = (uintptr_t)ofdpa_sai_map_delete(&neigh_db.last_seen_by_mac, key);
+    if ( slot != 0 ) {
+        neigh_db.last_seen[slot - 1].port = NULL;
+    }
+}
+
+// ofdpa_sai_set_last_seen records the port of an aged MAC in the slot of the
+// oldest one. The caller holds neigh_db_m.
+static void ofdpa_sai_set_last_seen(uint64_t key, ofdpa_sai_port_t *port) {
+    uint32_t slot = neigh_db.last_seen_next;
+    ofdpa_sai_last_seen_t *s = &neigh_db.last_seen[slot];
+    ofdpa_sai_forget_last_seen(key);
+    if ( s->port != NULL ) {
+        ofdpa_sai_map_delete(&neigh_db.last_seen_by_mac, s->key);
+        s->port = NULL;
+    }
+    s->key = key;
+    if ( ofdpa_sai_map_set(&neigh_db.last_seen_by_mac, key, (void *)(uintptr_t)(slot + 1)) == 0 ) {
+        s->port = port;
+    }
+    neigh_db.last_seen_next = (slot + 1) % LAST_SEEN_MAX;
+}
+
+// ofdpa_sai_prune_last_seen drops the last seen MACs of a vid and/or an
+// OF-DPA port, or all of them when both are 0. The caller holds neigh_db_m.
+static void ofdpa_sai_prune_last_seen(int vid, int port) {
+    ofdpa_sai_last_seen_t *s;
+    uint32_t i;
+    for ( i = 0; i < LAST_SEEN_MAX; i++ ) {
+        s = &neigh_db.last_seen[i];
+        if ( s->port != NULL && ( vid == 0 || (int)(s->key >> 48) == vid ) && ( port == 0 || s->port->index == port ) ) {
+            ofdpa_sai_map_delete(&neigh_db.last_seen_by_mac, s->key);
+            s->port = NULL;
+        }
+    }
+}
+
+static int ofdpa_sai_learn_mac(int vid, ofdpaMacAddr_t mac, ofdpa_sai_port_t *port) {
+    uint64_t key = ofdpa_sai_mac_key(vid, mac), vid_port = ofdpa_sai_vid_port_key(vid, port->index);
+    ofdpa_sai_port_t *old;
+    ofdpa_sai_map_t *macs;
+    int ret = -1;
+    pthread_mutex_lock(&neigh_db_m);
+    old = ofdpa_sai_map_get(&fdb.by_mac, key);
+    if ( old != NULL && old != port ) {
+        ofdpa_sai_unindex_mac(key, old);
+    }
+    macs = ofdpa_sai_map_get(&fdb.by_vid_port, vid_port);
+    if ( macs == NULL ) {
+        macs = calloc(1, sizeof(ofdpa_sai_map_t));
+        if ( macs != NULL && ofdpa_sai_map_set(&fdb.by_vid_port, vid_port, macs) != 0 ) {
+            free(macs);
+            macs = NULL;
+        }
+    }
+    if ( macs != NULL && ofdpa_sai_map_set(macs, key, port) == 0 && ofdpa_sai_map_set(&fdb.by_mac, key, port) == 0 ) {
+        ofdpa_sai_forget_last_seen(key);
+        ret = 0;
+    }
+    pthread_mutex_unlock(&neigh_db_m);
+    return ret;
+}
+
+// ofdpa_sai_forget_mac removes a MAC from the FDB index. An aged MAC is
+// kept as last seen, so next hops to it still resolve.
+static ofdpa_sai_port_t* ofdpa_sai_forget_mac(int vid, ofdpaMacAddr_t mac, bool aged) {
+    uint64_t key = ofdpa_sai_mac_key(vid, mac);
+    ofdpa_sai_port_t *port;
+    pthread_mutex_lock(&neigh_db_m);
+    port = ofdpa_sai_map_delete(&fdb.by_mac, key);
+    if ( port != NULL ) {
+        ofdpa_sai_unindex_mac(key, port);
+        if ( aged ) {
+            ofdpa_sai_set_last_seen(key, port);
+        }
+    }
+    pthread_mutex_unlock(&neigh_db_m);
+    return port;
+}
+
+// ofdpa_sai_take_macs removes the MACs learned on (vid, port) from the FDB
+// index, along with the last seen ones, and returns them as a map the
+// caller frees, or NULL when there are none.
+static ofdpa_sai_map_t* ofdpa_sai_take_macs(int vid, int port) {
+    ofdpa_sai_map_t *macs;
+    ofdpa_sai_map_entry_t *e;
+    uint32_t i;
+    pthread_mutex_lock(&neigh_db_m);
+    ofdpa_sai_prune_last_seen(vid, port);
+    macs = ofdpa_sai_map_delete(&fdb.by_vid_port, ofdpa_sai_vid_port_key(vid, port));
+    if ( macs != NULL ) {
+        for ( i = 0; i < macs->size; i++ ) {
+            for ( e = macs->buckets[i]; e != NULL; e = e->next ) {
+                ofdpa_sai_map_delete(&fdb.by_mac, e->key);
             }
-            vlan = vlan->next;
         }
     }
-    return NULL;
+    pthread_mutex_unlock(&neigh_db_m);
+    return macs;
+}
+
+static ofdpa_sai_port_t* get_ofdpa_sai_fdb_port(int vid, ofdpaMacAddr_t mac) {
+    ofdpa_sai_port_t *port;
+    pthread_mutex_lock(&neigh_db_m);
+    port = ofdpa_sai_map_get(&fdb.by_mac, ofdpa_sai_mac_key(vid, mac));
+    pthread_mutex_unlock(&neigh_db_m);
+    return port;
+}
+
+// get_ofdpa_sai_port_by_mac returns the port a MAC is learned on, or was
+// last seen on if its flow aged out.
+static ofdpa_sai_port_t* get_ofdpa_sai_port_by_mac(int vid, ofdpaMacAddr_t mac) {
+    uint64_t key = ofdpa_sai_mac_key(vid, mac);
+    ofdpa_sai_port_t *port;
+    uintptr_t slot;
+    pthread_mutex_lock(&neigh_db_m);
+    port = ofdpa_sai_map_get(&fdb.by_mac, key);
+    if ( port == NULL ) {
+        slot = (uintptr_t)ofdpa_sai_map_get(&neigh_db.last_seen_by_mac, key);
+        if ( slot != 0 ) {
+            port = neigh_db.last_seen[slot - 1].port;
+        }
+    }
+    pthread_mutex_unlock(&neigh_db_m);
+    return port;
+}
+
+static void ofdpa_sai_vlan_set_member(ofdpa_sai_vlan_t *vlan, ofdpa_sai_port_t *port, bool member) {
+    uint32_t bit;
+    if ( port->i >= MAX_PORTS ) {
+        return;
+    }
+    bit = 1U << (port->i % 32);
+    if ( member && (vlan->members[port->i / 32] & bit) == 0 ) {
+        vlan->members[port->i / 32] |= bit;
+        vlan->num_ports++;
+    } else if ( !member && (vlan->members[port->i / 32] & bit) != 0 ) {
+        vlan->members[port->i / 32] &= ~bit;
+        vlan->num_ports--;
+    }
+}
+
+static ofdpa_sai_port_t* get_ofdpa_sai_port_by_port_index(int index) {
+    return ofdpa_sai_map_get(&port_by_index, (uint64_t)index);
+}
+
+static ofdpa_sai_port_t* get_ofdpa_sai_port_by_port_oid(sai_object_id_t oid) {
+    return ofdpa_sai_map_get(&port_by_oid, oid);
+}
+
+static ofdpa_sai_port_t* get_ofdpa_sai_port_by_bridge_port_oid(sai_object_id_t oid) {
+    return ofdpa_sai_map_get(&port_by_bridge_port_oid, oid);
+}
+
+static ofdpa_sai_port_t* get_ofdpa_sai_port_by_vlan_member_id(sai_object_id_t oid) {
+    ofdpa_sai_vlan_member_t *vlan = ofdpa_sai_map_get(&vlan_member_by_oid, oid);
+    if ( vlan == NULL ) {
+        return NULL;
+    }
+    return vlan->port;
 }
 
-static sai_status_t ofdpa_sai_add_vlan_member(ofdpa_sai_port_t *port, sai_object_id_t vlan_member_id, int vid, bool tagged) {
+static ofdpa_sai_vlan_member_t* get_ofdpa_sai_vlan_member_by_vlan_member_id(sai_object_id_t oid) {
+    return ofdpa_sai_map_get(&vlan_member_by_oid, oid);
+}
+
+static sai_status_t ofdpa_sai_add_vlan_member(ofdpa_sai_port_t *port, sai_object_id_t vlan_member_id, sai_object_id_t vlan_oid, int vid, bool tagged) {
     ofdpa_sai_vlan_member_t *vlan, *prev = NULL, *tmp;
     vlan = malloc(sizeof(ofdpa_sai_vlan_member_t));
     memset(vlan, 0, sizeof(ofdpa_sai_vlan_member_t));
     vlan->oid = vlan_member_id;
+    vlan->vlan_oid = vlan_oid;
     vlan->vid = vid;
     vlan->tagged = tagged;
     vlan->port = port;
@@ -280,6 +912,10 @@ static sai_status_t ofdpa_sai_add_vlan_member(ofdpa_sai_port_t *port, sai_object
         prev->next = vlan;
     }
 
+    if ( ofdpa_sai_map_set(&vlan_member_by_oid, vlan_member_id, vlan) != 0 ) {
+        return SAI_STATUS_NO_MEMORY;
+    }
+
     return SAI_STATUS_SUCCESS;
 }
 
@@ -292,6 +928,7 @@ static sai_status_t ofdpa_sai_delete_vlan_member(ofdpa_sai_port_t *port, sai_obj
             } else {
                 port->vlans = vlan->next;
             }
+            ofdpa_sai_map_delete(&vlan_member_by_oid, vlan_member_id);
             free(vlan);
             return SAI_STATUS_SUCCESS;
         }
@@ -302,70 +939,50 @@ static sai_status_t ofdpa_sai_delete_vlan_member(ofdpa_sai_port_t *port, sai_obj
 }
 
 static ofdpa_sai_vlan_t* append_new_vlan(sai_object_id_t oid, int vid) {
-    ofdpa_sai_vlan_t *v = vlans, *prev = NULL;
-    while ( v != NULL ) {
-        prev = v;
-        v = v->next;
-    }
+    ofdpa_sai_vlan_t *v;
     v = malloc(sizeof(ofdpa_sai_vlan_t));
+    if ( v == NULL ) {
+        return NULL;
+    }
     memset(v, 0, sizeof(ofdpa_sai_vlan_t));
 
-    prev->next = v;
     v->oid = oid;
     v->vid = vid;
 
+    if ( ofdpa_sai_map_set(&vlan_by_oid, oid, v) != 0 ) {
+        free(v);
+        return NULL;
+    }
+    __atomic_store_n(&vlan_oid_by_vid[vid & OFDPA_VID_EXACT_MASK], oid, __ATOMIC_RELAXED);
+
     return v;
 }
 
 static sai_status_t delete_vlan(sai_object_id_t oid) {
-    ofdpa_sai_vlan_t *v = vlans, *prev = NULL;
-    while (v != NULL ) {
-        if ( v->oid == oid ) {
-            if ( prev != NULL ) {
-                prev->next = v->next;
-            } else {
-                vlans = v->next;
-            }
-            free(v);
-            return SAI_STATUS_SUCCESS;
-        }
-        prev = v;
-        v = v->next;
+    ofdpa_sai_vlan_t *v = ofdpa_sai_map_delete(&vlan_by_oid, oid);
+    if ( v == NULL ) {
+        return SAI_STATUS_FAILURE;
     }
-    return SAI_STATUS_FAILURE;
+    if ( v->router_if_oid != 0 ) {
+        ofdpa_sai_map_delete(&vlan_by_rif_oid, v->router_if_oid);
+    }
+    ofdpa_sai_clear_neighbors(v->router_if_oid);
+    __atomic_store_n(&vlan_oid_by_vid[v->vid & OFDPA_VID_EXACT_MASK], 0, __ATOMIC_RELAXED);
+    free(v);
+    return SAI_STATUS_SUCCESS;
 }
 
 static ofdpa_sai_vlan_t* get_ofdpa_sai_vlan_by_vlan_oid(sai_object_id_t oid) {
-    ofdpa_sai_vlan_t *v = vlans;
-    while (v != NULL ) {
-        if ( v->oid == oid ) {
-            return v;
-        }
-        v = v->next;
-    }
-    return NULL;
+    return ofdpa_sai_map_get(&vlan_by_oid, oid);
 }
 
 static ofdpa_sai_vlan_t* get_ofdpa_sai_vlan_by_router_if_oid(sai_object_id_t oid) {
-    ofdpa_sai_vlan_t *v = vlans;
-    while (v != NULL ) {
-        if ( v->router_if_oid == oid ) {
-            return v;
-        }
-        v = v->next;
-    }
-    return NULL;
+    return ofdpa_sai_map_get(&vlan_by_rif_oid, oid);
 }
 
 static sai_status_t get_vlan_or_port_by_rif_id(sai_object_id_t oid, ofdpa_sai_port_t **port, ofdpa_sai_vlan_t **vlan) {
-    int i;
-    *port = NULL;
     *vlan = NULL;
-    for ( i = 0; i < port_num; i++ ){
-        if ( ports[i].router_if_oid == oid ) {
-            *port = &ports[i];
-        }
-    }
+    *port = ofdpa_sai_map_get(&port_by_rif_oid, oid);
     if ( *port != NULL ) {
         return SAI_STATUS_SUCCESS;
     }
@@ -376,36 +993,6 @@ static sai_status_t get_vlan_or_port_by_rif_id(sai_object_id_t oid, ofdpa_sai_po
     return SAI_STATUS_FAILURE;
 }
 
-static ofdpa_sai_neighbor_db_t* new_neigh_db() {
-    ofdpa_sai_neighbor_db_t *db;
-    ofdpa_sai_neighbor_t *n;
-    db = malloc(sizeof(ofdpa_sai_neighbor_db_t));
-    memset(db, 0, sizeof(ofdpa_sai_neighbor_db_t));
-    n = malloc(sizeof(ofdpa_sai_neighbor_t));
-    memset(n, 0, sizeof(ofdpa_sai_neighbor_t));
-
-    db->head = n;
-
-    return db;
-}
-
-static int ofdpa_sai_add_neighbor_to_db(ofdpa_sai_neighbor_db_t *db, ofdpaMacAddr_t mac) {
-    ofdpa_sai_neighbor_t *n = db->head, *prev = NULL;
-    while ( n != NULL ) {
-        prev = n;
-        n = n->next;
-    }
-    n = malloc(sizeof(ofdpa_sai_neighbor_t));
-    memset(n, 0, sizeof(ofdpa_sai_neighbor_t));
-    n->mac = mac;
-    prev->next = n;
-    return 0;
-}
-
-static int ofdpa_sai_add_neighbor_to_port(ofdpa_sai_port_t *port, ofdpaMacAddr_t mac) {
-    return ofdpa_sai_add_neighbor_to_db(port->neigh_db, mac);
-}
-
 static void ipstr(sai_ip4_t ip, char *str) {
     sprintf(str, "%d.%d.%d.%d", ip & 0xff, (ip >> 8) & 0xff, (ip >> 16) & 0xff, (ip >> 24) & 0xff);
 }
@@ -490,10 +1077,10 @@ static sai_status_t ofdpa_err2sai_status(OFDPA_ERROR_t err) {
     case OFDPA_E_NONE:
         return SAI_STATUS_SUCCESS;
     case OFDPA_E_EXISTS:
-        printf("OFDPA EXISTS\n");
+        log_debug("OFDPA EXISTS\n");
         return SAI_STATUS_SUCCESS;
     }
-    printf("OFDPA ERR: %d\n", err);
+    log_error("OFDPA ERR: %d\n", err);
     return SAI_STATUS_FAILURE;
 }
 
@@ -544,6 +1131,9 @@ sai_status_t sai_create_vlan(
         return SAI_STATUS_FAILURE;
     }
     vlan = append_new_vlan(*vlan_id, vid);
+    if ( vlan == NULL ) {
+        return SAI_STATUS_NO_MEMORY;
+    }
     return ofdpa_sai_add_dlf_flow(vid);
 }
 
@@ -552,12 +1142,12 @@ sai_status_t sai_remove_vlan(
     ofdpa_sai_vlan_t *vlan = get_ofdpa_sai_vlan_by_vlan_oid(vlan_id);
     sai_status_t err;
     if ( vlan == NULL ) {
-        printf("failed to find vlan with oid: %lx", vlan_id);
+        log_error("failed to find vlan with oid: %lx", vlan_id);
         return SAI_STATUS_FAILURE;
     }
     err = ofdpa_sai_delete_dlf_flow(vlan->vid);
     if ( err != SAI_STATUS_SUCCESS ) {
-        printf("failed to delete dlf flow for %d\n", vlan->vid);
+        log_error("failed to delete dlf flow for %d\n", vlan->vid);
         return err;
     }
     return delete_vlan(vlan_id);
@@ -640,10 +1230,10 @@ sai_status_t sai_create_vlan_member(
     // if this is about adding another VLAN to trunk port
     // we don't change port's vid
     // port's vid is for access port
-    ofdpa_sai_add_vlan_member(port, *vlan_member_id, vlan->vid, !pop);
+    ofdpa_sai_add_vlan_member(port, *vlan_member_id, vlan->oid, vlan->vid, !pop);
 
     port->disabled = true;
-    port->num_neighbor = 0;
+    ofdpa_sai_clear_neighbors(port->router_if_oid);
 
     if ( pop ) {
         // if this vlan is for access, we need to remove existing flows for
@@ -651,19 +1241,19 @@ sai_status_t sai_create_vlan_member(
         // but we don't need to remove rules for tagged flow
         err = ofdpa_sai_delete_untagged_vlan_flow_entry(old_vid, port->index);
         if ( err != SAI_STATUS_SUCCESS ) {
-            printf("failed to delete vlan flow: vid: %d, port: %d\n", old_vid, port->index);
+            log_error("failed to delete vlan flow: vid: %d, port: %d\n", old_vid, port->index);
             return err;
         }
 
         err = ofdpa_sai_flush_bridging_flows(old_vid, port->index);
         if ( err != SAI_STATUS_SUCCESS ) {
-            printf("failed to flush briding table: vid: %d, port: %d\n", old_vid, port->index);
+            log_error("failed to flush briding table: vid: %d, port: %d\n", old_vid, port->index);
             return err;
         }
 
         err = ofdpa_sai_delete_l2_interface_group(old_vid, port->index);
         if ( err != SAI_STATUS_SUCCESS ) {
-            printf("failed to delete l2 intefrace group: vid %d, port: %d\n", old_vid, port->index);
+            log_error("failed to delete l2 intefrace group: vid %d, port: %d\n", old_vid, port->index);
             return err;
         }
 
@@ -671,22 +1261,24 @@ sai_status_t sai_create_vlan_member(
 
     err = ofdpa_sai_add_l2_interface_group(vlan->vid, port->index, pop);
     if ( err != SAI_STATUS_SUCCESS ) {
-        printf("failed to add l2 intefrace group\n");
+        log_error("failed to add l2 intefrace group\n");
         return err;
     }
 
     err = ofdpa_sai_add_vlan_flow_entry(vlan->vid, port->index, !pop);
     if ( err != SAI_STATUS_SUCCESS ) {
-        printf("failed to add vlan flow entry: %d %d\n", vlan->vid, port->index);
+        log_error("failed to add vlan flow entry: %d %d\n", vlan->vid, port->index);
         return err;
     }
 
     err = ofdpa_sai_add_dlf_bucket(vlan->vid, port->index);
     if ( err != SAI_STATUS_SUCCESS ) {
-        printf("failed to add dlf bucket: %d, %d\n", vlan->vid, port->index);
+        log_error("failed to add dlf bucket: %d, %d\n", vlan->vid, port->index);
         return err;
     }
 
+    ofdpa_sai_vlan_set_member(vlan, port, true);
+
     port->disabled = false;
 
     return SAI_STATUS_SUCCESS;
@@ -698,6 +1290,7 @@ sai_status_t sai_remove_vlan_member(_In_ sai_object_id_t vlan_member_id){
     ofdpa_sai_port_t *port = NULL;
     sai_status_t err;
     ofdpa_sai_vlan_member_t *vlan = NULL;
+    ofdpa_sai_vlan_t *v;
 
     if ( vlan_member_id == g_vlan_member ) {
         return SAI_STATUS_SUCCESS;
@@ -716,25 +1309,25 @@ sai_status_t sai_remove_vlan_member(_In_ sai_object_id_t vlan_member_id){
 
     err = ofdpa_sai_flush_bridging_flows(old_vid, port->index);
     if ( err != SAI_STATUS_SUCCESS ) {
-        printf("failed to flush briding table: vid: %d, port: %d\n", old_vid, port->index);
+        log_error("failed to flush briding table: vid: %d, port: %d\n", old_vid, port->index);
         return err;
     }
 
     err = ofdpa_sai_delete_dlf_bucket(old_vid, port->index);
     if ( err != SAI_STATUS_SUCCESS ) {
-        printf("failed to delete dlf bucket: vid: %d, port: %d\n", old_vid, port->index);
+        log_error("failed to delete dlf bucket: vid: %d, port: %d\n", old_vid, port->index);
         return err;
     }
 
     err = ofdpa_sai_delete_vlan_flow_entry(old_vid, port->index, old_tagged);
     if ( err != SAI_STATUS_SUCCESS ) {
-        printf("failed to delete vlan flow: vid: %d, port: %d\n", old_vid, port->index);
+        log_error("failed to delete vlan flow: vid: %d, port: %d\n", old_vid, port->index);
         return err;
     }
 
     err = ofdpa_sai_delete_l2_interface_group(old_vid, port->index);
     if ( err != SAI_STATUS_SUCCESS ) {
-        printf("failed to delete l2 intefrace group\n");
+        log_error("failed to delete l2 intefrace group\n");
         return err;
     }
 
@@ -743,17 +1336,21 @@ sai_status_t sai_remove_vlan_member(_In_ sai_object_id_t vlan_member_id){
 
         err = ofdpa_sai_add_l2_interface_group(port->vid, port->index, true);
         if ( err != SAI_STATUS_SUCCESS ) {
-            printf("failed to add l2 intefrace group\n");
+            log_error("failed to add l2 intefrace group\n");
             return err;
         }
 
         err = ofdpa_sai_add_untagged_vlan_flow_entry(port->vid, port->index);
         if ( err != SAI_STATUS_SUCCESS ) {
-            printf("failed to add vlan flow entry: %d %d\n", port->vid, port->index);
+            log_error("failed to add vlan flow entry: %d %d\n", port->vid, port->index);
             return err;
         }
     }
 
+    if ( (v = get_ofdpa_sai_vlan_by_vlan_oid(vlan->vlan_oid)) != NULL ) {
+        ofdpa_sai_vlan_set_member(v, port, false);
+    }
+
     port->disabled = false;
     return ofdpa_sai_delete_vlan_member(port, vlan_member_id);
 }
@@ -848,9 +1445,12 @@ sai_status_t sai_create_router_interface(
         return SAI_STATUS_FAILURE;
     }
 
-    printf("rif_id: %lx\n", *rif_id);
+    log_debug("rif_id: %lx\n", *rif_id);
 
     if ( port != NULL ) {
+        if ( ofdpa_sai_map_set(&port_by_rif_oid, *rif_id, port) != 0 ) {
+            return SAI_STATUS_NO_MEMORY;
+        }
         port->router_if_oid = *rif_id;
         vid = port->vid;
         mac = port->mac;
@@ -862,9 +1462,12 @@ sai_status_t sai_create_router_interface(
         sprintf(name, "Vlan%d", vlan->vid);
         err = get_mac_address(name, &mac);
         if ( err != SAI_STATUS_SUCCESS ) {
-            printf("failed to get mac address of %s\n", name);
+            log_error("failed to get mac address of %s\n", name);
             return err;
         }
+        if ( ofdpa_sai_map_set(&vlan_by_rif_oid, *rif_id, vlan) != 0 ) {
+            return SAI_STATUS_NO_MEMORY;
+        }
         vid = vlan->vid;
         vlan->router_if_oid = *rif_id;
         vlan->mac = mac;
@@ -873,20 +1476,20 @@ sai_status_t sai_create_router_interface(
 
     err = ofdpa_sai_add_mac_termination_flow(vid, index, mac);
     if ( err != SAI_STATUS_SUCCESS ) {
-        printf("failed to add mac termination flow: vid: %d, port: %d\n", vid, index);
+        log_error("failed to add mac termination flow: vid: %d, port: %d\n", vid, index);
         return err;
     }
 
     err = ofdpa_sai_add_acl_policy_flow(index, 0x0806, NULL, &mac, vid, 10);
     if ( err != SAI_STATUS_SUCCESS ) {
-        printf("failed to add acl policy flow: vid: %d, port: %d\n", vid, index);
+        log_error("failed to add acl policy flow: vid: %d, port: %d\n", vid, index);
         return err;
     }
 
     mac = mask_mac();
     err = ofdpa_sai_add_acl_policy_flow(index, 0x0806, NULL, &mac, vid, 0);
     if ( err != SAI_STATUS_SUCCESS ) {
-        printf("failed to add acl policy flow for arp request\n");
+        log_error("failed to add acl policy flow for arp request\n");
         return err;
     }
 
@@ -901,7 +1504,7 @@ sai_status_t sai_remove_router_interface(_In_ sai_object_id_t rif_id){
     int vid, index;
     err = get_vlan_or_port_by_rif_id(rif_id, &port, &vlan);
     if ( err != SAI_STATUS_SUCCESS ) {
-        printf("failed to get vlan/port by rif id: %lx\n", rif_id);
+        log_error("failed to get vlan/port by rif id: %lx\n", rif_id);
         return err;
     }
 
@@ -918,23 +1521,34 @@ sai_status_t sai_remove_router_interface(_In_ sai_object_id_t rif_id){
 
     err = ofdpa_sai_delete_acl_policy_flow(index, 0x0806, NULL, &mac, vid, 10);
     if ( err != SAI_STATUS_SUCCESS ) {
-        printf("failed to delete acl policy flow: vid: %d, port: %d\n", vid, index);
+        log_error("failed to delete acl policy flow: vid: %d, port: %d\n", vid, index);
         return err;
     }
 
     broadcast = mask_mac();
     err = ofdpa_sai_delete_acl_policy_flow(index, 0x0806, NULL, &broadcast, vid, 0);
     if ( err != SAI_STATUS_SUCCESS ) {
-        printf("failed to delete acl policy flow for arp request\n");
+        log_error("failed to delete acl policy flow for arp request\n");
         return err;
     }
 
     err = ofdpa_sai_delete_mac_termination_flow(vid, index, mac);
     if ( err != SAI_STATUS_SUCCESS ) {
-        printf("failed to add mac termination flow: vid: %d, port: %d\n", vid, index);
+        log_error("failed to add mac termination flow: vid: %d, port: %d\n", vid, index);
         return err;
     }
 
+    ofdpa_sai_clear_neighbors(rif_id);
+
+    if ( port != NULL ) {
+        ofdpa_sai_map_delete(&port_by_rif_oid, rif_id);
+        port->router_if_oid = 0;
+    }
+    if ( vlan != NULL ) {
+        ofdpa_sai_map_delete(&vlan_by_rif_oid, rif_id);
+        vlan->router_if_oid = 0;
+    }
+
     return SAI_STATUS_SUCCESS;
 }
 
@@ -974,24 +1588,30 @@ sai_status_t sai_create_port(_Out_ sai_object_id_t *port_id,
             count = attr_list[i].value.u32list.count;
             list = attr_list[i].value.u32list.list;
             if ( count != 1 ) {
-                printf("specify ofdpa port num in lane configuration\n");
+                log_error("specify ofdpa port num in lane configuration\n");
                 return SAI_STATUS_NOT_SUPPORTED;
             }
             index = list[0];
             found = true;
             break;
         }
-        printf("create port attr: %d\n", attr_list[i].id);
+        log_debug("create port attr: %d\n", attr_list[i].id);
     }
     if ( found == false ) {
-        printf("no lane found\n");
+        log_error("no lane found\n");
         return SAI_STATUS_NOT_SUPPORTED;
     }
     port = get_ofdpa_sai_port_by_port_index((int)index);
     if ( port == NULL ) {
-        printf("not found index: %d\n", index);
+        log_error("not found index: %d\n", index);
         return SAI_STATUS_FAILURE;
     }
+    if ( port->port_oid != 0 ) {
+        ofdpa_sai_map_delete(&port_by_oid, port->port_oid);
+    }
+    if ( ofdpa_sai_map_set(&port_by_oid, *port_id, port) != 0 ) {
+        return SAI_STATUS_NO_MEMORY;
+    }
     port->port_oid = *port_id;
 
     if ( g_port_state_callback != NULL ) {
@@ -1015,7 +1635,7 @@ sai_status_t sai_set_port_attribute(_In_ sai_object_id_t port_id, _In_ const sai
     OFDPA_PORT_CONFIG_t config = 0;
     sai_status_t err;
     if ( port == NULL ) {
-        printf("[set port] no port found for %lx. however ignore...\n", port_id);
+        log_warn("[set port] no port found for %lx. however ignore...\n", port_id);
         return SAI_STATUS_SUCCESS;
     }
     switch (attr->id) {
@@ -1041,7 +1661,7 @@ sai_status_t sai_get_port_attribute(_In_ sai_object_id_t port_id, _In_ uint32_t
         case SAI_PORT_ATTR_OPER_STATUS:
             port = get_ofdpa_sai_port_by_port_oid(port_id);
             if ( port == NULL ) {
-                printf("[get port] no port found for %lx. howerver ignore..\n", port_id);
+                log_warn("[get port] no port found for %lx. howerver ignore..\n", port_id);
                 return SAI_STATUS_SUCCESS;
             }
             err = ofdpa_sai_get_port_oper_status(port->index, &attr_list[i].value.s32);
@@ -1105,7 +1725,7 @@ sai_status_t sai_get_port_stats(_In_ sai_object_id_t port_id, _In_ uint32_t numb
     ofdpaPortStats_t stats = {0};
 
     if ( port == NULL ) {
-        printf("no port found for %lx", port_id);
+        log_error("no port found for %lx", port_id);
         return SAI_STATUS_FAILURE;
     }
 
@@ -1169,7 +1789,7 @@ sai_status_t sai_clear_port_all_stats(
     ofdpa_sai_port_t *port = get_ofdpa_sai_port_by_port_oid(port_id);
 
     if ( port == NULL ) {
-        printf("[clear stats] no port found for %lx", port_id);
+        log_warn("[clear stats] no port found for %lx", port_id);
         return SAI_STATUS_SUCCESS;
     }
 
@@ -1219,7 +1839,7 @@ static sai_status_t ofdpa_sai_init_port() {
         i = next;
         port_num++;
     }
-    printf("port_num: %d\n", port_num);
+    log_notice("port_num: %d\n", port_num);
     ports = malloc(port_num * sizeof(ofdpa_sai_port_t));
     memset(ports, 0, port_num * sizeof(ofdpa_sai_port_t));
 
@@ -1228,7 +1848,7 @@ static sai_status_t ofdpa_sai_init_port() {
     for(i = 0; i < port_num; i++) {
         err = ofdpaPortNextGet(j, &next);
         if ( err != OFDPA_E_NONE ) {
-            printf("should not happen: i: %d, j: %d\n", i, j);
+            log_error("should not happen: i: %d, j: %d\n", i, j);
             return SAI_STATUS_FAILURE;
         }
 
@@ -1241,49 +1861,375 @@ static sai_status_t ofdpa_sai_init_port() {
         ofdpaPortNameGet(next, &buf);
         ports[i].i = i;
         ports[i].vid = i + VLAN_OFFSET;
-        ports[i].neigh_db = new_neigh_db();
+        if ( ofdpa_sai_map_set(&port_by_index, (uint64_t)next, &ports[i]) != 0 ) {
+            return SAI_STATUS_NO_MEMORY;
+        }
     }
 
     return SAI_STATUS_SUCCESS;
 }
 
+static void ofdpa_sai_ring_init(ofdpa_sai_ring_t *ring, uint32_t size) {
+    ring->head = 0;
+    ring->tail = 0;
+    ring->size = size;
+    ring->dropped = 0;
+    sem_init(&ring->sem, 0, 0);
+}
+
+// ofdpa_sai_ring_reserve returns the slot the producer can fill next, or
+// -1 when the ring is full. The slot is handed to the consumer by
+// ofdpa_sai_ring_push.
+static int ofdpa_sai_ring_reserve(ofdpa_sai_ring_t *ring) {
+    uint32_t head = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+    if ( head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) >= ring->size ) {
+        __atomic_fetch_add(&ring->dropped, 1, __ATOMIC_RELAXED);
+        return -1;
+    }
+    return (int)(head & (ring->size - 1));
+}
+
+static void ofdpa_sai_ring_push(ofdpa_sai_ring_t *ring) {
+    __atomic_store_n(&ring->head, ring->head + 1, __ATOMIC_RELEASE);
+    sem_post(&ring->sem);
+}
+
+// ofdpa_sai_ring_peek returns the slot the consumer can read next, or -1
+// when the ring is empty. The slot is given back by ofdpa_sai_ring_pop.
+static int ofdpa_sai_ring_peek(ofdpa_sai_ring_t *ring) {
+    uint32_t tail = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+    if ( __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) == tail ) {
+        return -1;
+    }
+    return (int)(tail & (ring->size - 1));
+}
+
+static void ofdpa_sai_ring_pop(ofdpa_sai_ring_t *ring) {
+    __atomic_store_n(&ring->tail, ring->tail + 1, __ATOMIC_RELEASE);
+}
+
+// ofdpa_sai_pkt_is_control tells whether a frame carries a control
+// protocol: a link-local frame (STP, LACP, LLDP), ARP, OSPF, VRRP, ICMPv6
+// (neighbor discovery) or BGP.
+static bool ofdpa_sai_pkt_is_control(const char *pkt, uint32_t size) {
+    const uint8_t *p = (const uint8_t *)pkt;
+    uint32_t off = 14, l4;
+    int ether_type, proto;
+
+    if ( size < 14 ) {
+        return false;
+    }
+    // 01:80:c2:00:00:0x
+    if ( p[0] == 0x01 && p[1] == 0x80 && p[2] == 0xc2 && p[3] == 0 && p[4] == 0 && (p[5] & 0xf0) == 0 ) {
+        return true;
+    }
+    ether_type = p[12] << 8 | p[13];
+    if ( ether_type == ETHER_TYPE_VLAN ) {
+        if ( size < 18 ) {
+            return false;
+        }
+        ether_type = p[16] << 8 | p[17];
+        off = 18;
+    }
+    switch ( ether_type ) {
+    case ETHER_TYPE_ARP:
+    case ETHER_TYPE_SLOW:
+    case ETHER_TYPE_LLDP:
+        return true;
+    case ETHER_TYPE_IPV4:
+        if ( size < off + 20 ) {
+            return false;
+        }
+        proto = p[off + 9];
+        l4 = off + (p[off] & 0x0f) * 4;
+        break;
+    case ETHER_TYPE_IPV6:
+        // extension headers are not followed
+        if ( size < off + 40 ) {
+            return false;
+        }
+        proto = p[off + 6];
+        l4 = off + 40;
+        break;
+    default:
+        return false;
+    }
+    switch ( proto ) {
+    case IP_PROTO_OSPF:
+    case IP_PROTO_VRRP:
+    case IPPROTO_ICMPV6:
+        return true;
+    case IPPROTO_TCP:
+        if ( size < l4 + 4 ) {
+            return false;
+        }
+        return (p[l4] << 8 | p[l4 + 1]) == BGP_PORT || (p[l4 + 2] << 8 | p[l4 + 3]) == BGP_PORT;
+    }
+    return false;
+}
+
+// ofdpa_sai_fdb_event queues an FDB event for g_fdb_event_callback. MACs
+// learned on a vid without a SAI VLAN (the vid of a port which isn't a
+// VLAN member) or on a port without a bridge port aren't reported.
+static void ofdpa_sai_fdb_event(sai_fdb_event_t type, int vid, ofdpaMacAddr_t mac, ofdpa_sai_port_t *port) {
+    sai_object_id_t bv_id = __atomic_load_n(&vlan_oid_by_vid[vid & OFDPA_VID_EXACT_MASK], __ATOMIC_RELAXED);
+    sai_fdb_event_notification_data_t *data;
+    sai_attribute_t *attrs;
+
+    if ( g_fdb_event_callback == NULL || bv_id == 0 || port->bridge_port_oid == 0 ) {
+        return;
+    }
+    pthread_mutex_lock(&fdb_m);
+    if ( fdb_pending->count == FDB_BATCH_SIZE ) {
+        fdb_dropped++;
+        pthread_mutex_unlock(&fdb_m);
+        return;
+    }
+    data = &fdb_pending->data[fdb_pending->count];
+    attrs = fdb_pending->attrs[fdb_pending->count];
+    fdb_pending->count++;
+    memset(data, 0, sizeof(sai_fdb_event_notification_data_t));
+    data->event_type = type;
+    data->fdb_entry.switch_id = g_switch_id;
+    memcpy(data->fdb_entry.mac_address, mac.addr, OFDPA_MAC_ADDR_LEN);
+    data->fdb_entry.bv_id = bv_id;
+    attrs[0].id = SAI_FDB_ENTRY_ATTR_TYPE;
+    attrs[0].value.s32 = SAI_FDB_ENTRY_TYPE_DYNAMIC;
+    attrs[1].id = SAI_FDB_ENTRY_ATTR_BRIDGE_PORT_ID;
+    attrs[1].value.oid = port->bridge_port_oid;
+    data->attr_count = FDB_EVENT_ATTRS;
+    data->attr = attrs;
+    pthread_cond_signal(&fdb_cond);
+    pthread_mutex_unlock(&fdb_m);
+}
+
+// ofdpa_sai_fdb_notification_loop delivers the pending FDB events. Events
+// queued while the callback runs are delivered together by the next call.
+void *ofdpa_sai_fdb_notification_loop(void *arg) {
+    ofdpa_sai_fdb_batch_t *batch;
+    uint64_t dropped;
+
+    while ( true ) {
+        pthread_mutex_lock(&fdb_m);
+        while ( fdb_pending->count == 0 ) {
+            pthread_cond_wait(&fdb_cond, &fdb_m);
+        }
+        batch = fdb_pending;
+        fdb_pending = batch == &fdb_batches[0] ? &fdb_batches[1] : &fdb_batches[0];
+        dropped = fdb_dropped;
+        fdb_dropped = 0;
+        pthread_mutex_unlock(&fdb_m);
+
+        if ( dropped > 0 ) {
+            log_warn("%lu fdb events dropped\n", (unsigned long)dropped);
+        }
+        log_debug("notify %u fdb events\n", batch->count);
+        g_fdb_event_callback(batch->count, batch->data);
+        batch->count = 0;
+    }
+    return NULL;
+}
+
+// ofdpa_sai_age_mac forgets a MAC whose bridging flow OF-DPA removed after
+// its idle timeout.
+static void ofdpa_sai_age_mac(ofdpaBridgingFlowMatch_t *match) {
+    int vid = match->vlanId & OFDPA_VID_EXACT_MASK;
+    ofdpa_sai_port_t *port = ofdpa_sai_forget_mac(vid, match->destMac, true);
+    char mac[32];
+    if ( port == NULL ) {
+        return;
+    }
+    macstr(match->destMac, mac);
+    log_debug("%s aged out on %s, vlan %d\n", mac, port->name, vid);
+    ofdpa_sai_fdb_event(SAI_FDB_EVENT_AGED, vid, match->destMac, port);
+}
+
+// ofdpa_sai_learn_cache_check tells whether a MAC seen by the receive
+// thread has to be queued to the learn thread: it is new, it moved to
+// another port or it wasn't queued for LEARN_HOLD_SEC. Queued MACs are
+// recorded with ofdpa_sai_learn_cache_set.
+static bool ofdpa_sai_learn_cache_check(int vid, ofdpaMacAddr_t mac, ofdpa_sai_port_t *port) {
+    ofdpa_sai_learned_t *l = ofdpa_sai_map_get(&learn_cache, ofdpa_sai_mac_key(vid, mac));
+    return l == NULL || l->port != port || time(NULL) - l->time >= LEARN_HOLD_SEC;
+}
+
+static void ofdpa_sai_learn_cache_expire(time_t now) {
+    ofdpa_sai_map_entry_t **p, *e;
+    uint32_t i;
+    for ( i = 0; i < learn_cache.size; i++ ) {
+        p = &learn_cache.buckets[i];
+        while ( ( e = *p ) != NULL ) {
+            if ( now - ((ofdpa_sai_learned_t *)e->value)->time < LEARN_HOLD_SEC ) {
+                p = &e->next;
+                continue;
+            }
+            *p = e->next;
+            free(e->value);
+            free(e);
+            learn_cache.cnt--;
+        }
+    }
+}
+
+static void ofdpa_sai_learn_cache_set(int vid, ofdpaMacAddr_t mac, ofdpa_sai_port_t *port) {
+    uint64_t key = ofdpa_sai_mac_key(vid, mac);
+    ofdpa_sai_learned_t *l = ofdpa_sai_map_get(&learn_cache, key);
+    time_t now = time(NULL);
+    if ( l == NULL ) {
+        if ( learn_cache.cnt >= LEARN_CACHE_MAX ) {
+            ofdpa_sai_learn_cache_expire(now);
+            if ( learn_cache.cnt >= LEARN_CACHE_MAX ) {
+                return;
+            }
+        }
+        l = malloc(sizeof(ofdpa_sai_learned_t));
+        if ( l == NULL ) {
+            return;
+        }
+        if ( ofdpa_sai_map_set(&learn_cache, key, l) != 0 ) {
+            free(l);
+            return;
+        }
+    }
+    l->port = port;
+    l->time = now;
+}
+
+// ofdpa_sai_learn programs the bridging flow of a learned MAC. A MAC which
+// moved to another port has its flow modified to point to the new port.
+static void ofdpa_sai_learn(ofdpa_sai_learn_req_t *req) {
+    ofdpa_sai_port_t *old = get_ofdpa_sai_fdb_port(req->vid, req->mac);
+    sai_status_t status = SAI_STATUS_FAILURE;
+    char mac[32];
+
+    if ( old != NULL && old != req->port ) {
+        macstr(req->mac, mac);
+        log_info("%s moved from %s to %s on vlan %d\n", mac, old->name, req->port->name, req->vid);
+        status = ofdpa_sai_modify_bridging_flow(req->vid, req->port->index, req->mac, 5);
+    }
+    // the flow may have aged out
+    if ( status != SAI_STATUS_SUCCESS ) {
+        status = ofdpa_sai_add_bridging_flow(req->vid, req->port->index, req->mac, 5);
+    }
+    if ( status != SAI_STATUS_SUCCESS ) {
+        log_error("failed to add bridging flow\n");
+        return;
+    }
+    if ( ofdpa_sai_learn_mac(req->vid, req->mac, req->port) != 0 ) {
+        log_error("failed to add mac to db\n");
+    }
+    if ( old == NULL ) {
+        ofdpa_sai_fdb_event(SAI_FDB_EVENT_LEARNED, req->vid, req->mac, req->port);
+    } else if ( old != req->port ) {
+        ofdpa_sai_fdb_event(SAI_FDB_EVENT_MOVE, req->vid, req->mac, req->port);
+    }
+}
+
+// ofdpa_sai_learn_loop takes the MACs queued by the receive thread up to
+// LEARN_BATCH at a time and programs their bridging flows. A MAC queued
+// more than once in a batch is only programmed with its latest port.
+void *ofdpa_sai_learn_loop(void *arg) {
+    ofdpa_sai_learn_req_t batch[LEARN_BATCH], *req;
+    int i, j, n;
+
+    while ( true ) {
+        sem_wait(&learn_ring.sem);
+        n = 0;
+        while ( n < LEARN_BATCH && ( i = ofdpa_sai_ring_peek(&learn_ring) ) >= 0 ) {
+            req = &learn_reqs[i];
+            for ( j = 0; j < n; j++ ) {
+                if ( batch[j].vid == req->vid && memcmp(&batch[j].mac, &req->mac, sizeof(ofdpaMacAddr_t)) == 0 ) {
+                    break;
+                }
+            }
+            batch[j] = *req;
+            if ( j == n ) {
+                n++;
+            }
+            ofdpa_sai_ring_pop(&learn_ring);
+        }
+        for ( j = 0; j < n; j++ ) {
+            ofdpa_sai_learn(&batch[j]);
+        }
+    }
+    return NULL;
+}
+
+// ofdpa_sai_rx_worker_loop writes the packets of one RX queue to the TAP
+// interfaces of their ports.
+void *ofdpa_sai_rx_worker_loop(void *arg) {
+    ofdpa_sai_rx_queue_t *q = (ofdpa_sai_rx_queue_t *)arg;
+    ofdpa_sai_rx_slot_t *slot;
+    int i;
+
+    while ( true ) {
+        sem_wait(&q->ring.sem);
+        while ( ( i = ofdpa_sai_ring_peek(&q->ring) ) >= 0 ) {
+            slot = &q->slots[i];
+            if ( write(slot->port->fd, slot->data, slot->size) < 0 ) {
+                __atomic_fetch_add(&q->errors, 1, __ATOMIC_RELAXED);
+                log_debug("failed to write to %s: %d\n", slot->port->name, errno);
+            }
+            ofdpa_sai_ring_pop(&q->ring);
+        }
+    }
+    return NULL;
+}
+
+static sai_status_t ofdpa_sai_rx_init() {
+    int i, j;
+    rx_queues[RX_QUEUE_CONTROL].name = "control";
+    rx_queues[RX_QUEUE_DATA].name = "data";
+    for ( i = 0; i < RX_QUEUE_MAX; i++ ) {
+        ofdpa_sai_ring_init(&rx_queues[i].ring, RX_RING_SIZE);
+        for ( j = 0; j < RX_RING_SIZE; j++ ) {
+            rx_queues[i].slots[j].data = (char *)malloc(max_pkt_size);
+            if ( rx_queues[i].slots[j].data == NULL ) {
+                return SAI_STATUS_NO_MEMORY;
+            }
+        }
+    }
+    ofdpa_sai_ring_init(&learn_ring, LEARN_RING_SIZE);
+    return SAI_STATUS_SUCCESS;
+}
+
+// ofdpa_sai_pkt_recv_loop is the receive stage of the RX pipeline. It
+// doesn't call OF-DPA other than to receive, so it keeps up with the punt
+// rate whatever the workers are doing; when a ring is full the entry is
+// dropped and counted.
 void *ofdpa_sai_pkt_recv_loop(void *arg){
     ofdpaPacket_t pkt;
-    pkt.pktData.size = max_pkt_size;
-    pkt.pktData.pstart = (char *)malloc(max_pkt_size);
+    char *data = (char *)malloc(max_pkt_size);
     OFDPA_ERROR_t err;
-    sai_status_t status;
     ofdpa_sai_port_t *port = NULL;
+    ofdpa_sai_rx_queue_t *q;
+    ofdpa_sai_rx_slot_t *slot;
     int i;
 
     while (1) {
-        int fd;
+        pkt.pktData.size = max_pkt_size;
+        pkt.pktData.pstart = data;
         err = ofdpaPktReceive(NULL, &pkt);
         if ( err != OFDPA_E_NONE ) {
-            printf("Receive fail: %d\n", err);
+            log_error("Receive fail: %d\n", err);
             return NULL;
         }
 
-        pthread_mutex_lock(&m);
-        printf("RECV: in-port: %d, reason: %d, table-id: %d\n", pkt.inPortNum, pkt.reason, pkt.tableId);
-        for ( i = 0; i < pkt.pktData.size; i++ ) {
-            printf("0x%02x ", pkt.pktData.pstart[i] & 0xff);
-        }
-        printf("\n");
-        pthread_mutex_unlock(&m);
+        log_debug("RECV: in-port: %d, reason: %d, table-id: %d, size: %d\n", pkt.inPortNum, pkt.reason, pkt.tableId, pkt.pktData.size);
 
         port = get_ofdpa_sai_port_by_port_index(pkt.inPortNum);
         if ( port == NULL ) {
-            printf("failed to find port: %d\n", pkt.inPortNum);
+            log_error("failed to find port: %d\n", pkt.inPortNum);
             return NULL;
         }
 
         if ( port->disabled ) {
-            printf("port %d is disabled\n", port->index);
+            log_debug("port %d is disabled\n", port->index);
             continue;
         }
 
         if ( pkt.tableId == OFDPA_FLOW_TABLE_ID_SA_LOOKUP || ( pkt.tableId == OFDPA_FLOW_TABLE_ID_ACL_POLICY &&  is_broadcast(pkt.pktData.pstart)) ) {
+            ofdpa_sai_learn_req_t *req;
             ofdpaMacAddr_t src;
             int ether_type, vid = 0;
             for ( i = 0; i < OFDPA_MAC_ADDR_LEN; i++ ) {
@@ -1292,57 +2238,81 @@ void *ofdpa_sai_pkt_recv_loop(void *arg){
             ether_type = (int)((pkt.pktData.pstart[12] & 0xff ) << 8 | (pkt.pktData.pstart[13] & 0xff ));
             switch ( ether_type ) {
             case ETHER_TYPE_VLAN:
-                vid = (int)((pkt.pktData.pstart[14] & 0xff ) << 8 | ( pkt.pktData.pstart[15] & 0xff ));
+                vid = (int)((pkt.pktData.pstart[14] & 0x0f ) << 8 | ( pkt.pktData.pstart[15] & 0xff ));
                 break;
             default:
                 // access port vid
                 vid = port->vid;
                 break;
             }
-            printf("ether_type: %d, vid: %d\n", ether_type, vid);
-            // TODO call g_fdb_event_callback
-
-            // TODO avoid duplication
-            if ( ofdpa_sai_add_neighbor_to_port(port, src) != 0 ) {
-                printf("failed to add neighbor to db\n");
-            }
-            status = ofdpa_sai_add_bridging_flow(vid, pkt.inPortNum, src, 5);
-            if ( status != SAI_STATUS_SUCCESS ) {
-                printf("failed to add bridging flow\n");
+            log_debug("ether_type: %d, vid: %d\n", ether_type, vid);
+
+            if ( ofdpa_sai_learn_cache_check(vid, src, port) && ( i = ofdpa_sai_ring_reserve(&learn_ring) ) >= 0 ) {
+                req = &learn_reqs[i];
+                req->vid = vid;
+                req->mac = src;
+                req->port = port;
+                ofdpa_sai_ring_push(&learn_ring);
+                ofdpa_sai_learn_cache_set(vid, src, port);
             }
         }
-        if ( (fd = port->fd) > 0 ) {
-            write(fd, pkt.pktData.pstart, pkt.pktData.size);
+        if ( port->fd > 0 ) {
+            q = &rx_queues[ofdpa_sai_pkt_is_control(pkt.pktData.pstart, pkt.pktData.size) ? RX_QUEUE_CONTROL : RX_QUEUE_DATA];
+            if ( ( i = ofdpa_sai_ring_reserve(&q->ring) ) < 0 ) {
+                continue;
+            }
+            // hand the received buffer over to the worker and receive the
+            // next packet into the one the slot had
+            slot = &q->slots[i];
+            slot->port = port;
+            slot->size = pkt.pktData.size;
+            data = slot->data;
+            slot->data = pkt.pktData.pstart;
+            ofdpa_sai_ring_push(&q->ring);
         }
     }
 }
 
+// ofdpa_sai_pkt_send_loop sends the frames written to all the TAP
+// interfaces to their ports. It waits on tap_epfd and reads up to
+// TAP_BATCH frames from each ready TAP before moving on to the next one,
+// so a busy interface doesn't starve the others.
 void *ofdpa_sai_pkt_send_loop(void *arg) {
+    struct epoll_event events[TAP_EVENTS];
     ofdpa_buffdesc buf;
-    buf.size = max_pkt_size;
-    buf.pstart = (char *)malloc(max_pkt_size);
+    char *data = (char *)malloc(max_pkt_size);
     OFDPA_ERROR_t err;
-    ofdpa_sai_port_t *port = (ofdpa_sai_port_t *)arg;
-    int size, i;
+    ofdpa_sai_port_t *port;
+    int n, i, j, size;
 
     while (1) {
-        size = read(port->fd, buf.pstart, buf.size);
-        if ( size < 0 ) {
+        n = epoll_wait(tap_epfd, events, TAP_EVENTS, -1);
+        if ( n < 0 ) {
+            if ( errno == EINTR ) {
+                continue;
+            }
+            log_error("epoll_wait failed: %d\n", errno);
             return NULL;
         }
-        pthread_mutex_lock(&m);
-        printf("SEND: out-port: %d, size: %d\n", port->index, size);
-        buf.size = size;
-        for ( i = 0; i < size; i++ ) {
-            printf("0x%02x ", buf.pstart[i] & 0xff);
-        }
-        printf("\n");
-        err = ofdpaPktSend(&buf, 0, port->index, 0);
-        buf.size = max_pkt_size;
-        pthread_mutex_unlock(&m);
-        if ( err != OFDPA_E_NONE) {
-            printf("Send fail: %d\n", err);
-            continue;
+        for ( i = 0; i < n; i++ ) {
+            port = (ofdpa_sai_port_t *)events[i].data.ptr;
+            for ( j = 0; j < TAP_BATCH; j++ ) {
+                size = read(port->fd, data, max_pkt_size);
+                if ( size <= 0 ) {
+                    break;
+                }
+                log_debug("SEND: out-port: %d, size: %d\n", port->index, size);
+                buf.pstart = data;
+                buf.size = size;
+                err = ofdpaPktSend(&buf, 0, port->index, 0);
+                if ( err != OFDPA_E_NONE) {
+                    port->tx_errors++;
+                    log_error("Send fail: %d\n", err);
+                    continue;
+                }
+                port->tx_packets++;
+                port->tx_bytes += size;
+            }
         }
     }
 }
@@ -1354,15 +2324,15 @@ void *ofdpa_sai_event_recv_loop(void *arg) {
     ofdpa_sai_port_t *port = NULL;
 
     while ( ( err = ofdpaEventReceive(NULL) ) == OFDPA_E_NONE ) {
-        printf("event received\n");
+        log_debug("event received\n");
         memset(&port_event, 0, sizeof(port_event));
         while (ofdpaPortEventNextGet(&port_event) == OFDPA_E_NONE) {
-            printf("port_event: %d %d %s\n", port_event.eventMask, port_event.portNum, port_event.state ? "down" : "up" );
+            log_debug("port_event: %d %d %s\n", port_event.eventMask, port_event.portNum, port_event.state ? "down" : "up" );
             sai_port_oper_status_notification_t status = {0};
 
             port = get_ofdpa_sai_port_by_port_index(port_event.portNum);
             if ( port == NULL || port->port_oid == 0 ) {
-                printf("port not found. ignore\n");
+                log_warn("port not found. ignore\n");
                 continue;
             }
             status.port_id = port->port_oid;
@@ -1374,7 +2344,7 @@ void *ofdpa_sai_event_recv_loop(void *arg) {
                 status.port_state = SAI_PORT_OPER_STATUS_DOWN;
                 break;
             default:
-                printf("unknown state. ignore\n");
+                log_warn("unknown state. ignore\n");
                 continue;
             }
 
@@ -1383,12 +2353,17 @@ void *ofdpa_sai_event_recv_loop(void *arg) {
             }
 
         }
+        // the table to get the events of is given in flowMatch
         memset(&flow_event, 0, sizeof(flow_event));
+        flow_event.flowMatch.tableId = OFDPA_FLOW_TABLE_ID_BRIDGING;
         while (ofdpaFlowEventNextGet(&flow_event) == OFDPA_E_NONE) {
-            printf("flow_event: %d\n", flow_event.eventMask);
+            log_debug("flow_event: %d\n", flow_event.eventMask);
+            if ( flow_event.eventMask & OFDPA_FLOW_EVENT_IDLE_TIMEOUT ) {
+                ofdpa_sai_age_mac(&flow_event.flowMatch.flowData.bridgingFlowEntry.match_criteria);
+            }
         }
     }
-    printf("event receive failed: %d\n", err);
+    log_error("event receive failed: %d\n", err);
     return NULL;
 }
 
@@ -1397,23 +2372,23 @@ sai_status_t sai_create_switch(_Out_ sai_object_id_t* switch_id, _In_ uint32_t a
     *switch_id = g_switch_id;
     OFDPA_ERROR_t err;
 
-    printf("switch_id: %lx\n", g_switch_id);
+    log_notice("switch_id: %lx\n", g_switch_id);
 
     for(i = 0; i < attr_count; i++){
-        printf("attr: %d\n", attr_list[i].id);
+        log_debug("attr: %d\n", attr_list[i].id);
         switch ( attr_list[i].id ) {
         case SAI_SWITCH_ATTR_INIT_SWITCH:
-            printf("attr init switch\n");
+            log_notice("attr init switch\n");
             break;
         case SAI_SWITCH_ATTR_SHUTDOWN_REQUEST_NOTIFY:
-            printf("shutdown req notify\n");
+            log_notice("shutdown req notify\n");
             break;
         case SAI_SWITCH_ATTR_FDB_EVENT_NOTIFY:
-            printf("set fdb event notify\n");
+            log_notice("set fdb event notify\n");
             g_fdb_event_callback = (sai_fdb_event_notification_fn)(attr_list[i].value.ptr);
             break;
         case SAI_SWITCH_ATTR_PORT_STATE_CHANGE_NOTIFY:
-            printf("set port state change notify\n");
+            log_notice("set port state change notify\n");
             g_port_state_callback = (sai_port_state_change_notification_fn)(attr_list[i].value.ptr);
             break;
         default:
@@ -1436,10 +2411,33 @@ sai_status_t sai_create_switch(_Out_ sai_object_id_t* switch_id, _In_ uint32_t a
 
     ofdpa_sai_init_port();
 
+    tap_epfd = epoll_create1(0);
+    if ( tap_epfd < 0 ) {
+        log_error("failed to create epoll fd: %d\n", errno);
+        return SAI_STATUS_FAILURE;
+    }
+
+    if ( ofdpa_sai_rx_init() != SAI_STATUS_SUCCESS ) {
+        log_error("failed to allocate rx queues\n");
+        return SAI_STATUS_NO_MEMORY;
+    }
+
+    for ( i = 0; i < RX_QUEUE_MAX; i++ ) {
+        pthread_create(&rx_queues[i].pt, NULL, &ofdpa_sai_rx_worker_loop, &rx_queues[i]);
+    }
+
+    pthread_create(&pt_learn, NULL, &ofdpa_sai_learn_loop, NULL);
+
     pthread_create(&pt, NULL, &ofdpa_sai_pkt_recv_loop, NULL);
 
-    if ( g_port_state_callback != NULL ) {
-        pthread_create(&pt_notification, NULL, &ofdpa_sai_event_recv_loop, NULL);
+    pthread_create(&pt_tap, NULL, &ofdpa_sai_pkt_send_loop, NULL);
+
+    // flow events age out learned MACs, so the event thread runs even
+    // without a port state callback
+    pthread_create(&pt_notification, NULL, &ofdpa_sai_event_recv_loop, NULL);
+
+    if ( g_fdb_event_callback != NULL ) {
+        pthread_create(&pt_fdb, NULL, &ofdpa_sai_fdb_notification_loop, NULL);
     }
 
     return SAI_STATUS_SUCCESS;
@@ -1571,6 +2569,12 @@ sai_status_t sai_create_bridge_port(
         return SAI_STATUS_MANDATORY_ATTRIBUTE_MISSING;
     }
 
+    if ( port->bridge_port_oid != 0 ) {
+        ofdpa_sai_map_delete(&port_by_bridge_port_oid, port->bridge_port_oid);
+    }
+    if ( ofdpa_sai_map_set(&port_by_bridge_port_oid, *bridge_port_id, port) != 0 ) {
+        return SAI_STATUS_NO_MEMORY;
+    }
     port->bridge_port_oid = *bridge_port_id;
 
     return SAI_STATUS_SUCCESS;
@@ -1622,9 +2626,10 @@ sai_status_t sai_create_route_entry(
         _In_ uint32_t attr_count,
         _In_ const sai_attribute_t *attr_list){
     sai_ip4_t prefix, mask;
-    int i, j, gid = 0;
+    int i, gid = 0;
     bool packet_in = false, forward = false;
     sai_object_id_t oid;
+    ofdpa_sai_neighbor_t *neighbor;
     char sprefix[32], smask[32];
 
     if( route_entry->destination.addr_family != SAI_IP_ADDR_FAMILY_IPV4 ) {
@@ -1637,9 +2642,9 @@ sai_status_t sai_create_route_entry(
             if ( attr_list[i].value.s32 == SAI_PACKET_ACTION_FORWARD ) {
                 forward = true;
             }
-            printf("packet action: %d, %d\n", attr_list[i].value.s32, forward);
+            log_debug("packet action: %d, %d\n", attr_list[i].value.s32, forward);
         case SAI_ROUTE_ENTRY_ATTR_NEXT_HOP_ID:
-            printf("nexthop oid: %lx\n", attr_list[i].value.oid);
+            log_debug("nexthop oid: %lx\n", attr_list[i].value.oid);
             if ( sai_object_type_query(attr_list[i].value.oid) == SAI_OBJECT_TYPE_PORT ) {
                 packet_in = true;
             } else {
@@ -1653,23 +2658,16 @@ sai_status_t sai_create_route_entry(
     if ( packet_in == true && forward == true ) {
         ipstr(prefix, sprefix);
         ipstr(mask, smask);
-        printf("adding packet-in flow: %s %s\n", sprefix, smask);
+        log_debug("adding packet-in flow: %s %s\n", sprefix, smask);
         return ofdpa_sai_add_unicast_routing_flow(0, 0, packet_in, (int)prefix, (int)mask);
     }
 
-    for ( i = 0; i < port_num; i++ ) {
-        for ( j = 0; j < ports[i].num_neighbor; j++ ) {
-            if ( ports[i].neighbors[j].oid == oid ) {
-                gid = ports[i].neighbors[j].gid;
-                break;
-            }
-        }
-        if ( gid > 0 ) {
-            break;
-        }
+    neighbor = get_ofdpa_sai_neighbor_by_next_hop_oid(oid);
+    if ( neighbor != NULL ) {
+        gid = neighbor->gid;
     }
 
-    printf("nexthop oid: %lx, gid: %0x\n", oid, gid);
+    log_debug("nexthop oid: %lx, gid: %0x\n", oid, gid);
 
     if ( gid > 0 ) {
         return ofdpa_sai_add_unicast_routing_flow(gid, 0, packet_in, (int)prefix, (int)mask);
@@ -1680,7 +2678,7 @@ sai_status_t sai_create_route_entry(
 
 sai_status_t sai_remove_route_entry(_In_ const sai_route_entry_t *route_entry){
     if ( route_entry->destination.mask.ip4 != 0xffffffff ) {
-        printf("sai_remove_route_entry only support removing ipv4 host route /32. ignore\n");
+        log_warn("sai_remove_route_entry only support removing ipv4 host route /32. ignore\n");
         return SAI_STATUS_SUCCESS;
     }
     return ofdpa_sai_delete_unicast_routing_flow(0, 0, true, (int)route_entry->destination.addr.ip4, (int)route_entry->destination.mask.ip4);
@@ -1789,7 +2787,7 @@ static int tap_alloc(char *dev)
   int fd, err;
 
   if( (fd = open("/dev/net/tun", O_RDWR)) < 0 ) {
-    printf("[TUN] failed to open /dev/net/tun\n");
+    log_error("[TUN] failed to open /dev/net/tun\n");
     return -1;
   }
 
@@ -1812,7 +2810,7 @@ static int tap_alloc(char *dev)
   return fd;
 }
 
-static sai_status_t ofdpa_sai_add_bridging_flow(int vid, int port, ofdpaMacAddr_t dst, int idle_timeout) {
+static ofdpaFlowEntry_t _ofdpa_sai_create_bridging_flow_entry(int vid, int port, ofdpaMacAddr_t dst, int idle_timeout) {
     ofdpaFlowEntry_t entry;
     ofdpaFlowEntryInit(OFDPA_FLOW_TABLE_ID_BRIDGING, &entry);
     ofdpaBridgingFlowEntry_t br;
@@ -1823,7 +2821,7 @@ static sai_status_t ofdpa_sai_add_bridging_flow(int vid, int port, ofdpaMacAddr_
 
     macstr(dst, mac);
 
-    printf("add bridging flow: vid: %d, port: %d, gid: %d, dst: %s\n", vid, port, gid, mac);
+    log_debug("bridging flow: vid: %d, port: %d, gid: %d, dst: %s\n", vid, port, gid, mac);
 
     br.gotoTableId = OFDPA_FLOW_TABLE_ID_ACL_POLICY;
     br.groupID = gid;
@@ -1836,51 +2834,164 @@ static sai_status_t ofdpa_sai_add_bridging_flow(int vid, int port, ofdpaMacAddr_
     // give higher priority than dlf flows
     entry.priority = 10;
     entry.idle_time = (uint32_t)idle_timeout;
+    return entry;
+}
+
+static sai_status_t ofdpa_sai_add_bridging_flow(int vid, int port, ofdpaMacAddr_t dst, int idle_timeout) {
+    ofdpaFlowEntry_t entry = _ofdpa_sai_create_bridging_flow_entry(vid, port, dst, idle_timeout);
     return ofdpa_err2sai_status(ofdpaFlowAdd(&entry));
 }
 
+static sai_status_t ofdpa_sai_modify_bridging_flow(int vid, int port, ofdpaMacAddr_t dst, int idle_timeout) {
+    ofdpaFlowEntry_t entry = _ofdpa_sai_create_bridging_flow_entry(vid, port, dst, idle_timeout);
+    return ofdpa_err2sai_status(ofdpaFlowModify(&entry));
+}
+
+// ofdpa_sai_flush_bridging_flows deletes the bridging flows of the MACs
+// learned on (vid, port), which the MAC db keeps track of, instead of
+// walking the bridging table.
 static sai_status_t ofdpa_sai_flush_bridging_flows(int vid, int port) {
+    ofdpa_sai_map_t *macs = ofdpa_sai_take_macs(vid, port);
+    ofdpa_sai_map_entry_t *e;
     ofdpaFlowEntry_t flow;
-    sai_status_t err;
-    ofdpaFlowEntryInit(OFDPA_FLOW_TABLE_ID_BRIDGING, &flow);
-    uint32_t gid = ofdpa_sai_group_id(OFDPA_GROUP_ENTRY_TYPE_L2_INTERFACE, vid, port, 0);
+    ofdpaMacAddr_t mac;
+    OFDPA_ERROR_t ofdpa_err;
+    sai_status_t err = SAI_STATUS_SUCCESS;
+    uint32_t i;
 
-    while ( true ) {
-        err = ofdpa_err2sai_status(ofdpaFlowNextGet(&flow, &flow));
-        if ( err != SAI_STATUS_SUCCESS ) {
-            break;
+    if ( macs == NULL ) {
+        return SAI_STATUS_SUCCESS;
+    }
+    log_debug("flush %u bridging flows: vid: %d, port: %d\n", macs->cnt, vid, port);
+    for ( i = 0; i < macs->size; i++ ) {
+        for ( e = macs->buckets[i]; e != NULL; e = e->next ) {
+            mac = ofdpa_sai_mac_from_key(e->key);
+            flow = _ofdpa_sai_create_bridging_flow_entry(vid, port, mac, 0);
+            ofdpa_err = ofdpaFlowDelete(&flow);
+            // the flow may have aged out meanwhile
+            if ( ofdpa_err != OFDPA_E_NONE && ofdpa_err != OFDPA_E_NOT_FOUND ) {
+                err = ofdpa_err2sai_status(ofdpa_err);
+                continue;
+            }
+            ofdpa_sai_fdb_event(SAI_FDB_EVENT_FLUSHED, vid, mac, (ofdpa_sai_port_t *)e->value);
         }
+    }
+    ofdpa_sai_map_clear(macs, NULL);
+    free(macs);
+    return err;
+}
 
-        if ( flow.flowData.bridgingFlowEntry.groupID != gid ) {
-            continue;
-        }
+// ofdpa_sai_flush_fdb flushes the learned MACs of a vid and/or a port, or
+// all of them when vid is 0 and port is NULL.
+static sai_status_t ofdpa_sai_flush_fdb(int vid, ofdpa_sai_port_t *port) {
+    ofdpa_sai_map_entry_t *e;
+    uint64_t *keys;
+    uint32_t i, n = 0;
+    sai_status_t err, ret = SAI_STATUS_SUCCESS;
 
-        err = ofdpa_err2sai_status(ofdpaFlowDelete(&flow));
+    if ( vid != 0 && port != NULL ) {
+        return ofdpa_sai_flush_bridging_flows(vid, port->index);
+    }
+    pthread_mutex_lock(&neigh_db_m);
+    // aged MACs of the pairs left without a learned one
+    ofdpa_sai_prune_last_seen(vid, port != NULL ? port->index : 0);
+    keys = malloc((fdb.by_vid_port.cnt + 1) * sizeof(uint64_t));
+    if ( keys == NULL ) {
+        pthread_mutex_unlock(&neigh_db_m);
+        return SAI_STATUS_NO_MEMORY;
+    }
+    for ( i = 0; i < fdb.by_vid_port.size; i++ ) {
+        for ( e = fdb.by_vid_port.buckets[i]; e != NULL; e = e->next ) {
+            if ( ( vid == 0 || (int)(e->key >> 32) == vid ) && ( port == NULL || (int)(uint32_t)e->key == port->index ) ) {
+                keys[n++] = e->key;
+            }
+        }
+    }
+    pthread_mutex_unlock(&neigh_db_m);
+    for ( i = 0; i < n; i++ ) {
+        err = ofdpa_sai_flush_bridging_flows((int)(keys[i] >> 32), (int)(uint32_t)keys[i]);
         if ( err != SAI_STATUS_SUCCESS ) {
-            return err;
+            ret = err;
         }
     }
-    return SAI_STATUS_SUCCESS;
+    free(keys);
+    return ret;
+}
+
+static ofdpa_sai_flood_group_t* get_ofdpa_sai_flood_group(int vid, bool create) {
+    ofdpa_sai_flood_group_t *fg = ofdpa_sai_map_get(&flood_group_by_vid, (uint64_t)vid);
+    if ( fg != NULL || !create ) {
+        return fg;
+    }
+    fg = calloc(1, sizeof(ofdpa_sai_flood_group_t));
+    if ( fg == NULL ) {
+        return NULL;
+    }
+    if ( ofdpa_sai_map_set(&flood_group_by_vid, (uint64_t)vid, fg) != 0 ) {
+        free(fg);
+        return NULL;
+    }
+    return fg;
+}
+
+static void ofdpa_sai_delete_flood_group(int vid) {
+    ofdpa_sai_flood_group_t *fg = ofdpa_sai_map_delete(&flood_group_by_vid, (uint64_t)vid);
+    if ( fg == NULL ) {
+        return;
+    }
+    ofdpa_sai_map_clear(&fg->index_by_ref_gid, NULL);
+    free(fg);
+}
+
+// ofdpa_sai_flood_group_free_index returns the lowest unused bucket index,
+// or -1 when all MAX_PORTS are used.
+static int ofdpa_sai_flood_group_free_index(ofdpa_sai_flood_group_t *fg) {
+    int i;
+    for ( i = 0; i < MAX_PORTS / 32; i++ ) {
+        if ( ~fg->used[i] != 0 ) {
+            return i * 32 + __builtin_ctz(~fg->used[i]);
+        }
+    }
+    return -1;
 }
 
 static sai_status_t ofdpa_sai_add_dlf_bucket(int vid, int port) {
     ofdpaGroupBucketEntry_t bucket = {0};
     uint32_t gid = ofdpa_sai_group_id(OFDPA_GROUP_ENTRY_TYPE_L2_FLOOD, vid, 0, 0);
     uint32_t ref_gid = ofdpa_sai_group_id(OFDPA_GROUP_ENTRY_TYPE_L2_INTERFACE, vid, port, 0);
-    int i = 0;
+    ofdpa_sai_flood_group_t *fg = get_ofdpa_sai_flood_group(vid, true);
+    int i;
     OFDPA_ERROR_t ofdpa_err;
 
-    printf("add dlf bucket: gid: %x, ref_gid: %x\n", gid, ref_gid);
+    log_debug("add dlf bucket: gid: %x, ref_gid: %x\n", gid, ref_gid);
+
+    if ( fg == NULL ) {
+        return SAI_STATUS_NO_MEMORY;
+    }
+    if ( ofdpa_sai_map_get(&fg->index_by_ref_gid, (uint64_t)ref_gid) != NULL ) {
+        return SAI_STATUS_SUCCESS;
+    }
 
     bucket.groupId = gid;
     bucket.referenceGroupId = ref_gid;
 
-    for (i = 0; i < MAX_PORTS; i++ ) {
+    while ( ( i = ofdpa_sai_flood_group_free_index(fg) ) >= 0 ) {
+        fg->used[i / 32] |= 1U << (i % 32);
         bucket.bucketIndex = (uint32_t)i;
         ofdpa_err = ofdpaGroupBucketEntryAdd(&bucket);
-        if ( ofdpa_err != OFDPA_E_EXISTS) {
+        // the index can be used by a bucket this shim didn't add, e.g.
+        // before a restart
+        if ( ofdpa_err == OFDPA_E_EXISTS ) {
+            continue;
+        }
+        if ( ofdpa_err != OFDPA_E_NONE ) {
+            fg->used[i / 32] &= ~(1U << (i % 32));
             return ofdpa_err2sai_status(ofdpa_err);
         }
+        if ( ofdpa_sai_map_set(&fg->index_by_ref_gid, (uint64_t)ref_gid, (void *)(uintptr_t)(i + 1)) != 0 ) {
+            return SAI_STATUS_NO_MEMORY;
+        }
+        return SAI_STATUS_SUCCESS;
     }
 
     return SAI_STATUS_NO_MEMORY;
@@ -1890,21 +3001,33 @@ static sai_status_t ofdpa_sai_delete_dlf_bucket(int vid, int port) {
     ofdpaGroupBucketEntry_t bucket = {0};
     uint32_t gid = ofdpa_sai_group_id(OFDPA_GROUP_ENTRY_TYPE_L2_FLOOD, vid, 0, 0);
     uint32_t ref_gid = ofdpa_sai_group_id(OFDPA_GROUP_ENTRY_TYPE_L2_INTERFACE, vid, port, 0);
-    int i = 0;
+    ofdpa_sai_flood_group_t *fg = get_ofdpa_sai_flood_group(vid, false);
+    uintptr_t idx = 0;
+    OFDPA_ERROR_t ofdpa_err;
     sai_status_t err;
 
-    printf("delete dlf bucket: gid: %x, ref_gid: %x\n", gid, ref_gid);
-
-    bucket.groupId = gid;
-    bucket.referenceGroupId = ref_gid;
+    log_debug("delete dlf bucket: gid: %x, ref_gid: %x\n", gid, ref_gid);
 
-    err = ofdpa_sai_get_bucket_by_reference_gid(gid, ref_gid, &bucket);
-    if ( err != SAI_STATUS_SUCCESS ) {
-        printf("failed to delete dlf bucket for vid: %d, port: %d\n", vid, port);
-        return err;
+    if ( fg != NULL ) {
+        idx = (uintptr_t)ofdpa_sai_map_delete(&fg->index_by_ref_gid, (uint64_t)ref_gid);
+    }
+    if ( idx == 0 ) {
+        // a bucket this shim didn't add, look for it in the group
+        bucket.groupId = gid;
+        bucket.referenceGroupId = ref_gid;
+        err = ofdpa_sai_get_bucket_by_reference_gid(gid, ref_gid, &bucket);
+        if ( err != SAI_STATUS_SUCCESS ) {
+            log_error("failed to delete dlf bucket for vid: %d, port: %d\n", vid, port);
+            return err;
+        }
+        idx = bucket.bucketIndex + 1;
     }
 
-    return ofdpa_err2sai_status(ofdpaGroupBucketEntryDelete(gid, bucket.bucketIndex));
+    ofdpa_err = ofdpaGroupBucketEntryDelete(gid, (uint32_t)(idx - 1));
+    if ( fg != NULL && idx - 1 < MAX_PORTS && ( ofdpa_err == OFDPA_E_NONE || ofdpa_err == OFDPA_E_NOT_FOUND ) ) {
+        fg->used[(idx - 1) / 32] &= ~(1U << ((idx - 1) % 32));
+    }
+    return ofdpa_err2sai_status(ofdpa_err);
 }
 
 static sai_status_t ofdpa_sai_add_dlf_flow(int vid) {
@@ -1924,7 +3047,7 @@ static sai_status_t ofdpa_sai_add_dlf_flow(int vid) {
         return err;
     }
 
-    printf("add dlf flow: vid: %d, gid: %x\n", vid, gid);
+    log_debug("add dlf flow: vid: %d, gid: %x\n", vid, gid);
 
     br.gotoTableId = OFDPA_FLOW_TABLE_ID_ACL_POLICY;
     br.groupID = gid;
@@ -1943,7 +3066,7 @@ static sai_status_t ofdpa_sai_delete_dlf_flow(int vid) {
     sai_status_t err;
     uint32_t gid = ofdpa_sai_group_id(OFDPA_GROUP_ENTRY_TYPE_L2_FLOOD, vid, 0, 0);
 
-    printf("delete dlf flow: vid: %d, gid: %x\n", vid, gid);
+    log_debug("delete dlf flow: vid: %d, gid: %x\n", vid, gid);
 
     br.gotoTableId = OFDPA_FLOW_TABLE_ID_ACL_POLICY;
     br.groupID = gid;
@@ -1956,7 +3079,12 @@ static sai_status_t ofdpa_sai_delete_dlf_flow(int vid) {
         return err;
     }
 
-    return ofdpa_err2sai_status(ofdpaGroupDelete(gid));
+    err = ofdpa_err2sai_status(ofdpaGroupDelete(gid));
+    if ( err != SAI_STATUS_SUCCESS ) {
+        return err;
+    }
+    ofdpa_sai_delete_flood_group(vid);
+    return SAI_STATUS_SUCCESS;
 }
 
 static ofdpaFlowEntry_t _ofdpa_sai_create_mac_termination_flow(int vid, int port, ofdpaMacAddr_t dst) {
@@ -2001,7 +3129,7 @@ static sai_status_t ofdpa_sai_get_port_oper_status(int port, sai_port_oper_statu
     OFDPA_ERROR_t err;
     err = ofdpaPortStateGet(port, &state);
     if ( err != OFDPA_E_NONE) {
-        printf("state get failed: %d", port);
+        log_error("state get failed: %d", port);
         return SAI_STATUS_FAILURE;
     }
     switch ( state ) {
@@ -2012,7 +3140,7 @@ static sai_status_t ofdpa_sai_get_port_oper_status(int port, sai_port_oper_statu
         *status = SAI_PORT_OPER_STATUS_DOWN;
         break;
     default:
-        printf("unknown port state: %d\n", state);
+        log_warn("unknown port state: %d\n", state);
         return SAI_STATUS_FAILURE;
     }
     return SAI_STATUS_SUCCESS;
@@ -2219,6 +3347,15 @@ static sai_status_t ofdpa_sai_delete_unicast_routing_flow(int gid, int vrf, bool
     return ofdpa_err2sai_status(ofdpaFlowDelete(&entry));
 }
 
+// ofdpa_sai_hostif_release closes the TAP interface of port and detaches it
+// from the port, for the error paths of sai_create_hostif.
+static void ofdpa_sai_hostif_release(ofdpa_sai_port_t *port) {
+    int fd = port->fd;
+    port->fd = 0;
+    port->hostif_oid = 0;
+    close(fd);
+}
+
 sai_status_t sai_create_hostif(
         _Out_ sai_object_id_t *hif_id,
         _In_ sai_object_id_t switch_id,
@@ -2231,6 +3368,7 @@ sai_status_t sai_create_hostif(
     ofdpaMacAddr_t mac;
     sai_status_t err;
     ofdpa_sai_port_t *port = NULL;
+    struct epoll_event ev;
 
     for( i = 0; i < attr_count; i++ ) {
         switch (attr_list[i].id) {
@@ -2265,6 +3403,12 @@ sai_status_t sai_create_hostif(
         return SAI_STATUS_FAILURE;
     }
 
+    if ( fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK) < 0 ) {
+        log_error("failed to make %s non-blocking\n", name);
+        close(fd);
+        return SAI_STATUS_FAILURE;
+    }
+
     port->hostif_oid = *hif_id;
     port->fd = fd;
 
@@ -2277,19 +3421,30 @@ sai_status_t sai_create_hostif(
 
     err = ofdpa_sai_add_l2_interface_group(vid, ofdpa_idx, true);
     if ( err != SAI_STATUS_SUCCESS ) {
-        printf("failed to add l2 interface group: %d %d\n", vid, port->i);
+        log_error("failed to add l2 interface group: %d %d\n", vid, port->i);
+        ofdpa_sai_hostif_release(port);
         return err;
     }
 
     err = ofdpa_sai_add_vlan_flow_entry(vid, ofdpa_idx, false);
     if ( err != SAI_STATUS_SUCCESS ) {
-        printf("failed to add vlan flow entry: %d %d\n", vid, port->i);
+        log_error("failed to add vlan flow entry: %d %d\n", vid, port->i);
+        ofdpa_sai_delete_l2_interface_group(vid, ofdpa_idx);
+        ofdpa_sai_hostif_release(port);
         return err;
     }
 
-    pthread_create(&port->pt, NULL, ofdpa_sai_pkt_send_loop, (void *)port);
+    ev.events = EPOLLIN;
+    ev.data.ptr = port;
+    if ( epoll_ctl(tap_epfd, EPOLL_CTL_ADD, fd, &ev) < 0 ) {
+        log_error("failed to watch %s: %d\n", name, errno);
+        ofdpa_sai_delete_vlan_flow_entry(vid, ofdpa_idx, false);
+        ofdpa_sai_delete_l2_interface_group(vid, ofdpa_idx);
+        ofdpa_sai_hostif_release(port);
+        return SAI_STATUS_FAILURE;
+    }
 
-    printf("send loop thread created for %s\n", name);
+    log_notice("%s added to the send loop\n", name);
 
     return SAI_STATUS_SUCCESS;
 }
@@ -2361,7 +3516,7 @@ sai_status_t sai_get_hostif_trap_group_attribute(
         _In_ uint32_t attr_count,
         _Inout_ sai_attribute_t *attr_list){
     int i;
-    printf("trap: %lx, %lx\n", hostif_trap_group_id, g_default_trap_group);
+    log_debug("trap: %lx, %lx\n", hostif_trap_group_id, g_default_trap_group);
     if ( hostif_trap_group_id != g_default_trap_group ) {
         return SAI_STATUS_NOT_SUPPORTED;
     }
@@ -2487,6 +3642,7 @@ sai_status_t sai_create_next_hop(
     ofdpa_sai_vlan_t *vlan = NULL;
     ofdpa_sai_port_t *port = NULL;
     ofdpa_sai_neighbor_t *neighbor = NULL;
+    char ssrc[32], sdst[32];
 
     for ( i = 0; i < attr_count; i++ ) {
         switch ( attr_list[i].id ) {
@@ -2503,26 +3659,17 @@ sai_status_t sai_create_next_hop(
         }
     }
 
-    printf("create next hop: %d\n", ip4);
+    log_debug("create next hop: %d\n", ip4);
 
     if ( port != NULL ) {
-        for ( i = 0; i < port->num_neighbor; i++ ) {
-            if ( port->neighbors[i].ip == ip4 ) {
-                neighbor = &port->neighbors[i];
-            }
-        }
+        neighbor = get_ofdpa_sai_neighbor(oid, ip4);
     } else if ( vlan != NULL ) {
-        for ( i = 0; i < vlan->num_neighbor; i++ ) {
-            if ( vlan->neighbors[i].ip == ip4 ) {
-                neighbor = &vlan->neighbors[i];
-            }
-        }
-
+        neighbor = get_ofdpa_sai_neighbor(oid, ip4);
         if ( neighbor == NULL ) {
             return SAI_STATUS_FAILURE;
         }
 
-        port = get_ofdpa_sai_port_by_mac(0, neighbor->mac);
+        port = get_ofdpa_sai_port_by_mac(vlan->vid, neighbor->mac);
         if ( port == NULL ) {
             return SAI_STATUS_FAILURE;
         }
@@ -2535,8 +3682,10 @@ sai_status_t sai_create_next_hop(
         return SAI_STATUS_FAILURE;
     }
 
-    printf("setting nexthop oid: %lx\n", *next_hop_id);
-    neighbor->oid = *next_hop_id;
+    log_debug("setting nexthop oid: %lx\n", *next_hop_id);
+    if ( ofdpa_sai_set_neighbor_next_hop(neighbor, *next_hop_id) != 0 ) {
+        return SAI_STATUS_NO_MEMORY;
+    }
 
     vid = port->vid;
     index = port->index;
@@ -2547,28 +3696,28 @@ sai_status_t sai_create_next_hop(
 
     ref_gid = (int)ofdpa_sai_group_id(OFDPA_GROUP_ENTRY_TYPE_L2_INTERFACE, vid, index, 0);
 
-    printf("ref-gid: %d\n", ref_gid);
-    print_mac(src);
-    print_mac(dst);
+    macstr(src, ssrc);
+    macstr(dst, sdst);
+    log_debug("ref-gid: %d, src: %s, dst: %s\n", ref_gid, ssrc, sdst);
 
     err = ofdpa_sai_add_l3_unicast_group(vid, src, dst, ref_gid, l3_unicast_idx, &gid);
     if ( err != SAI_STATUS_SUCCESS ) {
-        printf("failed to add l3 unicast group: %d\n", vid);
+        log_error("failed to add l3 unicast group: %d\n", vid);
         return SAI_STATUS_FAILURE;
     }
 
-    printf("setting gid: %x\n", gid);
+    log_debug("setting gid: %x\n", gid);
     neighbor->gid = gid;
 
-    printf("added l3 unciast group\n");
+    log_debug("added l3 unciast group\n");
 
     err = ofdpa_sai_add_unicast_routing_flow(gid, 0, false, (int)ip, (int)0xffffffff);
     if ( err != SAI_STATUS_SUCCESS ) {
-        printf("failed to add unicast routing flow: %d\n", gid);
+        log_error("failed to add unicast routing flow: %d\n", gid);
         return err;
     }
 
-    printf("added unicast routing flow\n");
+    log_debug("added unicast routing flow\n");
 
     return SAI_STATUS_SUCCESS;
 }
@@ -2603,18 +3752,17 @@ sai_status_t sai_create_neighbor_entry(
         _In_ const sai_neighbor_entry_t *neighbor_entry,
         _In_ uint32_t attr_count,
         _In_ const sai_attribute_t *attr_list){
-    int i, j, idx = -1, jdx;
+    int i, j, idx = -1;
     ofdpaMacAddr_t mac;
     ofdpa_sai_vlan_t *vlan = NULL;
+    ofdpa_sai_port_t *port;
+    ofdpa_sai_neighbor_t *neighbor;
     char ip[32];
 
-    for ( i = 0; i < port_num; i++ ) {
-        if ( ports[i].router_if_oid == neighbor_entry->rif_id ) {
-            idx = i;
-        }
-    }
-
-    if ( idx < 0 ) {
+    port = ofdpa_sai_map_get(&port_by_rif_oid, neighbor_entry->rif_id);
+    if ( port != NULL ) {
+        idx = port->i;
+    } else {
         vlan = get_ofdpa_sai_vlan_by_router_if_oid(neighbor_entry->rif_id);
         if ( vlan == NULL ) {
             return SAI_STATUS_FAILURE;
@@ -2631,23 +3779,22 @@ sai_status_t sai_create_neighbor_entry(
     }
 
     ipstr(neighbor_entry->ip_address.addr.ip4, ip);
-    printf("create neighbor entry: %d %d %s\n", idx, jdx, ip);
+    log_debug("create neighbor entry: %d %s\n", idx, ip);
 
-    if ( vlan == NULL ) {
-        jdx = ports[idx].num_neighbor++;
-        ports[idx].neighbors[jdx].mac = mac;
-        ports[idx].neighbors[jdx].ip = (uint32_t)neighbor_entry->ip_address.addr.ip4;
-    } else {
-        jdx = vlan->num_neighbor++;
-        vlan->neighbors[jdx].mac = mac;
-        vlan->neighbors[jdx].ip = (uint32_t)neighbor_entry->ip_address.addr.ip4;
+    neighbor = ofdpa_sai_add_neighbor(neighbor_entry->rif_id, (uint32_t)neighbor_entry->ip_address.addr.ip4, mac);
+    if ( neighbor == NULL ) {
+        return SAI_STATUS_NO_MEMORY;
     }
 
     return SAI_STATUS_SUCCESS;
 }
 
 sai_status_t sai_remove_neighbor_entry(_In_ const sai_neighbor_entry_t *neighbor_entry){
-    // TODO:
+    char ip[32];
+    if ( ofdpa_sai_delete_neighbor(neighbor_entry->rif_id, (uint32_t)neighbor_entry->ip_address.addr.ip4) != 0 ) {
+        ipstr(neighbor_entry->ip_address.addr.ip4, ip);
+        log_warn("no neighbor entry for %s. ignore\n", ip);
+    }
     return SAI_STATUS_SUCCESS;
 }
 
@@ -2676,16 +3823,97 @@ sai_neighbor_api_t neighbor_api = {
     .remove_all_neighbor_entries = sai_remove_all_neighbor_entries,
 };
 
+sai_status_t sai_create_fdb_entry(
+        _In_ const sai_fdb_entry_t *fdb_entry,
+        _In_ uint32_t attr_count,
+        _In_ const sai_attribute_t *attr_list){
+    return SAI_STATUS_NOT_SUPPORTED;
+}
+
+sai_status_t sai_remove_fdb_entry(_In_ const sai_fdb_entry_t *fdb_entry){
+    ofdpa_sai_vlan_t *vlan = get_ofdpa_sai_vlan_by_vlan_oid(fdb_entry->bv_id);
+    ofdpa_sai_port_t *port;
+    ofdpaFlowEntry_t flow;
+    ofdpaMacAddr_t mac;
+    OFDPA_ERROR_t err;
+    if ( vlan == NULL ) {
+        return SAI_STATUS_INVALID_PARAMETER;
+    }
+    memcpy(mac.addr, fdb_entry->mac_address, OFDPA_MAC_ADDR_LEN);
+    port = ofdpa_sai_forget_mac(vlan->vid, mac, false);
+    if ( port == NULL ) {
+        return SAI_STATUS_ITEM_NOT_FOUND;
+    }
+    flow = _ofdpa_sai_create_bridging_flow_entry(vlan->vid, port->index, mac, 0);
+    err = ofdpaFlowDelete(&flow);
+    if ( err == OFDPA_E_NOT_FOUND ) {
+        return SAI_STATUS_SUCCESS;
+    }
+    return ofdpa_err2sai_status(err);
+}
+
+sai_status_t sai_set_fdb_entry_attribute(
+        _In_ const sai_fdb_entry_t *fdb_entry,
+        _In_ const sai_attribute_t *attr){
+    return SAI_STATUS_NOT_SUPPORTED;
+}
+
+sai_status_t sai_get_fdb_entry_attribute(
+        _In_ const sai_fdb_entry_t *fdb_entry,
+        _In_ uint32_t attr_count,
+        _Inout_ sai_attribute_t *attr_list){
+    return SAI_STATUS_NOT_SUPPORTED;
+}
+
+sai_status_t sai_flush_fdb_entries(
+        _In_ sai_object_id_t switch_id,
+        _In_ uint32_t attr_count,
+        _In_ const sai_attribute_t *attr_list){
+    ofdpa_sai_port_t *port = NULL;
+    ofdpa_sai_vlan_t *vlan = NULL;
+    int i;
+    for ( i = 0; i < attr_count; i++ ) {
+        switch ( attr_list[i].id ) {
+        case SAI_FDB_FLUSH_ATTR_BRIDGE_PORT_ID:
+            port = get_ofdpa_sai_port_by_bridge_port_oid(attr_list[i].value.oid);
+            if ( port == NULL ) {
+                return SAI_STATUS_INVALID_PARAMETER;
+            }
+            break;
+        case SAI_FDB_FLUSH_ATTR_BV_ID:
+            vlan = get_ofdpa_sai_vlan_by_vlan_oid(attr_list[i].value.oid);
+            if ( vlan == NULL ) {
+                return SAI_STATUS_INVALID_PARAMETER;
+            }
+            break;
+        case SAI_FDB_FLUSH_ATTR_ENTRY_TYPE:
+            // all the entries are learned ones
+            if ( attr_list[i].value.s32 == SAI_FDB_FLUSH_ENTRY_TYPE_STATIC ) {
+                return SAI_STATUS_SUCCESS;
+            }
+            break;
+        }
+    }
+    return ofdpa_sai_flush_fdb(vlan != NULL ? vlan->vid : 0, port);
+}
+
+sai_fdb_api_t fdb_api = {
+    .create_fdb_entry = sai_create_fdb_entry,
+    .remove_fdb_entry = sai_remove_fdb_entry,
+    .set_fdb_entry_attribute = sai_set_fdb_entry_attribute,
+    .get_fdb_entry_attribute = sai_get_fdb_entry_attribute,
+    .flush_fdb_entries = sai_flush_fdb_entries,
+};
+
 sai_object_type_t sai_object_type_query(_In_ sai_object_id_t sai_object_id) {
     return (sai_object_type_t)(sai_object_id >> OBJECT_TYPE_SHIFT);
 }
 
 sai_status_t sai_api_initialize(_In_ uint64_t flags, _In_ const sai_service_method_table_t *services) {
-    ofdpa_sai_vlan_t *v;
-    pthread_mutex_init(&m, NULL);
-    v = malloc(sizeof(ofdpa_sai_vlan_t));
-    memset(v, 0, sizeof(ofdpa_sai_vlan_t));
-    vlans = v;
+    ofdpa_sai_log_init();
+    pthread_mutex_init(&neigh_db_m, NULL);
+    pthread_mutex_init(&fdb_m, NULL);
+    pthread_cond_init(&fdb_cond, NULL);
 
     return SAI_STATUS_SUCCESS;
 }
@@ -2722,8 +3950,11 @@ sai_status_t sai_api_query(_In_ sai_api_t sai_api_id, _Out_ void **api_method_ta
     case SAI_API_NEIGHBOR:
         *api_method_table = &neighbor_api;
         break;
+    case SAI_API_FDB:
+        *api_method_table = &fdb_api;
+        break;
     default:
-        printf("no api: %d\n", sai_api_id);
+        log_warn("no api: %d\n", sai_api_id);
     }
     return SAI_STATUS_SUCCESS;
 }
@@ -2732,7 +3963,20 @@ sai_status_t sai_api_uninitialize(void) {
     return SAI_STATUS_SUCCESS;
 }
 
-sai_status_t sai_log_set(_In_ sai_api_t sai_api_id, _In_ sai_log_level_t log_level) {
+sai_status_t sai_log_set(_In_ sai_api_t sai_api_id, _In_ sai_log_level_t level) {
+    int i, min = SAI_LOG_LEVEL_CRITICAL;
+    if ( !log_started || sai_api_id < 0 || sai_api_id >= SAI_API_MAX ) {
+        return SAI_STATUS_INVALID_PARAMETER;
+    }
+    // the shim doesn't tell apart which API a message belongs to, so it
+    // logs at the most verbose level any API asked for
+    log_levels[sai_api_id] = level;
+    for ( i = 0; i < SAI_API_MAX; i++ ) {
+        if ( log_levels[i] < min ) {
+            min = log_levels[i];
+        }
+    }
+    log_level = min;
     return SAI_STATUS_SUCCESS;
 }
 
@@ -2741,5 +3985,21 @@ sai_object_id_t sai_switch_id_query(_In_ sai_object_id_t sai_object_id) {
 }
 
 sai_status_t sai_dbg_generate_dump(_In_ const char *dump_file_name) {
+    FILE *f;
+    int i;
+    f = fopen(dump_file_name, "w");
+    if ( f == NULL ) {
+        return SAI_STATUS_FAILURE;
+    }
+    for ( i = 0; i < port_num; i++ ) {
+        fprintf(f, "%s: index: %d, tx_packets: %lu, tx_bytes: %lu, tx_errors: %lu\n", ports[i].name, ports[i].index,
+                (unsigned long)ports[i].tx_packets, (unsigned long)ports[i].tx_bytes, (unsigned long)ports[i].tx_errors);
+    }
+    for ( i = 0; i < RX_QUEUE_MAX; i++ ) {
+        fprintf(f, "rx queue %s: dropped: %lu, errors: %lu\n", rx_queues[i].name,
+                (unsigned long)rx_queues[i].ring.dropped, (unsigned long)rx_queues[i].errors);
+    }
+    fprintf(f, "learn queue: dropped: %lu\n", (unsigned long)learn_ring.dropped);
+    fclose(f);
     return SAI_STATUS_SUCCESS;
 }
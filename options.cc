@@ -0,0 +1,334 @@
+#include <getopt.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <utility>
+
+#include <grpc/grpc.h>
+#include <grpc++/server_builder.h>
+#include <grpc++/security/server_credentials.h>
+
+#include "options.h"
+#include "admission.h"
+
+const char* DEFAULT_LISTEN_ADDRESS = "0.0.0.0:50051";
+
+struct option_def {
+    const char* name;
+    const char* arg;
+    const char* help;
+};
+
+const option_def option_defs[] = {
+    {"config", "FILE", "read options from FILE, one \"key = value\" per line"},
+    {"listen", "ADDR", "listen on host:port or unix:/path, repeatable (default 0.0.0.0:50051)"},
+    {"metrics-address", "ADDR", "serve OpenMetrics on ADDR (host:port), disabled by default"},
+    {"counters-shm", "PATH", "publish port counters to the shared-memory table PATH (counter_shm.h)"},
+    {"stat-interval", "MS", "counter poll interval in milliseconds (default 1000)"},
+    {"state-file", "PATH", "save the configuration state to PATH and reconcile it on restart"},
+    {"state-interval", "MS", "state save interval in milliseconds (default 1000)"},
+    {"units", "LIST", "comma separated units to poll counters of (default 0)"},
+    {"unit-workers", "0|1", "run the SDK calls of each unit on its own worker thread (default 1)"},
+    {"max-active-rpcs", "N", "admit at most N non-critical RPCs at a time, 0 for no limit (default 16)"},
+    {"max-bulk-rpcs", "N", "admit at most N bulk RPCs at a time (default 1)"},
+    {"rpc-class", "METHOD=CLASS", "run Service.Method as critical, normal or bulk, repeatable"},
+    {"priority-peers", "LIST", "comma separated peer addresses (or unix) allowed to raise the class of a call"},
+    {"max-message-size", "BYTES", "maximum send and receive message size"},
+    {"keepalive-time", "MS", "interval of keepalive pings to clients"},
+    {"keepalive-timeout", "MS", "time to wait for a keepalive ping ack"},
+    {"keepalive-permit-without-calls", "0|1", "allow keepalive pings on connections without calls"},
+    {"min-ping-interval", "MS", "minimum interval of client pings without data"},
+    {"http2-stream-window", "BYTES", "fixed HTTP/2 stream flow-control window, disables BDP probing"},
+    {"http2-max-frame-size", "BYTES", "maximum HTTP/2 frame size"},
+    {"http2-write-buffer-size", "BYTES", "HTTP/2 write buffer size"},
+};
+const int NUM_OPTIONS = sizeof(option_defs) / sizeof(option_defs[0]);
+
+void usage(const char* prog) {
+    std::cerr << "usage: " << prog << " [options]" << std::endl;
+    for ( auto& d : option_defs ) {
+        std::string flag = std::string("--") + d.name + " " + d.arg;
+        std::cerr << "  " << flag;
+        for ( size_t i = flag.size(); i < 40; i++ ) {
+            std::cerr << ' ';
+        }
+        std::cerr << " " << d.help << std::endl;
+    }
+}
+
+bool parse_int(const std::string& value, int* out) {
+    char* end;
+    auto v = std::strtol(value.c_str(), &end, 10);
+    if ( value.empty() || *end != '\0' ) {
+        return false;
+    }
+    *out = int(v);
+    return true;
+}
+
+bool set_option(server_options* opts, const std::string& name, const std::string& value) {
+    if ( name == "listen" ) {
+        opts->listen.push_back(value);
+        return true;
+    } else if ( name == "metrics-address" ) {
+        opts->metrics_address = value;
+        return true;
+    } else if ( name == "counters-shm" ) {
+        opts->counters_shm = value;
+        return true;
+    } else if ( name == "state-file" ) {
+        opts->state_file = value;
+        return true;
+    } else if ( name == "state-interval" ) {
+        return parse_int(value, &opts->state_interval) && opts->state_interval > 0;
+    } else if ( name == "units" ) {
+        opts->units.clear();
+        std::istringstream in(value);
+        std::string unit;
+        while ( std::getline(in, unit, ',') ) {
+            int u;
+            if ( !parse_int(unit, &u) ) {
+                return false;
+            }
+            opts->units.push_back(u);
+        }
+        return !opts->units.empty();
+    } else if ( name == "stat-interval" ) {
+        return parse_int(value, &opts->stat_interval) && opts->stat_interval > 0;
+    } else if ( name == "unit-workers" ) {
+        return parse_int(value, &opts->unit_workers);
+    } else if ( name == "max-active-rpcs" ) {
+        return parse_int(value, &opts->max_active_rpcs) && opts->max_active_rpcs >= 0;
+    } else if ( name == "max-bulk-rpcs" ) {
+        return parse_int(value, &opts->max_bulk_rpcs) && opts->max_bulk_rpcs >= 0;
+    } else if ( name == "rpc-class" ) {
+        auto eq = value.find('=');
+        int cls;
+        if ( eq == std::string::npos || !parse_rpc_class(value.substr(eq + 1), &cls) ) {
+            return false;
+        }
+        opts->rpc_classes.push_back(std::make_pair(value.substr(0, eq), cls));
+        return true;
+    } else if ( name == "priority-peers" ) {
+        opts->priority_peers.clear();
+        std::istringstream in(value);
+        std::string peer;
+        while ( std::getline(in, peer, ',') ) {
+            opts->priority_peers.push_back(peer);
+        }
+        return !opts->priority_peers.empty();
+    } else if ( name == "max-message-size" ) {
+        return parse_int(value, &opts->max_message_size);
+    } else if ( name == "keepalive-time" ) {
+        return parse_int(value, &opts->keepalive_time_ms);
+    } else if ( name == "keepalive-timeout" ) {
+        return parse_int(value, &opts->keepalive_timeout_ms);
+    } else if ( name == "keepalive-permit-without-calls" ) {
+        return parse_int(value, &opts->keepalive_permit_without_calls);
+    } else if ( name == "min-ping-interval" ) {
+        return parse_int(value, &opts->min_ping_interval_ms);
+    } else if ( name == "http2-stream-window" ) {
+        return parse_int(value, &opts->http2_stream_window);
+    } else if ( name == "http2-max-frame-size" ) {
+        return parse_int(value, &opts->http2_max_frame_size);
+    } else if ( name == "http2-write-buffer-size" ) {
+        return parse_int(value, &opts->http2_write_buffer_size);
+    }
+    return false;
+}
+
+std::string trim(const std::string& s) {
+    auto b = s.find_first_not_of(" \t\r");
+    if ( b == std::string::npos ) {
+        return "";
+    }
+    auto e = s.find_last_not_of(" \t\r");
+    return s.substr(b, e - b + 1);
+}
+
+bool read_config(const std::string& path, std::vector<std::pair<std::string, std::string> >* settings) {
+    std::ifstream in(path);
+    if ( !in ) {
+        std::cerr << "cannot read config file " << path << std::endl;
+        return false;
+    }
+    std::string line;
+    int lineno = 0;
+    while ( std::getline(in, line) ) {
+        lineno++;
+        auto hash = line.find('#');
+        if ( hash != std::string::npos ) {
+            line = line.substr(0, hash);
+        }
+        line = trim(line);
+        if ( line.empty() ) {
+            continue;
+        }
+        auto eq = line.find('=');
+        if ( eq == std::string::npos ) {
+            std::cerr << path << ":" << lineno << ": expected key = value" << std::endl;
+            return false;
+        }
+        settings->push_back(std::make_pair(trim(line.substr(0, eq)), trim(line.substr(eq + 1))));
+    }
+    return true;
+}
+
+bool parse_options(int argc, char** argv, server_options* opts) {
+    opts->stat_interval = 1000;
+    opts->state_interval = 1000;
+    opts->units.assign(1, 0);
+    opts->unit_workers = 1;
+    opts->max_active_rpcs = 16;
+    opts->max_bulk_rpcs = 1;
+    opts->max_message_size = -1;
+    opts->keepalive_time_ms = -1;
+    opts->keepalive_timeout_ms = -1;
+    opts->keepalive_permit_without_calls = -1;
+    opts->min_ping_interval_ms = -1;
+    opts->http2_stream_window = -1;
+    opts->http2_max_frame_size = -1;
+    opts->http2_write_buffer_size = -1;
+
+    std::vector<struct option> long_options;
+    for ( int i = 0; i < NUM_OPTIONS; i++ ) {
+        long_options.push_back({option_defs[i].name, required_argument, 0, 256 + i});
+    }
+    long_options.push_back({"help", no_argument, 0, 'h'});
+    long_options.push_back({0, 0, 0, 0});
+
+    std::vector<std::pair<std::string, std::string> > flags;
+    std::string config;
+    int c;
+    while ( (c = getopt_long(argc, argv, "h", long_options.data(), NULL)) != -1 ) {
+        if ( c < 256 || c >= 256 + NUM_OPTIONS ) {
+            return false;
+        }
+        std::string name = option_defs[c - 256].name;
+        if ( name == "config" ) {
+            config = optarg;
+        } else {
+            flags.push_back(std::make_pair(name, optarg));
+        }
+    }
+    if ( optind != argc ) {
+        return false;
+    }
+
+    std::vector<std::pair<std::string, std::string> > settings;
+    if ( !config.empty() && !read_config(config, &settings) ) {
+        return false;
+    }
+    // listen addresses given as flags replace those of the config file
+    bool listen_flag = false;
+    for ( auto& f : flags ) {
+        listen_flag |= f.first == "listen";
+    }
+    for ( auto& s : settings ) {
+        if ( listen_flag && s.first == "listen" ) {
+            continue;
+        }
+        if ( !set_option(opts, s.first, s.second) ) {
+            std::cerr << config << ": invalid option " << s.first << " = " << s.second << std::endl;
+            return false;
+        }
+    }
+    for ( auto& f : flags ) {
+        if ( !set_option(opts, f.first, f.second) ) {
+            std::cerr << "invalid option --" << f.first << " " << f.second << std::endl;
+            return false;
+        }
+    }
+    if ( opts->listen.empty() ) {
+        opts->listen.push_back(DEFAULT_LISTEN_ADDRESS);
+    }
+    return true;
+}
+
+// remove_stale_socket unlinks a unix socket left behind by a previous run,
+// which would otherwise make the bind fail. A socket some server still
+// accepts connections on is left alone and fails the startup.
+bool remove_stale_socket(const std::string& address) {
+    const std::string scheme("unix:");
+    if ( address.compare(0, scheme.size(), scheme) != 0 ) {
+        return true;
+    }
+    auto path = address.substr(scheme.size());
+    if ( path.compare(0, 2, "//") == 0 ) {
+        path = path.substr(2);
+    }
+    struct stat st;
+    if ( stat(path.c_str(), &st) != 0 || !S_ISSOCK(st.st_mode) ) {
+        return true;
+    }
+    sockaddr_un sa;
+    if ( path.size() >= sizeof(sa.sun_path) ) {
+        std::cerr << "unix socket path too long: " << path << std::endl;
+        return false;
+    }
+    std::memset(&sa, 0, sizeof(sa));
+    sa.sun_family = AF_UNIX;
+    std::memcpy(sa.sun_path, path.c_str(), path.size());
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if ( fd < 0 ) {
+        std::cerr << "cannot check " << path << ": " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    auto ret = connect(fd, (sockaddr*)&sa, sizeof(sa));
+    auto err = errno;
+    close(fd);
+    if ( ret < 0 && err == ECONNREFUSED ) {
+        unlink(path.c_str());
+        return true;
+    }
+    if ( ret == 0 ) {
+        std::cerr << "another server is listening on " << path << std::endl;
+    } else {
+        std::cerr << "cannot check " << path << ": " << std::strerror(err) << std::endl;
+    }
+    return false;
+}
+
+bool configure_builder(const server_options& opts, grpc::ServerBuilder* builder) {
+    for ( auto& address : opts.listen ) {
+        if ( !remove_stale_socket(address) ) {
+            return false;
+        }
+        builder->AddListeningPort(address, grpc::InsecureServerCredentials());
+    }
+    if ( opts.max_message_size >= 0 ) {
+        builder->SetMaxReceiveMessageSize(opts.max_message_size);
+        builder->SetMaxSendMessageSize(opts.max_message_size);
+    }
+    if ( opts.keepalive_time_ms >= 0 ) {
+        builder->AddChannelArgument(GRPC_ARG_KEEPALIVE_TIME_MS, opts.keepalive_time_ms);
+    }
+    if ( opts.keepalive_timeout_ms >= 0 ) {
+        builder->AddChannelArgument(GRPC_ARG_KEEPALIVE_TIMEOUT_MS, opts.keepalive_timeout_ms);
+    }
+    if ( opts.keepalive_permit_without_calls >= 0 ) {
+        builder->AddChannelArgument(GRPC_ARG_KEEPALIVE_PERMIT_WITHOUT_CALLS, opts.keepalive_permit_without_calls);
+    }
+    if ( opts.min_ping_interval_ms >= 0 ) {
+        builder->AddChannelArgument(GRPC_ARG_HTTP2_MIN_RECV_PING_INTERVAL_WITHOUT_DATA_MS, opts.min_ping_interval_ms);
+    }
+    if ( opts.http2_stream_window >= 0 ) {
+        builder->AddChannelArgument(GRPC_ARG_HTTP2_STREAM_LOOKAHEAD_BYTES, opts.http2_stream_window);
+        builder->AddChannelArgument(GRPC_ARG_HTTP2_BDP_PROBE, 0);
+    }
+    if ( opts.http2_max_frame_size >= 0 ) {
+        builder->AddChannelArgument(GRPC_ARG_HTTP2_MAX_FRAME_SIZE, opts.http2_max_frame_size);
+    }
+    if ( opts.http2_write_buffer_size >= 0 ) {
+        builder->AddChannelArgument(GRPC_ARG_HTTP2_WRITE_BUFFER_SIZE, opts.http2_write_buffer_size);
+    }
+    return true;
+}
@@ -0,0 +1,43 @@
+#ifndef OPTIONS_H
+#define OPTIONS_H
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <grpc++/server_builder.h>
+
+// server_options holds the startup configuration of opennsl-server. Every
+// option can be given as a --flag or as a "key = value" line of the file
+// named by --config; flags take precedence over the file. Integer tuning
+// options left at -1 keep the gRPC defaults.
+struct server_options {
+    std::vector<std::string> listen; // host:port or unix:/path, repeatable
+    std::string metrics_address;
+    std::string counters_shm;
+    std::string state_file;
+    int state_interval;
+    int stat_interval;
+    std::vector<int> units;
+    int unit_workers;
+    int max_active_rpcs;
+    int max_bulk_rpcs;
+    std::vector<std::pair<std::string, int> > rpc_classes; // method, rpc_class
+    std::vector<std::string> priority_peers;
+    int max_message_size;
+    int keepalive_time_ms;
+    int keepalive_timeout_ms;
+    int keepalive_permit_without_calls;
+    int min_ping_interval_ms;
+    int http2_stream_window;
+    int http2_max_frame_size;
+    int http2_write_buffer_size;
+};
+
+void usage(const char* prog);
+bool parse_options(int argc, char** argv, server_options* opts);
+// configure_builder adds the listening ports and the tuning options to
+// builder. It fails when a unix socket to listen on is still in use.
+bool configure_builder(const server_options& opts, grpc::ServerBuilder* builder);
+
+#endif // OPTIONS_H
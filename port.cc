@@ -5,6 +5,9 @@
 
 #include "portservice.grpc.pb.h"
 #include "port.h"
+#include "metrics.h"
+#include "admission.h"
+#include "config_state.h"
 
 extern "C" {
 #include "opennsl/error.h"
@@ -12,8 +15,19 @@ extern "C" {
 }
 
 
+void PortServiceImpl::changed(int64_t unit, int64_t port) {
+    auto match = [unit, port](const std::pair<int64_t, int64_t>& key) {
+        return key.first == unit && (port < 0 || key.second == port);
+    };
+    speed_flight_.forget_if(match);
+    link_status_flight_.forget_if(match);
+}
+
 grpc::Status PortServiceImpl::Init(grpc::ServerContext* context, const port::InitRequest* req, port::InitResponse* res) {
-    auto ret = opennsl_port_init(req->unit());
+    RPC_TIMER("Port");
+    RPC_ADMIT("Port", RPC_CLASS_NORMAL);
+    auto ret = SDK_CALL(opennsl_port_init, req->unit());
+    changed(req->unit(), -1);
     if (ret != OPENNSL_E_NONE) {
         std::ostringstream err;
         err << "opennsl_port_init() failed " << opennsl_errmsg(ret);
@@ -23,7 +37,10 @@ grpc::Status PortServiceImpl::Init(grpc::ServerContext* context, const port::Ini
 }
 
 grpc::Status PortServiceImpl::Clear(grpc::ServerContext* context, const port::ClearRequest* req, port::ClearResponse* res) {
-    auto ret = opennsl_port_clear(req->unit());
+    RPC_TIMER("Port");
+    RPC_ADMIT("Port", RPC_CLASS_NORMAL);
+    auto ret = SDK_CALL(opennsl_port_clear, req->unit());
+    changed(req->unit(), -1);
     if (ret != OPENNSL_E_NONE) {
         std::ostringstream err;
         err << "opennsl_port_clear() failed " << opennsl_errmsg(ret);
@@ -35,7 +52,11 @@ grpc::Status PortServiceImpl::Clear(grpc::ServerContext* context, const port::Cl
 opennsl_pbmp_t get_port_config(const google::protobuf::RepeatedField<google::protobuf::uint32>& pbmp) {
     opennsl_pbmp_t ret;
     int i = 0;
+    OPENNSL_PBMP_CLEAR(ret);
     for(auto b : pbmp) {
+        if (i == _SHR_PBMP_WORD_MAX) {
+            break;
+        }
         ret.pbits[i++] = b;
     }
     return ret;
@@ -49,9 +70,12 @@ void set_protobuf_port_config(google::protobuf::RepeatedField<google::protobuf::
 }
 
 grpc::Status PortServiceImpl::Probe(grpc::ServerContext* context, const port::ProbeRequest* req, port::ProbeResponse* res) {
+    RPC_TIMER("Port");
+    RPC_ADMIT("Port", RPC_CLASS_NORMAL);
     opennsl_pbmp_t okay_pbmp;
     opennsl_pbmp_t pbmp = get_port_config(req->pbmp());
-    auto ret = opennsl_port_probe(req->unit(), pbmp, &okay_pbmp);
+    auto ret = SDK_CALL(opennsl_port_probe, req->unit(), pbmp, &okay_pbmp);
+    changed(req->unit(), -1);
     if (ret != OPENNSL_E_NONE) {
         std::ostringstream err;
         err << "opennsl_port_probe() failed " << opennsl_errmsg(ret);
@@ -62,9 +86,12 @@ grpc::Status PortServiceImpl::Probe(grpc::ServerContext* context, const port::Pr
 }
 
 grpc::Status PortServiceImpl::Detach(grpc::ServerContext* context, const port::DetachRequest* req, port::DetachResponse* res) {
+    RPC_TIMER("Port");
+    RPC_ADMIT("Port", RPC_CLASS_NORMAL);
     opennsl_pbmp_t okay_pbmp;
     opennsl_pbmp_t pbmp = get_port_config(req->pbmp());
-    auto ret = opennsl_port_detach(req->unit(), pbmp, &okay_pbmp);
+    auto ret = SDK_CALL(opennsl_port_detach, req->unit(), pbmp, &okay_pbmp);
+    changed(req->unit(), -1);
     if (ret != OPENNSL_E_NONE) {
         std::ostringstream err;
         err << "opennsl_port_probe() failed " << opennsl_errmsg(ret);
@@ -75,8 +102,10 @@ grpc::Status PortServiceImpl::Detach(grpc::ServerContext* context, const port::D
 }
 
 grpc::Status PortServiceImpl::GetConfig(grpc::ServerContext* context, const port::GetConfigRequest* req, port::GetConfigResponse* res) {
+    RPC_TIMER("Port");
+    RPC_ADMIT("Port", RPC_CLASS_NORMAL);
     opennsl_port_config_t config;
-    auto ret = opennsl_port_config_get(req->unit(), &config);
+    auto ret = SDK_CALL(opennsl_port_config_get, req->unit(), &config);
     if (ret != OPENNSL_E_NONE ) {
         return grpc::Status(grpc::UNAVAILABLE, "");
     }
@@ -111,23 +140,32 @@ grpc::Status PortServiceImpl::GetConfig(grpc::ServerContext* context, const port
 };
 
 grpc::Status PortServiceImpl::GetPortName(grpc::ServerContext* context, const port::GetPortNameRequest* req, port::GetPortNameResponse* res) {
-    res->set_name(opennsl_port_name(req->unit(), req->port()));
+    RPC_TIMER("Port");
+    RPC_ADMIT("Port", RPC_CLASS_NORMAL);
+    res->set_name(SDK_CALL(opennsl_port_name, req->unit(), req->port()));
     return grpc::Status::OK;
 }
 
 grpc::Status PortServiceImpl::PortEnableSet(grpc::ServerContext* context, const port::PortEnableSetRequest* req, port::PortEnableSetResponse* res){
-    auto ret = opennsl_port_enable_set(req->unit(), req->port(), req->enable());
+    RPC_TIMER("Port");
+    RPC_ADMIT("Port", RPC_CLASS_CRITICAL);
+    auto lock = config_lock(req->unit());
+    auto ret = SDK_CALL(opennsl_port_enable_set, req->unit(), req->port(), req->enable());
+    changed(req->unit(), req->port());
     if ( ret != OPENNSL_E_NONE ) {
         std::ostringstream err;
         err << "opennsl_port_enable_set() failed " << opennsl_errmsg(ret);
         return grpc::Status(grpc::UNAVAILABLE, err.str());
     }
+    ConfigState::instance().port_set(req->unit(), req->port(), PORT_SETTING_ENABLE, req->enable());
     return grpc::Status::OK;
 }
 
 grpc::Status PortServiceImpl::PortEnableGet(grpc::ServerContext* context, const port::PortEnableGetRequest* req, port::PortEnableGetResponse* res){
+    RPC_TIMER("Port");
+    RPC_ADMIT("Port", RPC_CLASS_NORMAL);
     int enable;
-    auto ret = opennsl_port_enable_get(req->unit(), req->port(), &enable);
+    auto ret = SDK_CALL(opennsl_port_enable_get, req->unit(), req->port(), &enable);
     if ( ret != OPENNSL_E_NONE ) {
         std::ostringstream err;
         err << "opennsl_port_enable_get() failed " << opennsl_errmsg(ret);
@@ -138,7 +176,10 @@ grpc::Status PortServiceImpl::PortEnableGet(grpc::ServerContext* context, const
 }
 
 grpc::Status PortServiceImpl::PortAdvertSet(grpc::ServerContext* context, const port::PortAdvertSetRequest* req, port::PortAdvertSetResponse* res){
-    auto ret = opennsl_port_advert_set(req->unit(), req->port(), req->ability());
+    RPC_TIMER("Port");
+    RPC_ADMIT("Port", RPC_CLASS_NORMAL);
+    auto ret = SDK_CALL(opennsl_port_advert_set, req->unit(), req->port(), req->ability());
+    changed(req->unit(), req->port());
     if ( ret != OPENNSL_E_NONE ) {
         std::ostringstream err;
         err << "opennsl_port_advert_set() failed " << opennsl_errmsg(ret);
@@ -148,8 +189,10 @@ grpc::Status PortServiceImpl::PortAdvertSet(grpc::ServerContext* context, const
 }
 
 grpc::Status PortServiceImpl::PortAdvertGet(grpc::ServerContext* context, const port::PortAdvertGetRequest* req, port::PortAdvertGetResponse* res){
+    RPC_TIMER("Port");
+    RPC_ADMIT("Port", RPC_CLASS_NORMAL);
     opennsl_port_abil_t abil;
-    auto ret = opennsl_port_advert_get(req->unit(), req->port(), &abil);
+    auto ret = SDK_CALL(opennsl_port_advert_get, req->unit(), req->port(), &abil);
     if ( ret != OPENNSL_E_NONE ) {
         std::ostringstream err;
         err << "opennsl_port_advert_get() failed " << opennsl_errmsg(ret);
@@ -188,8 +231,11 @@ void set_protobuf_ability(port::Ability* dst, const opennsl_port_ability_t& src)
 }
 
 grpc::Status PortServiceImpl::PortAbilityAdvertSet(grpc::ServerContext* context, const port::PortAbilityAdvertSetRequest* req, port::PortAbilityAdvertSetResponse* res){
+    RPC_TIMER("Port");
+    RPC_ADMIT("Port", RPC_CLASS_NORMAL);
     auto ability = get_ability(req->ability());
-    auto ret = opennsl_port_ability_advert_set(req->unit(), req->port(), &ability);
+    auto ret = SDK_CALL(opennsl_port_ability_advert_set, req->unit(), req->port(), &ability);
+    changed(req->unit(), req->port());
     if ( ret != OPENNSL_E_NONE ) {
         std::ostringstream err;
         err << "opennsl_port_ability_advert_set() failed " << opennsl_errmsg(ret);
@@ -199,8 +245,10 @@ grpc::Status PortServiceImpl::PortAbilityAdvertSet(grpc::ServerContext* context,
 }
 
 grpc::Status PortServiceImpl::PortAbilityAdvertGet(grpc::ServerContext* context, const port::PortAbilityAdvertGetRequest* req, port::PortAbilityAdvertGetResponse* res){
+    RPC_TIMER("Port");
+    RPC_ADMIT("Port", RPC_CLASS_NORMAL);
     opennsl_port_ability_t ability;
-    auto ret = opennsl_port_ability_advert_get(req->unit(), req->port(), &ability);
+    auto ret = SDK_CALL(opennsl_port_ability_advert_get, req->unit(), req->port(), &ability);
     if ( ret != OPENNSL_E_NONE ) {
         std::ostringstream err;
         err << "opennsl_port_ability_advert_get() failed " << opennsl_errmsg(ret);
@@ -212,8 +260,10 @@ grpc::Status PortServiceImpl::PortAbilityAdvertGet(grpc::ServerContext* context,
 
 
 grpc::Status PortServiceImpl::PortAdvertRemoteGet(grpc::ServerContext* context, const port::PortAdvertRemoteGetRequest* req, port::PortAdvertRemoteGetResponse* res){
+    RPC_TIMER("Port");
+    RPC_ADMIT("Port", RPC_CLASS_NORMAL);
     opennsl_port_abil_t ability;
-    auto ret = opennsl_port_advert_remote_get(req->unit(), req->port(), &ability);
+    auto ret = SDK_CALL(opennsl_port_advert_remote_get, req->unit(), req->port(), &ability);
     if ( ret != OPENNSL_E_NONE) {
         std::ostringstream err;
         err << "opennsl_port_advert_remote_get() failed " << opennsl_errmsg(ret);
@@ -224,8 +274,10 @@ grpc::Status PortServiceImpl::PortAdvertRemoteGet(grpc::ServerContext* context,
 }
 
 grpc::Status PortServiceImpl::PortAbilityRemoteGet(grpc::ServerContext* context, const port::PortAbilityRemoteGetRequest* req, port::PortAbilityRemoteGetResponse* res){
+    RPC_TIMER("Port");
+    RPC_ADMIT("Port", RPC_CLASS_NORMAL);
     opennsl_port_ability_t ability;
-    auto ret = opennsl_port_ability_remote_get(req->unit(), req->port(), &ability);
+    auto ret = SDK_CALL(opennsl_port_ability_remote_get, req->unit(), req->port(), &ability);
     if ( ret != OPENNSL_E_NONE ) {
         std::ostringstream err;
         err << "opennsl_port_ability_remote_get() failed " << opennsl_errmsg(ret);
@@ -236,8 +288,10 @@ grpc::Status PortServiceImpl::PortAbilityRemoteGet(grpc::ServerContext* context,
 }
 
 grpc::Status PortServiceImpl::PortAbilityGet(grpc::ServerContext* context, const port::PortAbilityGetRequest* req, port::PortAbilityGetResponse* res){
+    RPC_TIMER("Port");
+    RPC_ADMIT("Port", RPC_CLASS_NORMAL);
     opennsl_port_abil_t ability;
-    auto ret = opennsl_port_ability_get(req->unit(), req->port(), &ability);
+    auto ret = SDK_CALL(opennsl_port_ability_get, req->unit(), req->port(), &ability);
     if ( ret != OPENNSL_E_NONE) {
         std::ostringstream err;
         err << "opennsl_port_ability_get() failed " << opennsl_errmsg(ret);
@@ -248,8 +302,10 @@ grpc::Status PortServiceImpl::PortAbilityGet(grpc::ServerContext* context, const
 }
 
 grpc::Status PortServiceImpl::PortAbilityLocalGet(grpc::ServerContext* context, const port::PortAbilityLocalGetRequest* req, port::PortAbilityLocalGetResponse* res){
+    RPC_TIMER("Port");
+    RPC_ADMIT("Port", RPC_CLASS_NORMAL);
     opennsl_port_ability_t ability;
-    auto ret = opennsl_port_ability_local_get(req->unit(), req->port(), &ability);
+    auto ret = SDK_CALL(opennsl_port_ability_local_get, req->unit(), req->port(), &ability);
     if ( ret != OPENNSL_E_NONE ) {
         std::ostringstream err;
         err << "opennsl_port_ability_local_get() failed " << opennsl_errmsg(ret);
@@ -260,7 +316,10 @@ grpc::Status PortServiceImpl::PortAbilityLocalGet(grpc::ServerContext* context,
 }
 
 grpc::Status PortServiceImpl::PortLinkscanSet(grpc::ServerContext* context, const port::PortLinkscanSetRequest* req, port::PortLinkscanSetResponse* res){
-    auto ret = opennsl_port_linkscan_set(req->unit(), req->port(), req->linkscan());
+    RPC_TIMER("Port");
+    RPC_ADMIT("Port", RPC_CLASS_NORMAL);
+    auto ret = SDK_CALL(opennsl_port_linkscan_set, req->unit(), req->port(), req->linkscan());
+    changed(req->unit(), req->port());
     if ( ret != OPENNSL_E_NONE ) {
         std::ostringstream err;
         err << "opennsl_port_linkscan_set() failed " << opennsl_errmsg(ret);
@@ -270,8 +329,10 @@ grpc::Status PortServiceImpl::PortLinkscanSet(grpc::ServerContext* context, cons
 }
 
 grpc::Status PortServiceImpl::PortLinkscanGet(grpc::ServerContext* context, const port::PortLinkscanGetRequest* req, port::PortLinkscanGetResponse* res){
+    RPC_TIMER("Port");
+    RPC_ADMIT("Port", RPC_CLASS_NORMAL);
     int linkscan;
-    auto ret = opennsl_port_linkscan_get(req->unit(), req->port(), &linkscan);
+    auto ret = SDK_CALL(opennsl_port_linkscan_get, req->unit(), req->port(), &linkscan);
     if ( ret != OPENNSL_E_NONE ) {
         std::ostringstream err;
         err << "opennsl_port_linkscan_set() failed " << opennsl_errmsg(ret);
@@ -282,18 +343,25 @@ grpc::Status PortServiceImpl::PortLinkscanGet(grpc::ServerContext* context, cons
 }
 
 grpc::Status PortServiceImpl::PortAutonegSet(grpc::ServerContext* context, const port::PortAutonegSetRequest* req, port::PortAutonegSetResponse* res){
-    auto ret = opennsl_port_autoneg_set(req->unit(), req->port(), req->enable());
+    RPC_TIMER("Port");
+    RPC_ADMIT("Port", RPC_CLASS_NORMAL);
+    auto lock = config_lock(req->unit());
+    auto ret = SDK_CALL(opennsl_port_autoneg_set, req->unit(), req->port(), req->enable());
+    changed(req->unit(), req->port());
     if ( ret != OPENNSL_E_NONE ) {
         std::ostringstream err;
         err << "opennsl_port_autoneg_set() failed " << opennsl_errmsg(ret);
         return grpc::Status(grpc::UNAVAILABLE, err.str());
     }
+    ConfigState::instance().port_set(req->unit(), req->port(), PORT_SETTING_AUTONEG, req->enable());
     return grpc::Status::OK;
 }
 
 grpc::Status PortServiceImpl::PortAutonegGet(grpc::ServerContext* context, const port::PortAutonegGetRequest* req, port::PortAutonegGetResponse* res){
+    RPC_TIMER("Port");
+    RPC_ADMIT("Port", RPC_CLASS_NORMAL);
     int enabled;
-    auto ret = opennsl_port_autoneg_get(req->unit(), req->port(), &enabled);
+    auto ret = SDK_CALL(opennsl_port_autoneg_get, req->unit(), req->port(), &enabled);
     if ( ret != OPENNSL_E_NONE ) {
         std::ostringstream err;
         err << "opennsl_port_autoneg_get() failed " << opennsl_errmsg(ret);
@@ -304,8 +372,10 @@ grpc::Status PortServiceImpl::PortAutonegGet(grpc::ServerContext* context, const
 }
 
 grpc::Status PortServiceImpl::PortSpeedMAX(grpc::ServerContext* context, const port::PortSpeedMAXRequest* req, port::PortSpeedMAXResponse* res){
+    RPC_TIMER("Port");
+    RPC_ADMIT("Port", RPC_CLASS_NORMAL);
     int speed;
-    auto ret = opennsl_port_speed_max(req->unit(), req->port(), &speed);
+    auto ret = SDK_CALL(opennsl_port_speed_max, req->unit(), req->port(), &speed);
     if ( ret != OPENNSL_E_NONE ) {
         std::ostringstream err;
         err << "opennsl_port_speed_max() failed " << opennsl_errmsg(ret);
@@ -316,29 +386,43 @@ grpc::Status PortServiceImpl::PortSpeedMAX(grpc::ServerContext* context, const p
 }
 
 grpc::Status PortServiceImpl::PortSpeedSet(grpc::ServerContext* context, const port::PortSpeedSetRequest* req, port::PortSpeedSetResponse* res){
-    auto ret = opennsl_port_speed_set(req->unit(), req->port(), req->speed());
+    RPC_TIMER("Port");
+    RPC_ADMIT("Port", RPC_CLASS_NORMAL);
+    auto lock = config_lock(req->unit());
+    auto ret = SDK_CALL(opennsl_port_speed_set, req->unit(), req->port(), req->speed());
+    changed(req->unit(), req->port());
     if ( ret != OPENNSL_E_NONE ) {
         std::ostringstream err;
         err << "opennsl_port_speed_set() failed " << opennsl_errmsg(ret);
         return grpc::Status(grpc::UNAVAILABLE, err.str());
     }
+    ConfigState::instance().port_set(req->unit(), req->port(), PORT_SETTING_SPEED, req->speed());
     return grpc::Status::OK;
 }
 
 grpc::Status PortServiceImpl::PortSpeedGet(grpc::ServerContext* context, const port::PortSpeedGetRequest* req, port::PortSpeedGetResponse* res){
-    int speed;
-    auto ret = opennsl_port_speed_get(req->unit(), req->port(), &speed);
+    RPC_TIMER("Port");
+    RPC_ADMIT("Port", RPC_CLASS_NORMAL);
+    auto r = speed_flight_.run(std::make_pair(req->unit(), req->port()), [&]() {
+        int speed = 0;
+        auto ret = SDK_CALL(opennsl_port_speed_get, req->unit(), req->port(), &speed);
+        return std::make_pair(ret, speed);
+    });
+    auto ret = r.first;
     if ( ret != OPENNSL_E_NONE ) {
         std::ostringstream err;
         err << "opennsl_port_speed_get() failed " << opennsl_errmsg(ret);
         return grpc::Status(grpc::UNAVAILABLE, err.str());
     }
-    res->set_speed(speed);
+    res->set_speed(r.second);
     return grpc::Status::OK;
 }
 
 grpc::Status PortServiceImpl::PortInterfaceSet(grpc::ServerContext* context, const port::PortInterfaceSetRequest* req, port::PortInterfaceSetResponse* res){
-    auto ret = opennsl_port_interface_set(req->unit(), req->port(), static_cast<opennsl_port_if_t>(req->type()));
+    RPC_TIMER("Port");
+    RPC_ADMIT("Port", RPC_CLASS_NORMAL);
+    auto ret = SDK_CALL(opennsl_port_interface_set, req->unit(), req->port(), static_cast<opennsl_port_if_t>(req->type()));
+    changed(req->unit(), req->port());
     if ( ret != OPENNSL_E_NONE ) {
         std::ostringstream err;
         err << "opennsl_port_interface_set() failed " << opennsl_errmsg(ret);
@@ -348,8 +432,10 @@ grpc::Status PortServiceImpl::PortInterfaceSet(grpc::ServerContext* context, con
 }
 
 grpc::Status PortServiceImpl::PortInterfaceGet(grpc::ServerContext* context, const port::PortInterfaceGetRequest* req, port::PortInterfaceGetResponse* res){
+    RPC_TIMER("Port");
+    RPC_ADMIT("Port", RPC_CLASS_NORMAL);
     opennsl_port_if_t type;
-    auto ret = opennsl_port_interface_get(req->unit(), req->port(), &type);
+    auto ret = SDK_CALL(opennsl_port_interface_get, req->unit(), req->port(), &type);
     if ( ret != OPENNSL_E_NONE ) {
         std::ostringstream err;
         err << "opennsl_port_interface_get() failed " << opennsl_errmsg(ret);
@@ -360,21 +446,30 @@ grpc::Status PortServiceImpl::PortInterfaceGet(grpc::ServerContext* context, con
 }
 
 grpc::Status PortServiceImpl::PortLinkStatusGet(::grpc::ServerContext* context, const ::port::PortLinkStatusGetRequest* req, ::port::PortLinkStatusGetResponse* res){
-    int status;
-    auto ret = opennsl_port_link_status_get(req->unit(), req->port(), &status);
+    RPC_TIMER("Port");
+    RPC_ADMIT("Port", RPC_CLASS_NORMAL);
+    auto r = link_status_flight_.run(std::make_pair(req->unit(), req->port()), [&]() {
+        int status = 0;
+        auto ret = SDK_CALL(opennsl_port_link_status_get, req->unit(), req->port(), &status);
+        return std::make_pair(ret, status);
+    });
+    auto ret = r.first;
     if ( ret != OPENNSL_E_NONE ) {
         std::ostringstream err;
         err << "opennsl_port_link_status_get() failed " << opennsl_errmsg(ret);
         return grpc::Status(grpc::UNAVAILABLE, err.str());
     }
-    if ( status > 0 ) {
+    if ( r.second > 0 ) {
         res->set_up(true);
     }
     return grpc::Status::OK;
 }
 
 grpc::Status PortServiceImpl::PortLinkFailedClear(::grpc::ServerContext* context, const ::port::PortLinkFailedClearRequest* req, ::port::PortLinkFailedClearResponse* res){
-    auto ret = opennsl_port_link_failed_clear(req->unit(), req->port());
+    RPC_TIMER("Port");
+    RPC_ADMIT("Port", RPC_CLASS_NORMAL);
+    auto ret = SDK_CALL(opennsl_port_link_failed_clear, req->unit(), req->port());
+    changed(req->unit(), req->port());
     if ( ret != OPENNSL_E_NONE ) {
         std::ostringstream err;
         err << "opennsl_port_link_failed_clear() failed " << opennsl_errmsg(ret);
@@ -384,7 +479,10 @@ grpc::Status PortServiceImpl::PortLinkFailedClear(::grpc::ServerContext* context
 }
 
 grpc::Status PortServiceImpl::PortControlSet(::grpc::ServerContext* context, const ::port::PortControlSetRequest* req, ::port::PortControlSetResponse* res){
-    auto ret = opennsl_port_control_set(req->unit(), req->port(), static_cast<opennsl_port_control_t>(req->type()), req->value());
+    RPC_TIMER("Port");
+    RPC_ADMIT("Port", RPC_CLASS_NORMAL);
+    auto ret = SDK_CALL(opennsl_port_control_set, req->unit(), req->port(), static_cast<opennsl_port_control_t>(req->type()), req->value());
+    changed(req->unit(), req->port());
     if ( ret != OPENNSL_E_NONE ) {
         std::ostringstream err;
         err << "opennsl_port_control_set() failed " << opennsl_errmsg(ret);
@@ -394,8 +492,10 @@ grpc::Status PortServiceImpl::PortControlSet(::grpc::ServerContext* context, con
 }
 
 grpc::Status PortServiceImpl::PortControlGet(::grpc::ServerContext* context, const ::port::PortControlGetRequest* req, ::port::PortControlGetResponse* res){
+    RPC_TIMER("Port");
+    RPC_ADMIT("Port", RPC_CLASS_NORMAL);
     int value;
-    auto ret = opennsl_port_control_get(req->unit(), req->port(), static_cast<opennsl_port_control_t>(req->type()), &value);
+    auto ret = SDK_CALL(opennsl_port_control_get, req->unit(), req->port(), static_cast<opennsl_port_control_t>(req->type()), &value);
     if ( ret != OPENNSL_E_NONE ) {
         std::ostringstream err;
         err << "opennsl_port_control_get() failed " << opennsl_errmsg(ret);
@@ -406,8 +506,10 @@ grpc::Status PortServiceImpl::PortControlGet(::grpc::ServerContext* context, con
 }
 
 grpc::Status PortServiceImpl::PortGportGet(::grpc::ServerContext* context, const ::port::PortGportGetRequest* req, ::port::PortGportGetResponse* res){
+    RPC_TIMER("Port");
+    RPC_ADMIT("Port", RPC_CLASS_NORMAL);
     opennsl_gport_t gport;
-    auto ret = opennsl_port_gport_get(req->unit(), req->port(), &gport);
+    auto ret = SDK_CALL(opennsl_port_gport_get, req->unit(), req->port(), &gport);
     if ( ret != OPENNSL_E_NONE ) {
         std::ostringstream err;
         err << "opennsl_port_gport_get() failed " << opennsl_errmsg(ret);
@@ -418,8 +520,10 @@ grpc::Status PortServiceImpl::PortGportGet(::grpc::ServerContext* context, const
 }
 
 grpc::Status PortServiceImpl::PortLocalGet(::grpc::ServerContext* context, const ::port::PortLocalGetRequest* req, ::port::PortLocalGetResponse* res){
+    RPC_TIMER("Port");
+    RPC_ADMIT("Port", RPC_CLASS_NORMAL);
     opennsl_port_t port;
-    auto ret = opennsl_port_local_get(req->unit(), req->gport(), &port);
+    auto ret = SDK_CALL(opennsl_port_local_get, req->unit(), req->gport(), &port);
     if ( ret != OPENNSL_E_NONE ) {
         std::ostringstream err;
         err << "opennsl_port_local_get() failed " << opennsl_errmsg(ret);
@@ -1,6 +1,9 @@
+#include <utility>
+
 #include <grpc++/server.h>
 
 #include "portservice.grpc.pb.h"
+#include "singleflight.h"
 
 extern "C" {
 #include "opennsl/port.h"
@@ -44,5 +47,12 @@ class PortServiceImpl final : public portservice::Port::Service {
         grpc::Status PortControlGet(::grpc::ServerContext* context, const ::port::PortControlGetRequest* req, ::port::PortControlGetResponse* res);
         grpc::Status PortGportGet(::grpc::ServerContext* context, const ::port::PortGportGetRequest* req, ::port::PortGportGetResponse* res);
         grpc::Status PortLocalGet(::grpc::ServerContext* context, const ::port::PortLocalGetRequest* req, ::port::PortLocalGetResponse* res);
-         
+        // changed tells that port was written, so that the reads issued
+        // from now on go to the SDK. A port of -1 stands for every port.
+        void changed(int64_t unit, int64_t port);
+    private:
+        // concurrent reads of the same (unit, port) share one SDK call;
+        // results are (return code, value)
+        SingleFlight<std::pair<int64_t, int64_t>, std::pair<int, int> > speed_flight_;
+        SingleFlight<std::pair<int64_t, int64_t>, std::pair<int, int> > link_status_flight_;
 };
@@ -1,3 +1,6 @@
+#ifndef QUEUE_H
+#define QUEUE_H
+
 #include <queue>
 #include <thread>
 #include <mutex>
@@ -41,3 +44,5 @@ private:
     std::mutex mutex_;
     std::condition_variable cond_;
 };
+
+#endif // QUEUE_H
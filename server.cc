@@ -1,4 +1,11 @@
+#include <signal.h>
+
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
 #include <string>
+#include <thread>
+#include <vector>
 
 #include <grpc/grpc.h>
 #include <grpc++/server.h>
@@ -14,6 +21,14 @@
 #include "link.h"
 #include "vlan.h"
 #include "l2.h"
+#include "metrics.h"
+#include "admission.h"
+#include "counters.h"
+#include "exporter.h"
+#include "counter_table.h"
+#include "options.h"
+#include "state_snapshot.h"
+#include "desired.h"
 
 extern "C" {
 #include "sal/driver.h"
@@ -31,39 +46,120 @@ using grpc::Status;
 
 class DriverServiceImpl final : public driverservice::Driver::Service {
     public:
+        DriverServiceImpl(CounterPoller* poller, StateSnapshot* state) : poller_(poller), state_(state) {}
         Status Init(ServerContext* context, const driver::InitRequest* req, driver::InitResponse* res) {
+            RPC_TIMER("Driver");
+            RPC_ADMIT("Driver", RPC_CLASS_NORMAL);
             int rv = 0;
-            rv = opennsl_driver_init((opennsl_init_t *) NULL);
+            rv = SDK_CALL(opennsl_driver_init, (opennsl_init_t *) NULL);
             if(rv == OPENNSL_E_NONE){
+                // counters can only be polled once the SDK is up
+                if ( poller_ != NULL ) {
+                    poller_->start();
+                }
+                if ( state_ != NULL ) {
+                    std::vector<std::string> diverged;
+                    res->set_warm_restart(state_->reconcile(&diverged));
+                    for ( auto& d : diverged ) {
+                        res->add_diverged(d);
+                    }
+                }
                 return Status::OK;
             }
             return Status(grpc::UNAVAILABLE, "");
         }
         Status GetVersion(ServerContext* context, const driver::GetVersionRequest* req, driver::GetVersionResponse* res) {
-            res->set_version(opennsl_version_get());
+            RPC_TIMER("Driver");
+            RPC_ADMIT("Driver", RPC_CLASS_NORMAL);
+            res->set_version(SDK_CALL(opennsl_version_get));
             return Status::OK;
         }
+    private:
+        CounterPoller* poller_;
+        StateSnapshot* state_;
 };
 
 int main(int argc, char** argv) {
-    std::string server_address("0.0.0.0:50051");
-    DriverServiceImpl driverservice;
+    server_options opts;
+    if ( !parse_options(argc, argv, &opts) ) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    UnitWorkers::instance().set_enabled(opts.unit_workers != 0);
+    Admission::instance().configure(opts.max_active_rpcs, opts.max_bulk_rpcs);
+    for ( auto& c : opts.rpc_classes ) {
+        Admission::instance().set_method_class(c.first, c.second);
+    }
+    Admission::instance().set_priority_peers(opts.priority_peers);
+
+    // SIGUSR1 dumps the latency histograms; block it before any thread is
+    // started so that only the dump thread receives it
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGUSR1);
+    pthread_sigmask(SIG_BLOCK, &set, NULL);
+    std::thread(telemetry::dump_on_signal, SIGUSR1).detach();
+    // a peer closing a socket we write to must not take the server down
+    signal(SIGPIPE, SIG_IGN);
+
+    CounterPoller poller(opts.units, opts.stat_interval);
+    bool poll = false;
+    std::unique_ptr<MetricsExporter> exporter;
+    if ( !opts.metrics_address.empty() ) {
+        exporter.reset(new MetricsExporter(opts.metrics_address));
+        if ( !exporter->start() ) {
+            return 1;
+        }
+        auto e = exporter.get();
+        poller.add_listener([e](const counter_snapshot& snap) { e->render(snap); });
+        poll = true;
+    }
+    std::unique_ptr<SharedCounterTable> table;
+    if ( !opts.counters_shm.empty() ) {
+        table.reset(new SharedCounterTable(opts.counters_shm, opts.units.size() * _SHR_PBMP_WORD_MAX * _SHR_PBMP_WORD_WIDTH));
+        if ( !table->open() ) {
+            return 1;
+        }
+        auto t = table.get();
+        poller.add_listener([t](const counter_snapshot& snap) { t->publish(snap); });
+        poll = true;
+    }
+
+    VLANServiceImpl vlanservice;
+    std::unique_ptr<StateSnapshot> state;
+    if ( !opts.state_file.empty() ) {
+        state.reset(new StateSnapshot(opts.state_file, opts.state_interval, vlanservice.table()));
+        state->load();
+    }
+    DriverServiceImpl driverservice(poll ? &poller : NULL, state.get());
     PortServiceImpl portservice;
     StatServiceImpl statservice;
     LinkServiceImpl linkservice;
-    VLANServiceImpl vlanservice;
     L2ServiceImpl l2service;
+    MetricsServiceImpl metricsservice;
+    DesiredStateServiceImpl desiredservice(vlanservice.table(), &portservice);
 
     ServerBuilder builder;
-    builder.AddListeningPort(server_address, grpc::InsecureServerCredentials());
+    if ( !configure_builder(opts, &builder) ) {
+        return 1;
+    }
     builder.RegisterService(&driverservice);
     builder.RegisterService(&portservice);
     builder.RegisterService(&statservice);
     builder.RegisterService(&linkservice);
     builder.RegisterService(&vlanservice);
     builder.RegisterService(&l2service);
+    builder.RegisterService(&metricsservice);
+    builder.RegisterService(&desiredservice);
     std::unique_ptr<Server> server(builder.BuildAndStart());
-    std::cout << "Server listening on " << server_address << std::endl;
+    if ( !server ) {
+        std::cerr << "failed to start server" << std::endl;
+        return 1;
+    }
+    for ( auto& address : opts.listen ) {
+        std::cout << "Server listening on " << address << std::endl;
+    }
     server->Wait();
 
     return 0;
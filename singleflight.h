@@ -0,0 +1,74 @@
+#ifndef SINGLEFLIGHT_H
+#define SINGLEFLIGHT_H
+
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+
+// SingleFlight collapses concurrent identical reads. The first caller of run
+// for a key becomes the leader and calls f; callers with the same key that
+// arrive before f returns wait for it and share its result instead of
+// calling f themselves. Results are not kept once the leader returns.
+//
+// A write that changes what f reads must forget the keys it touched once it
+// is done, so that reads issued after it don't join a flight that started
+// before it.
+template <typename K, typename V>
+class SingleFlight {
+    public:
+        template <typename F>
+        V run(const K& key, F f) {
+            std::shared_ptr<flight> c;
+            {
+                std::unique_lock<std::mutex> mlock(mutex_);
+                auto it = flights_.find(key);
+                if ( it != flights_.end() ) {
+                    c = it->second;
+                    while ( !c->done ) {
+                        c->cond.wait(mlock);
+                    }
+                    return c->value;
+                }
+                c = std::make_shared<flight>();
+                flights_[key] = c;
+            }
+            V value = f();
+            {
+                std::unique_lock<std::mutex> mlock(mutex_);
+                c->value = value;
+                c->done = true;
+                auto it = flights_.find(key);
+                if ( it != flights_.end() && it->second == c ) {
+                    flights_.erase(it);
+                }
+            }
+            c->cond.notify_all();
+            return value;
+        }
+        // forget_if makes callers of run from now on start a new flight for
+        // every key pred holds for. Callers already waiting get the result
+        // of the old one.
+        template <typename P>
+        void forget_if(P pred) {
+            std::unique_lock<std::mutex> mlock(mutex_);
+            for ( auto it = flights_.begin(); it != flights_.end(); ) {
+                if ( pred(it->first) ) {
+                    it = flights_.erase(it);
+                } else {
+                    it++;
+                }
+            }
+        }
+    private:
+        struct flight {
+            flight() : done(false) {}
+            bool done;
+            V value;
+            std::condition_variable cond;
+        };
+        std::mutex mutex_;
+        std::map<K, std::shared_ptr<flight> > flights_;
+};
+
+#endif // SINGLEFLIGHT_H
@@ -2,6 +2,8 @@
 
 #include "statservice.grpc.pb.h"
 #include "stat.h"
+#include "metrics.h"
+#include "admission.h"
 
 extern "C" {
 #include "opennsl/error.h"
@@ -9,7 +11,13 @@ extern "C" {
 }
 
 grpc::Status StatServiceImpl::Init(grpc::ServerContext* context, const stat::InitRequest* req, stat::InitResponse* res) {
-    auto ret = opennsl_stat_init(req->unit());
+    RPC_TIMER("Stat");
+    RPC_ADMIT("Stat", RPC_CLASS_NORMAL);
+    auto ret = SDK_CALL(opennsl_stat_init, req->unit());
+    auto unit = req->unit();
+    get_flight_.forget_if([unit](const std::tuple<int64_t, int64_t, int>& key) {
+        return std::get<0>(key) == unit;
+    });
     if (ret != OPENNSL_E_NONE) {
         return grpc::Status(grpc::UNAVAILABLE, "opennsl_stat_init() failed");
     }
@@ -17,7 +25,16 @@ grpc::Status StatServiceImpl::Init(grpc::ServerContext* context, const stat::Ini
 }
 
 grpc::Status StatServiceImpl::Clear(grpc::ServerContext* context, const stat::ClearRequest* req, stat::ClearResponse* res) {
-    auto ret = opennsl_stat_clear(req->unit(), req->port());
+    RPC_TIMER("Stat");
+    RPC_ADMIT("Stat", RPC_CLASS_NORMAL);
+    auto ret = SDK_CALL(opennsl_stat_clear, req->unit(), req->port());
+    // reads of the port that started before the clear must not be served
+    // to callers after it
+    auto unit = req->unit();
+    auto port = req->port();
+    get_flight_.forget_if([unit, port](const std::tuple<int64_t, int64_t, int>& key) {
+        return std::get<0>(key) == unit && std::get<1>(key) == port;
+    });
     if (ret != OPENNSL_E_NONE) {
         return grpc::Status(grpc::UNAVAILABLE, "opennsl_stat_clear() failed");
     }
@@ -25,7 +42,9 @@ grpc::Status StatServiceImpl::Clear(grpc::ServerContext* context, const stat::Cl
 }
 
 grpc::Status StatServiceImpl::Sync(grpc::ServerContext* context, const stat::SyncRequest* req, stat::SyncResponse* res) {
-    auto ret = opennsl_stat_sync(req->unit());
+    RPC_TIMER("Stat");
+    RPC_ADMIT("Stat", RPC_CLASS_NORMAL);
+    auto ret = SDK_CALL(opennsl_stat_sync, req->unit());
     if (ret != OPENNSL_E_NONE) {
         return grpc::Status(grpc::UNAVAILABLE, "opennsl_stat_sync() failed");
     }
@@ -33,12 +52,17 @@ grpc::Status StatServiceImpl::Sync(grpc::ServerContext* context, const stat::Syn
 }
 
 grpc::Status StatServiceImpl::Get(grpc::ServerContext* context, const stat::GetRequest* req, stat::GetResponse* res) {
-    uint64 value;
-    auto ret = opennsl_stat_get(req->unit(), req->port(), opennsl_stat_val_t(req->type()), &value);
-    if (ret != OPENNSL_E_NONE) {
+    RPC_TIMER("Stat");
+    RPC_ADMIT("Stat", RPC_CLASS_NORMAL);
+    auto r = get_flight_.run(std::make_tuple(req->unit(), req->port(), int(req->type())), [&]() {
+        uint64 value = 0;
+        auto ret = SDK_CALL(opennsl_stat_get, req->unit(), req->port(), opennsl_stat_val_t(req->type()), &value);
+        return std::make_pair(ret, value);
+    });
+    if (r.first != OPENNSL_E_NONE) {
         return grpc::Status(grpc::UNAVAILABLE, "opennsl_stat_get() failed");
     }
-    res->set_value(value);
+    res->set_value(r.second);
     return grpc::Status::OK;
 }
 
@@ -1,6 +1,14 @@
+#include <tuple>
+#include <utility>
+
 #include <grpc++/server.h>
 
 #include "statservice.grpc.pb.h"
+#include "singleflight.h"
+
+extern "C" {
+#include "opennsl/types.h"
+}
 
 class StatServiceImpl final : public statservice::Stat::Service {
     public:
@@ -9,4 +17,8 @@ class StatServiceImpl final : public statservice::Stat::Service {
         grpc::Status Sync(grpc::ServerContext* context, const stat::SyncRequest* req, stat::SyncResponse* res);
         grpc::Status Get(grpc::ServerContext* context, const stat::GetRequest* req, stat::GetResponse* res);
 //        grpc::Status MultiGet(grpc::ServerContext* context, const stat::MultiGetRequest* req, stat::MultiGetResponse* res);
+    private:
+        // concurrent reads of the same (unit, port, type) share one SDK
+        // call; results are (return code, value)
+        SingleFlight<std::tuple<int64_t, int64_t, int>, std::pair<int, uint64> > get_flight_;
 };
@@ -0,0 +1,382 @@
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <sstream>
+
+#include "state_snapshot.h"
+#include "metrics.h"
+
+extern "C" {
+#include "opennsl/error.h"
+#include "opennsl/l2.h"
+#include "opennsl/port.h"
+}
+
+// The snapshot file starts with a state_header, followed by num_vlans
+// state_vlan records at vlans_offset, num_l2 state_l2 records at l2_offset
+// and num_ports state_port records at ports_offset. All integers are native
+// endian; the file is only read back by the server that wrote it.
+const uint64_t STATE_MAGIC = 0x544154534c534e4fULL; // "ONSLSTAT"
+const uint32_t STATE_LAYOUT_VERSION = 3;
+
+struct state_header {
+    uint64_t magic;
+    uint32_t layout_version;
+    uint32_t header_size;
+    uint32_t pbmp_words;
+    uint32_t num_vlans;
+    uint32_t num_l2;
+    uint32_t num_ports;
+    uint32_t vlans_offset;
+    uint32_t l2_offset;
+    uint32_t ports_offset;
+    uint32_t reserved;
+    uint64_t vlan_version;
+    int64_t timestamp;
+};
+
+struct state_vlan {
+    int32_t unit;
+    uint32_t vid;
+    uint64_t version;
+    uint32_t pbmp[_SHR_PBMP_WORD_MAX];
+    uint32_t ut_pbmp[_SHR_PBMP_WORD_MAX];
+};
+
+struct state_l2 {
+    int32_t unit;
+    uint16_t vid;
+    uint8_t mac[6];
+    uint32_t flags;
+    int32_t port;
+    int32_t modid;
+    int32_t tgid;
+};
+
+struct state_port {
+    int32_t unit;
+    int32_t port;
+    uint32_t mask;
+    int32_t enable;
+    int32_t speed;
+    int32_t autoneg;
+};
+
+bool StateSnapshot::load() {
+    int fd = ::open(path_.c_str(), O_RDONLY | O_CLOEXEC);
+    if ( fd < 0 ) {
+        if ( errno != ENOENT ) {
+            std::cerr << "cannot open " << path_ << ": " << std::strerror(errno) << std::endl;
+        }
+        return false;
+    }
+    struct stat st;
+    if ( fstat(fd, &st) < 0 || size_t(st.st_size) < sizeof(state_header) ) {
+        close(fd);
+        std::cerr << "ignoring truncated state file " << path_ << std::endl;
+        return false;
+    }
+    size_t size = st.st_size;
+    auto p = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if ( p == MAP_FAILED ) {
+        std::cerr << "cannot map " << path_ << ": " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    auto base = static_cast<const char*>(p);
+    auto h = static_cast<const state_header*>(p);
+    if ( h->magic != STATE_MAGIC || h->layout_version != STATE_LAYOUT_VERSION || h->header_size != sizeof(state_header) ||
+            h->pbmp_words != _SHR_PBMP_WORD_MAX ||
+            h->vlans_offset + uint64_t(h->num_vlans) * sizeof(state_vlan) > size ||
+            h->l2_offset + uint64_t(h->num_l2) * sizeof(state_l2) > size ||
+            h->ports_offset + uint64_t(h->num_ports) * sizeof(state_port) > size ) {
+        munmap(p, size);
+        std::cerr << "ignoring incompatible state file " << path_ << std::endl;
+        return false;
+    }
+
+    std::map<int, std::vector<vlan_entry> > vlans;
+    auto v = reinterpret_cast<const state_vlan*>(base + h->vlans_offset);
+    for ( uint32_t i = 0; i < h->num_vlans; i++ ) {
+        vlan_entry e;
+        e.vid = v[i].vid;
+        OPENNSL_PBMP_CLEAR(e.pbmp);
+        OPENNSL_PBMP_CLEAR(e.ut_pbmp);
+        for ( int w = 0; w < _SHR_PBMP_WORD_MAX; w++ ) {
+            e.pbmp.pbits[w] = v[i].pbmp[w];
+            e.ut_pbmp.pbits[w] = v[i].ut_pbmp[w];
+        }
+        e.version = v[i].version;
+        e.exists = true;
+        vlans[v[i].unit].push_back(e);
+        units_.insert(v[i].unit);
+    }
+    for ( auto& u : vlans ) {
+        vlans_->restore(u.first, u.second, h->vlan_version);
+    }
+
+    std::vector<l2_static> l2;
+    auto a = reinterpret_cast<const state_l2*>(base + h->l2_offset);
+    for ( uint32_t i = 0; i < h->num_l2; i++ ) {
+        l2_static e;
+        e.unit = a[i].unit;
+        std::memcpy(e.mac, a[i].mac, 6);
+        e.vid = a[i].vid;
+        e.flags = a[i].flags;
+        e.port = a[i].port;
+        e.modid = a[i].modid;
+        e.tgid = a[i].tgid;
+        l2.push_back(e);
+        units_.insert(e.unit);
+    }
+    std::vector<port_settings> ports;
+    auto s = reinterpret_cast<const state_port*>(base + h->ports_offset);
+    for ( uint32_t i = 0; i < h->num_ports; i++ ) {
+        port_settings ps;
+        ps.unit = s[i].unit;
+        ps.port = s[i].port;
+        ps.mask = s[i].mask;
+        ps.enable = s[i].enable;
+        ps.speed = s[i].speed;
+        ps.autoneg = s[i].autoneg;
+        ports.push_back(ps);
+        units_.insert(ps.unit);
+    }
+    ConfigState::instance().restore(l2, ports);
+
+    std::cout << "restored " << h->num_vlans << " VLANs, " << h->num_l2 << " static L2 entries and "
+        << h->num_ports << " port settings from " << path_ << std::endl;
+    munmap(p, size);
+    loaded_ = true;
+    return true;
+}
+
+bool StateSnapshot::save() {
+    std::vector<std::pair<int, vlan_entry> > vlans;
+    std::vector<l2_static> l2;
+    std::vector<port_settings> ports;
+    auto version = vlans_->entries(&vlans);
+    ConfigState::instance().snapshot(&l2, &ports);
+
+    size_t vlans_offset = sizeof(state_header);
+    size_t l2_offset = vlans_offset + vlans.size() * sizeof(state_vlan);
+    size_t ports_offset = l2_offset + l2.size() * sizeof(state_l2);
+    size_t size = ports_offset + ports.size() * sizeof(state_port);
+
+    auto tmp = path_ + ".tmp";
+    int fd = ::open(tmp.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if ( fd < 0 ) {
+        std::cerr << "cannot create " << tmp << ": " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    if ( ftruncate(fd, size) < 0 ) {
+        std::cerr << "cannot size " << tmp << ": " << std::strerror(errno) << std::endl;
+        close(fd);
+        return false;
+    }
+    auto p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if ( p == MAP_FAILED ) {
+        std::cerr << "cannot map " << tmp << ": " << std::strerror(errno) << std::endl;
+        close(fd);
+        return false;
+    }
+    auto base = static_cast<char*>(p);
+    auto v = reinterpret_cast<state_vlan*>(base + vlans_offset);
+    for ( auto& e : vlans ) {
+        v->unit = e.first;
+        v->vid = e.second.vid;
+        v->version = e.second.version;
+        for ( int w = 0; w < _SHR_PBMP_WORD_MAX; w++ ) {
+            v->pbmp[w] = e.second.pbmp.pbits[w];
+            v->ut_pbmp[w] = e.second.ut_pbmp.pbits[w];
+        }
+        v++;
+    }
+    auto a = reinterpret_cast<state_l2*>(base + l2_offset);
+    for ( auto& e : l2 ) {
+        a->unit = e.unit;
+        a->vid = e.vid;
+        std::memcpy(a->mac, e.mac, 6);
+        a->flags = e.flags;
+        a->port = e.port;
+        a->modid = e.modid;
+        a->tgid = e.tgid;
+        a++;
+    }
+    auto s = reinterpret_cast<state_port*>(base + ports_offset);
+    for ( auto& ps : ports ) {
+        s->unit = ps.unit;
+        s->port = ps.port;
+        s->mask = ps.mask;
+        s->enable = ps.enable;
+        s->speed = ps.speed;
+        s->autoneg = ps.autoneg;
+        s++;
+    }
+    auto h = static_cast<state_header*>(p);
+    h->magic = STATE_MAGIC;
+    h->layout_version = STATE_LAYOUT_VERSION;
+    h->header_size = sizeof(state_header);
+    h->pbmp_words = _SHR_PBMP_WORD_MAX;
+    h->num_vlans = vlans.size();
+    h->num_l2 = l2.size();
+    h->num_ports = ports.size();
+    h->vlans_offset = vlans_offset;
+    h->l2_offset = l2_offset;
+    h->ports_offset = ports_offset;
+    h->vlan_version = version;
+    h->timestamp = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+
+    // the rename must not expose a file whose pages are not on disk yet
+    bool ok = msync(p, size, MS_SYNC) == 0;
+    munmap(p, size);
+    close(fd);
+    if ( !ok || rename(tmp.c_str(), path_.c_str()) < 0 ) {
+        std::cerr << "cannot save " << path_ << ": " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    return true;
+}
+
+void StateSnapshot::loop() {
+    static telemetry::Metric metric("internal/state_save");
+    uint64_t saved_generation = 0;
+    uint64_t saved_version = 0;
+    bool first = true;
+    while (true) {
+        auto generation = ConfigState::instance().generation();
+        auto version = vlans_->version();
+        if ( first || generation != saved_generation || version != saved_version ) {
+            if ( telemetry::timed(metric, [this]() { return save(); }) ) {
+                saved_generation = generation;
+                saved_version = version;
+                first = false;
+            }
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(interval_ms_));
+    }
+}
+
+std::string format_mac(const uint8_t* mac) {
+    char buf[18];
+    std::snprintf(buf, sizeof(buf), "%02x:%02x:%02x:%02x:%02x:%02x", mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+    return buf;
+}
+
+int collect_l2(int unit, opennsl_l2_addr_t* info, void* user_data) {
+    auto entries = static_cast<std::map<std::pair<std::string, int>, opennsl_l2_addr_t>*>(user_data);
+    (*entries)[std::make_pair(format_mac(info->mac), int(info->vid))] = *info;
+    return 0;
+}
+
+// reconcile_unit compares the restored state of unit with the hardware,
+// rewriting l2 and ports to what the hardware has.
+void StateSnapshot::reconcile_unit(int unit, std::vector<l2_static>* l2, std::vector<port_settings>* ports, std::vector<std::string>* diverged) {
+    std::vector<opennsl_vlan_t> vids;
+    auto ret = vlans_->reconcile(unit, &vids);
+    if ( ret != OPENNSL_E_NONE ) {
+        std::ostringstream msg;
+        msg << "unit " << unit << ": opennsl_vlan_list() failed " << opennsl_errmsg(ret);
+        diverged->push_back(msg.str());
+    }
+    for ( auto vid : vids ) {
+        std::ostringstream msg;
+        msg << "unit " << unit << " vlan " << vid << ": membership differs";
+        diverged->push_back(msg.str());
+    }
+
+    std::map<std::pair<std::string, int>, opennsl_l2_addr_t> hw;
+    ret = SDK_CALL(opennsl_l2_traverse, unit, collect_l2, &hw);
+    if ( ret != OPENNSL_E_NONE ) {
+        std::ostringstream msg;
+        msg << "unit " << unit << ": opennsl_l2_traverse() failed " << opennsl_errmsg(ret);
+        diverged->push_back(msg.str());
+    }
+    std::vector<l2_static> kept;
+    for ( auto& e : *l2 ) {
+        if ( e.unit != unit ) {
+            kept.push_back(e);
+            continue;
+        }
+        std::ostringstream msg;
+        msg << "unit " << unit << " l2 " << format_mac(e.mac) << " vlan " << e.vid << ": ";
+        auto it = hw.find(std::make_pair(format_mac(e.mac), int(e.vid)));
+        if ( it == hw.end() ) {
+            msg << "missing";
+            diverged->push_back(msg.str());
+            continue;
+        }
+        auto& a = it->second;
+        if ( (a.flags & OPENNSL_L2_STATIC) == 0 ) {
+            msg << "no longer static";
+            diverged->push_back(msg.str());
+            continue;
+        }
+        if ( a.port != e.port || a.modid != e.modid || a.tgid != e.tgid ) {
+            msg << "port " << e.port << ", hardware has " << a.port;
+            diverged->push_back(msg.str());
+            e.port = a.port;
+            e.modid = a.modid;
+            e.tgid = a.tgid;
+        }
+        e.flags = a.flags;
+        kept.push_back(e);
+    }
+    *l2 = kept;
+
+    for ( auto& p : *ports ) {
+        if ( p.unit != unit ) {
+            continue;
+        }
+        int value;
+        if ( (p.mask & PORT_SETTING_ENABLE) && SDK_CALL(opennsl_port_enable_get, unit, p.port, &value) == OPENNSL_E_NONE && value != p.enable ) {
+            std::ostringstream msg;
+            msg << "unit " << unit << " port " << p.port << ": enable " << p.enable << ", hardware has " << value;
+            diverged->push_back(msg.str());
+            p.enable = value;
+        }
+        if ( (p.mask & PORT_SETTING_SPEED) && SDK_CALL(opennsl_port_speed_get, unit, p.port, &value) == OPENNSL_E_NONE && value != p.speed ) {
+            std::ostringstream msg;
+            msg << "unit " << unit << " port " << p.port << ": speed " << p.speed << ", hardware has " << value;
+            diverged->push_back(msg.str());
+            p.speed = value;
+        }
+        if ( (p.mask & PORT_SETTING_AUTONEG) && SDK_CALL(opennsl_port_autoneg_get, unit, p.port, &value) == OPENNSL_E_NONE && value != p.autoneg ) {
+            std::ostringstream msg;
+            msg << "unit " << unit << " port " << p.port << ": autoneg " << p.autoneg << ", hardware has " << value;
+            diverged->push_back(msg.str());
+            p.autoneg = value;
+        }
+    }
+}
+
+bool StateSnapshot::reconcile(std::vector<std::string>* diverged) {
+    if ( reconciled_.exchange(true) ) {
+        return false;
+    }
+    if ( loaded_ ) {
+        static telemetry::Metric metric("internal/state_reconcile");
+        telemetry::Timer timer(metric);
+        std::vector<l2_static> l2;
+        std::vector<port_settings> ports;
+        ConfigState::instance().snapshot(&l2, &ports);
+        for ( auto unit : units_ ) {
+            reconcile_unit(unit, &l2, &ports, diverged);
+        }
+        ConfigState::instance().restore(l2, ports);
+        for ( auto& d : *diverged ) {
+            std::cerr << "warm restart: " << d << std::endl;
+        }
+        std::cout << "warm restart: reconciled " << units_.size() << " units, " << diverged->size() << " differences" << std::endl;
+    }
+    th_ = new std::thread(&StateSnapshot::loop, this);
+    return loaded_;
+}
@@ -0,0 +1,43 @@
+#ifndef STATE_SNAPSHOT_H
+#define STATE_SNAPSHOT_H
+
+#include <atomic>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "vlan.h"
+#include "config_state.h"
+
+// StateSnapshot persists the configuration known to the server (the VLAN
+// table and the ConfigState) to a memory-mapped file every interval_ms when
+// it changed, so that a restarted server can pick it up again.
+//
+// At startup load() restores the saved state. Once the SDK is up,
+// reconcile() compares it with the hardware in one pass per unit, adopts
+// what the hardware has and reports each difference, and from then on the
+// state is saved periodically. VLAN versions survive the restart, but the
+// VLAN table starts a new epoch, so clients polling VLAN ListChanges get a
+// full list once and then only see changes again.
+class StateSnapshot {
+    public:
+        StateSnapshot(const std::string& path, int interval_ms, VLANTable* vlans) : path_(path), interval_ms_(interval_ms), vlans_(vlans), loaded_(false), reconciled_(false), th_(NULL) {}
+        bool load();
+        // reconcile only runs once; it returns whether a saved state was
+        // reconciled.
+        bool reconcile(std::vector<std::string>* diverged);
+        bool save();
+    private:
+        void reconcile_unit(int unit, std::vector<l2_static>* l2, std::vector<port_settings>* ports, std::vector<std::string>* diverged);
+        void loop();
+        std::string path_;
+        int interval_ms_;
+        VLANTable* vlans_;
+        bool loaded_;
+        std::set<int> units_;
+        std::atomic<bool> reconciled_;
+        std::thread* th_;
+};
+
+#endif // STATE_SNAPSHOT_H
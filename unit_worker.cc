@@ -0,0 +1,156 @@
+#include "unit_worker.h"
+#include "metrics.h"
+
+const int SPIN_LIMIT = 64;
+
+// the unit of an RPC request is an int64
+static_assert(sdk_unit(int64_t(3), 0) == 3, "an int64 unit must be routed to its worker");
+static_assert(sdk_unit(3, 0) == 3, "an int unit must be routed to its worker");
+static_assert(sdk_unit(int64_t(1) << 32 | 3) == -1, "an out of range unit must not be routed");
+static_assert(sdk_unit("name", 3) == -1, "a call without a unit must not be routed");
+
+// the unit whose worker runs on this thread
+thread_local int worker_unit = -1;
+
+// calls made outside of an RPC, such as by the pollers, queue as normal ones
+thread_local int sdk_lane = 1;
+
+task_queue::task_queue() : head_(&stub_), tail_(&stub_) {
+    stub_.next.store(NULL, std::memory_order_relaxed);
+}
+
+// push and pop implement an intrusive multi-producer single-consumer queue.
+// A producer swaps itself in as the head and then links the previous head to
+// it; between the two steps the consumer sees a broken link and retries.
+void task_queue::push(unit_task* t) {
+    t->next.store(NULL, std::memory_order_relaxed);
+    auto prev = head_.exchange(t, std::memory_order_acq_rel);
+    prev->next.store(t, std::memory_order_release);
+}
+
+unit_task* task_queue::pop() {
+    auto tail = tail_;
+    auto next = tail->next.load(std::memory_order_acquire);
+    if ( tail == &stub_ ) {
+        if ( next == NULL ) {
+            return NULL;
+        }
+        tail_ = next;
+        tail = next;
+        next = next->next.load(std::memory_order_acquire);
+    }
+    if ( next != NULL ) {
+        tail_ = next;
+        return tail;
+    }
+    if ( tail != head_.load(std::memory_order_acquire) ) {
+        return NULL;
+    }
+    // tail is the last task; requeue the stub behind it so that tail can
+    // be handed out without leaving the queue pointing at it
+    push(&stub_);
+    next = tail->next.load(std::memory_order_acquire);
+    if ( next != NULL ) {
+        tail_ = next;
+        return tail;
+    }
+    return NULL;
+}
+
+UnitWorker::UnitWorker(int unit) : unit_(unit), pending_(0) {
+    th_ = new std::thread(&UnitWorker::loop, this);
+}
+
+void UnitWorker::submit(unit_task* t) {
+    // counting before the push keeps the worker from sleeping on a task
+    // that is half way in; only the first task after idle has to wake it
+    bool idle = pending_.fetch_add(1, std::memory_order_acq_rel) == 0;
+    lanes_[t->lane].push(t);
+    if ( idle ) {
+        std::unique_lock<std::mutex> mlock(mutex_);
+        cond_.notify_one();
+    }
+}
+
+// pop takes the next task of the first lane that has one.
+unit_task* UnitWorker::pop() {
+    for ( int i = 0; i < UNIT_LANES; i++ ) {
+        auto t = lanes_[i].pop();
+        if ( t != NULL ) {
+            return t;
+        }
+    }
+    return NULL;
+}
+
+void UnitWorker::run(unit_task* t) {
+    static telemetry::Metric wait("internal/unit_queue_wait");
+    wait.record(telemetry::now_ns() - t->enqueued);
+    (*t->fn)();
+    pending_.fetch_sub(1, std::memory_order_release);
+    // notify under the lock, as t is gone once its caller sees done
+    std::unique_lock<std::mutex> mlock(t->mutex);
+    t->done.store(true, std::memory_order_release);
+    t->cond.notify_one();
+}
+
+void UnitWorker::loop() {
+    worker_unit = unit_;
+    while (true) {
+        auto t = pop();
+        if ( t == NULL ) {
+            if ( pending_.load(std::memory_order_acquire) > 0 ) {
+                // a producer is between its two push steps
+                std::this_thread::yield();
+                continue;
+            }
+            std::unique_lock<std::mutex> mlock(mutex_);
+            cond_.wait(mlock, [this]() { return pending_.load(std::memory_order_acquire) > 0; });
+            continue;
+        }
+        run(t);
+    }
+}
+
+UnitWorkers& UnitWorkers::instance() {
+    static UnitWorkers w;
+    return w;
+}
+
+UnitWorkers::UnitWorkers() : enabled_(true) {
+    for ( auto& w : workers_ ) {
+        w.store(NULL, std::memory_order_relaxed);
+    }
+}
+
+void UnitWorkers::submit(int unit, const std::function<void()>& fn) {
+    if ( !enabled_ || unit < 0 || unit >= MAX_UNITS || unit == worker_unit ) {
+        fn();
+        return;
+    }
+    auto w = workers_[unit].load(std::memory_order_acquire);
+    if ( w == NULL ) {
+        std::unique_lock<std::mutex> mlock(mutex_);
+        w = workers_[unit].load(std::memory_order_relaxed);
+        if ( w == NULL ) {
+            w = new UnitWorker(unit);
+            workers_[unit].store(w, std::memory_order_release);
+        }
+    }
+    unit_task t;
+    t.fn = &fn;
+    t.lane = sdk_lane >= 0 && sdk_lane < UNIT_LANES ? sdk_lane : UNIT_LANES - 1;
+    t.enqueued = telemetry::now_ns();
+    t.done.store(false, std::memory_order_relaxed);
+    w->submit(&t);
+    // most SDK calls finish within a few microseconds, well before a
+    // sleeping thread would be rescheduled
+    for ( int i = 0; i < SPIN_LIMIT && !t.done.load(std::memory_order_acquire); i++ ) {
+        std::this_thread::yield();
+    }
+    // taking the lock also waits for the worker to let go of t
+    std::unique_lock<std::mutex> mlock(t.mutex);
+    while ( !t.done.load(std::memory_order_acquire) ) {
+        t.cond.wait(mlock);
+    }
+}
@@ -0,0 +1,107 @@
+#ifndef UNIT_WORKER_H
+#define UNIT_WORKER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+
+const int MAX_UNITS = 8;
+
+// unit_task is one SDK call waiting for a unit worker. It lives on the stack
+// of the calling thread, which blocks until the worker marks it done.
+struct unit_task {
+    std::atomic<unit_task*> next;
+    const std::function<void()>* fn;
+    int lane;
+    uint64_t enqueued;
+    std::atomic<bool> done;
+    std::mutex mutex;
+    std::condition_variable cond;
+};
+
+// UNIT_LANES is the number of priority lanes of a unit worker. Lane 0 is
+// served first.
+const int UNIT_LANES = 3;
+
+// sdk_lane is the lane the SDK calls of this thread are queued on.
+// Admission sets it to the class of the RPC being served.
+extern thread_local int sdk_lane;
+
+// task_queue is an intrusive lock-free multi-producer single-consumer queue
+// of unit tasks.
+class task_queue {
+    public:
+        task_queue();
+        void push(unit_task* t);
+        unit_task* pop();
+    private:
+        std::atomic<unit_task*> head_;
+        unit_task* tail_;
+        unit_task stub_;
+};
+
+// UnitWorker owns the SDK access of one unit. Callers push tasks onto the
+// queue of their lane and the worker thread runs them one at a time, always
+// taking the next task from the first lane that has one. Tasks of a lane
+// run in arrival order.
+class UnitWorker {
+    public:
+        UnitWorker(int unit);
+        void submit(unit_task* t);
+    private:
+        unit_task* pop();
+        void run(unit_task* t);
+        void loop();
+        int unit_;
+        task_queue lanes_[UNIT_LANES];
+        std::atomic<int> pending_; // submitted tasks not yet run
+        std::mutex mutex_;
+        std::condition_variable cond_;
+        std::thread* th_;
+};
+
+// UnitWorkers routes SDK calls to the worker of their unit, starting it on
+// first use. Calls for units outside [0, MAX_UNITS), calls made from the
+// worker of the same unit and all calls when disabled run on the calling
+// thread.
+class UnitWorkers {
+    public:
+        static UnitWorkers& instance();
+        void set_enabled(bool enabled) { enabled_ = enabled; }
+        template <typename F>
+        auto run(int unit, F f) -> decltype(f()) {
+            decltype(f()) ret;
+            submit(unit, [&]() { ret = f(); });
+            return ret;
+        }
+    private:
+        UnitWorkers();
+        void submit(int unit, const std::function<void()>& fn);
+        bool enabled_;
+        std::mutex mutex_;
+        std::atomic<UnitWorker*> workers_[MAX_UNITS];
+};
+
+// sdk_unit picks the unit an SDK call is routed by: its first argument when
+// that is an integer, by the OpenNSL convention, and none otherwise. RPC
+// handlers pass the int64 unit of their request, so any integer type
+// counts, and values which aren't a valid unit route to none.
+inline constexpr int sdk_unit() {
+    return -1;
+}
+
+template <typename U, typename... Args>
+constexpr typename std::enable_if<std::is_integral<U>::value, int>::type sdk_unit(const U& unit, const Args&...) {
+    return unit >= 0 && unit < MAX_UNITS ? static_cast<int>(unit) : -1;
+}
+
+template <typename T, typename... Args>
+constexpr typename std::enable_if<!std::is_integral<T>::value, int>::type sdk_unit(const T&, const Args&...) {
+    return -1;
+}
+
+#endif // UNIT_WORKER_H
@@ -1,146 +1,704 @@
+#include <random>
 #include <sstream>
 
 #include <grpc++/server.h>
 
 #include "vlanservice.grpc.pb.h"
 #include "vlan.h"
+#include "metrics.h"
+#include "admission.h"
 #include "port.h"
+#include "config_state.h"
 
 extern "C" {
 #include "opennsl/error.h"
 #include "opennsl/vlan.h"
 }
 
+// number of VLANs carried by one ListStreamResponse
+const int VLAN_LIST_CHUNK_SIZE = 256;
+
+// load reads the VLANs of unit from the SDK. Only entries that differ from
+// the table get a new version, and their VIDs are appended to changed.
+int VLANTable::load(int unit, std::vector<opennsl_vlan_t>* changed) {
+    opennsl_vlan_data_t *p;
+    opennsl_vlan_t default_vid;
+    int count;
+    auto ret = SDK_CALL(opennsl_vlan_default_get, unit, &default_vid);
+    if (ret != OPENNSL_E_NONE) {
+        return ret;
+    }
+    ret = SDK_CALL(opennsl_vlan_list, unit, &p, &count);
+    if (ret != OPENNSL_E_NONE) {
+        return ret;
+    }
+    auto& vlans = units_[unit];
+    auto& ports = ports_[unit];
+    std::set<opennsl_vlan_t> present;
+    for (auto i = 0; i < count; i++) {
+        auto& e = vlans[p[i].vlan_tag];
+        present.insert(p[i].vlan_tag);
+        if (e.exists && OPENNSL_PBMP_EQ(e.pbmp, p[i].port_bitmap) && OPENNSL_PBMP_EQ(e.ut_pbmp, p[i].ut_port_bitmap)) {
+            continue;
+        }
+        e.vid = p[i].vlan_tag;
+        e.pbmp = p[i].port_bitmap;
+        e.ut_pbmp = p[i].ut_port_bitmap;
+        e.version = ++version_;
+        e.exists = true;
+        if (changed != NULL) {
+            changed->push_back(e.vid);
+        }
+    }
+    ports.clear();
+    for (auto& v : vlans) {
+        auto& e = v.second;
+        if (e.exists && present.count(e.vid) == 0) {
+            e.exists = false;
+            e.version = ++version_;
+            OPENNSL_PBMP_CLEAR(e.pbmp);
+            OPENNSL_PBMP_CLEAR(e.ut_pbmp);
+            if (changed != NULL) {
+                changed->push_back(e.vid);
+            }
+        }
+        int port;
+        OPENNSL_PBMP_ITER(e.pbmp, port) {
+            ports[port].insert(e.vid);
+        }
+    }
+    default_vids_[unit] = default_vid;
+    synced_.insert(unit);
+    return SDK_CALL(opennsl_vlan_list_destroy, unit, p, count);
+}
+
+int VLANTable::sync(int unit) {
+    std::unique_lock<std::mutex> mlock(mutex_);
+    if (synced_.count(unit) > 0) {
+        return OPENNSL_E_NONE;
+    }
+    return load(unit, NULL);
+}
+
+// reconcile loads unit from the SDK even if it was synced before and reports
+// the VIDs whose membership differed from the table.
+int VLANTable::reconcile(int unit, std::vector<opennsl_vlan_t>* changed) {
+    std::unique_lock<std::mutex> mlock(mutex_);
+    return load(unit, changed);
+}
+
+// new_epoch draws a random non-zero epoch.
+static uint64_t new_epoch() {
+    std::random_device rd;
+    uint64_t epoch;
+    do {
+        epoch = uint64_t(rd()) << 32 | rd();
+    } while (epoch == 0);
+    return epoch;
+}
+
+VLANTable::VLANTable() : version_(0), epoch_(new_epoch()) {}
+
+// restore seeds the table of unit with entries saved by a previous run. The
+// unit is not marked synced, so the first sync() compares it with the SDK.
+// The saved run may have handed out versions after the entries were saved,
+// so the table draws a new epoch: clients holding a version of the old run
+// get a full list instead of changes counted from a version that may have
+// been reused.
+void VLANTable::restore(int unit, const std::vector<vlan_entry>& entries, uint64_t version) {
+    std::unique_lock<std::mutex> mlock(mutex_);
+    auto& vlans = units_[unit];
+    for (auto& e : entries) {
+        vlans[e.vid] = e;
+    }
+    if (version > version_) {
+        version_ = version;
+    }
+    epoch_ = new_epoch();
+}
+
+uint64_t VLANTable::version() {
+    std::unique_lock<std::mutex> mlock(mutex_);
+    return version_;
+}
+
+uint64_t VLANTable::epoch() {
+    std::unique_lock<std::mutex> mlock(mutex_);
+    return epoch_;
+}
+
+// entries appends the existing VLANs of every synced unit.
+uint64_t VLANTable::entries(std::vector<std::pair<int, vlan_entry> >* entries) {
+    std::unique_lock<std::mutex> mlock(mutex_);
+    for (auto unit : synced_) {
+        for (auto& v : units_[unit]) {
+            if (v.second.exists) {
+                entries->push_back(std::make_pair(unit, v.second));
+            }
+        }
+    }
+    return version_;
+}
+
+// get returns the entry of vid, or NULL when the unit is not loaded yet.
+// Changes to a unit that was never loaded are picked up by the first sync().
+vlan_entry* VLANTable::get(int unit, opennsl_vlan_t vid) {
+    if (synced_.count(unit) == 0) {
+        return NULL;
+    }
+    auto& e = units_[unit][vid];
+    e.vid = vid;
+    e.version = ++version_;
+    return &e;
+}
+
+// reindex moves vid between the port sets of the ports that joined or left
+// it, comparing the member bitmap before the change with the current one.
+void VLANTable::reindex(int unit, const vlan_entry& e, const opennsl_pbmp_t& before) {
+    auto& ports = ports_[unit];
+    int port;
+    OPENNSL_PBMP_ITER(before, port) {
+        if (!OPENNSL_PBMP_MEMBER(e.pbmp, port)) {
+            ports[port].erase(e.vid);
+        }
+    }
+    OPENNSL_PBMP_ITER(e.pbmp, port) {
+        if (!OPENNSL_PBMP_MEMBER(before, port)) {
+            ports[port].insert(e.vid);
+        }
+    }
+}
+
+void VLANTable::create(int unit, opennsl_vlan_t vid) {
+    std::unique_lock<std::mutex> mlock(mutex_);
+    auto e = get(unit, vid);
+    if (e == NULL) {
+        return;
+    }
+    auto before = e->pbmp;
+    OPENNSL_PBMP_CLEAR(e->pbmp);
+    OPENNSL_PBMP_CLEAR(e->ut_pbmp);
+    e->exists = true;
+    reindex(unit, *e, before);
+}
+
+void VLANTable::destroy(int unit, opennsl_vlan_t vid) {
+    std::unique_lock<std::mutex> mlock(mutex_);
+    auto e = get(unit, vid);
+    if (e == NULL) {
+        return;
+    }
+    auto before = e->pbmp;
+    OPENNSL_PBMP_CLEAR(e->pbmp);
+    OPENNSL_PBMP_CLEAR(e->ut_pbmp);
+    e->exists = false;
+    reindex(unit, *e, before);
+}
+
+void VLANTable::destroy_all(int unit) {
+    std::unique_lock<std::mutex> mlock(mutex_);
+    if (synced_.count(unit) == 0) {
+        return;
+    }
+    // the SDK keeps the default VLAN, so reload instead of guessing
+    load(unit, NULL);
+}
+
+void VLANTable::port_add(int unit, opennsl_vlan_t vid, const opennsl_pbmp_t& pbmp, const opennsl_pbmp_t& ubmp) {
+    std::unique_lock<std::mutex> mlock(mutex_);
+    auto e = get(unit, vid);
+    if (e == NULL) {
+        return;
+    }
+    // ports in pbmp become tagged members unless they are also in ubmp
+    auto before = e->pbmp;
+    opennsl_pbmp_t ut = ubmp;
+    OPENNSL_PBMP_AND(ut, pbmp);
+    OPENNSL_PBMP_OR(e->pbmp, pbmp);
+    OPENNSL_PBMP_REMOVE(e->ut_pbmp, pbmp);
+    OPENNSL_PBMP_OR(e->ut_pbmp, ut);
+    reindex(unit, *e, before);
+}
+
+void VLANTable::port_remove(int unit, opennsl_vlan_t vid, const opennsl_pbmp_t& pbmp) {
+    std::unique_lock<std::mutex> mlock(mutex_);
+    auto e = get(unit, vid);
+    if (e == NULL) {
+        return;
+    }
+    auto before = e->pbmp;
+    OPENNSL_PBMP_REMOVE(e->pbmp, pbmp);
+    OPENNSL_PBMP_REMOVE(e->ut_pbmp, pbmp);
+    reindex(unit, *e, before);
+}
+
+// refresh re-reads the membership of vid from the SDK. It is used after
+// changes that can't be applied to the table directly, like gport updates.
+void VLANTable::refresh(int unit, opennsl_vlan_t vid) {
+    std::unique_lock<std::mutex> mlock(mutex_);
+    auto e = get(unit, vid);
+    if (e == NULL) {
+        return;
+    }
+    auto before = e->pbmp;
+    auto ret = SDK_CALL(opennsl_vlan_port_get, unit, vid, &e->pbmp, &e->ut_pbmp);
+    e->exists = ret == OPENNSL_E_NONE;
+    if (!e->exists) {
+        OPENNSL_PBMP_CLEAR(e->pbmp);
+        OPENNSL_PBMP_CLEAR(e->ut_pbmp);
+    }
+    reindex(unit, *e, before);
+}
+
+void VLANTable::set_default(int unit, opennsl_vlan_t vid) {
+    std::unique_lock<std::mutex> mlock(mutex_);
+    if (synced_.count(unit) == 0) {
+        return;
+    }
+    default_vids_[unit] = vid;
+}
+
+opennsl_vlan_t VLANTable::default_vid(int unit) {
+    std::unique_lock<std::mutex> mlock(mutex_);
+    return default_vids_[unit];
+}
+
+bool VLANTable::vlan(int unit, opennsl_vlan_t vid, vlan_entry* entry) {
+    std::unique_lock<std::mutex> mlock(mutex_);
+    auto& vlans = units_[unit];
+    auto it = vlans.find(vid);
+    if (it == vlans.end() || !it->second.exists) {
+        return false;
+    }
+    *entry = it->second;
+    return true;
+}
+
+// port_vlans appends the VLANs port is a member of in ascending order.
+uint64_t VLANTable::port_vlans(int unit, opennsl_port_t port, std::vector<vlan_entry>* entries) {
+    std::unique_lock<std::mutex> mlock(mutex_);
+    auto& vlans = units_[unit];
+    for (auto vid : ports_[unit][port]) {
+        entries->push_back(vlans[vid]);
+    }
+    return version_;
+}
+
+uint64_t VLANTable::list(int unit, std::vector<vlan_entry>* entries) {
+    std::unique_lock<std::mutex> mlock(mutex_);
+    for (auto& v : units_[unit]) {
+        if (v.second.exists) {
+            entries->push_back(v.second);
+        }
+    }
+    return version_;
+}
+
+// changes appends the entries modified after since, tombstones included.
+uint64_t VLANTable::changes(int unit, uint64_t since, std::vector<vlan_entry>* entries) {
+    std::unique_lock<std::mutex> mlock(mutex_);
+    for (auto& v : units_[unit]) {
+        if (v.second.version > since) {
+            entries->push_back(v.second);
+        }
+    }
+    return version_;
+}
+
+void set_protobuf_vlan_data(vlan::VLANData* dst, const vlan_entry& src) {
+    dst->set_vid(src.vid);
+    set_protobuf_port_config(dst->mutable_pbmp(), src.pbmp);
+    set_protobuf_port_config(dst->mutable_ut_pbmp(), src.ut_pbmp);
+}
+
+bool valid_vid_range(const vlan::VIDRange& range) {
+    return range.first() >= 1 && range.first() <= range.last() && range.last() < OPENNSL_VLAN_MAX;
+}
+
+void add_vid_error(google::protobuf::RepeatedPtrField<vlan::VIDError>* errors, opennsl_vlan_t vid, int ret, const char* fn) {
+    std::ostringstream err;
+    err << fn << " failed " << opennsl_errmsg(ret);
+    auto e = errors->Add();
+    e->set_vid(vid);
+    e->set_code(ret);
+    e->set_message(err.str());
+}
+
 grpc::Status VLANServiceImpl::Create(::grpc::ServerContext* context, const ::vlan::CreateRequest* req, ::vlan::CreateResponse* res){
-    auto ret = opennsl_vlan_create(req->unit(), req->vid());
+    RPC_TIMER("VLAN");
+    RPC_ADMIT("VLAN", RPC_CLASS_NORMAL);
+    auto lock = config_lock(req->unit());
+    auto ret = SDK_CALL(opennsl_vlan_create, req->unit(), req->vid());
     if (ret != OPENNSL_E_NONE) {
         return grpc::Status(grpc::UNAVAILABLE, "opennsl_vlan_create() failed");
     }
+    table_.create(req->unit(), req->vid());
     return grpc::Status::OK;
 }
 
 grpc::Status VLANServiceImpl::Destroy(::grpc::ServerContext* context, const ::vlan::DestroyRequest* req, ::vlan::DestroyResponse* res){
-    auto ret = opennsl_vlan_destroy(req->unit(), req->vid());
+    RPC_TIMER("VLAN");
+    RPC_ADMIT("VLAN", RPC_CLASS_NORMAL);
+    auto lock = config_lock(req->unit());
+    auto ret = SDK_CALL(opennsl_vlan_destroy, req->unit(), req->vid());
     if (ret != OPENNSL_E_NONE) {
         std::ostringstream err;
         err << "opennsl_vlan_destroy() failed " << opennsl_errmsg(ret);
         return grpc::Status(grpc::UNAVAILABLE, err.str());
     }
+    table_.destroy(req->unit(), req->vid());
     return grpc::Status::OK;
 }
 
 grpc::Status VLANServiceImpl::DestroyAll(::grpc::ServerContext* context, const ::vlan::DestroyAllRequest* req, ::vlan::DestroyAllResponse* res){
-    auto ret = opennsl_vlan_destroy_all(req->unit());
+    RPC_TIMER("VLAN");
+    RPC_ADMIT("VLAN", RPC_CLASS_BULK);
+    auto lock = config_lock(req->unit());
+    auto ret = SDK_CALL(opennsl_vlan_destroy_all, req->unit());
     if (ret != OPENNSL_E_NONE) {
         std::ostringstream err;
         err << "opennsl_vlan_destroy_all() failed " << opennsl_errmsg(ret);
         return grpc::Status(grpc::UNAVAILABLE, err.str());
     }
+    table_.destroy_all(req->unit());
+    return grpc::Status::OK;
+}
+
+grpc::Status VLANServiceImpl::CreateRange(::grpc::ServerContext* context, const ::vlan::CreateRangeRequest* req, ::vlan::CreateRangeResponse* res){
+    RPC_TIMER("VLAN");
+    RPC_ADMIT("VLAN", RPC_CLASS_BULK);
+    for (auto& range : req->ranges()) {
+        if (!valid_vid_range(range)) {
+            return grpc::Status(grpc::INVALID_ARGUMENT, "invalid vid range");
+        }
+    }
+    for (auto& range : req->ranges()) {
+        for (auto vid = range.first(); vid <= range.last(); vid++) {
+            // locked per VID, so that a long range doesn't hold up other
+            // changes of the unit
+            auto lock = config_lock(req->unit());
+            auto ret = SDK_CALL(opennsl_vlan_create, req->unit(), vid);
+            if (ret != OPENNSL_E_NONE) {
+                add_vid_error(res->mutable_errors(), vid, ret, "opennsl_vlan_create()");
+                continue;
+            }
+            table_.create(req->unit(), vid);
+        }
+    }
+    return grpc::Status::OK;
+}
+
+grpc::Status VLANServiceImpl::DestroyRange(::grpc::ServerContext* context, const ::vlan::DestroyRangeRequest* req, ::vlan::DestroyRangeResponse* res){
+    RPC_TIMER("VLAN");
+    RPC_ADMIT("VLAN", RPC_CLASS_BULK);
+    for (auto& range : req->ranges()) {
+        if (!valid_vid_range(range)) {
+            return grpc::Status(grpc::INVALID_ARGUMENT, "invalid vid range");
+        }
+    }
+    for (auto& range : req->ranges()) {
+        for (auto vid = range.first(); vid <= range.last(); vid++) {
+            auto lock = config_lock(req->unit());
+            auto ret = SDK_CALL(opennsl_vlan_destroy, req->unit(), vid);
+            if (ret != OPENNSL_E_NONE) {
+                add_vid_error(res->mutable_errors(), vid, ret, "opennsl_vlan_destroy()");
+                continue;
+            }
+            table_.destroy(req->unit(), vid);
+        }
+    }
     return grpc::Status::OK;
 }
 
 grpc::Status VLANServiceImpl::PortAdd(::grpc::ServerContext* context, const ::vlan::PortAddRequest* req, ::vlan::PortAddResponse* res){
+    RPC_TIMER("VLAN");
+    RPC_ADMIT("VLAN", RPC_CLASS_NORMAL);
     auto pbmp = get_port_config(req->pbmp());
     auto ubmp = get_port_config(req->ut_pbmp());
-    auto ret = opennsl_vlan_port_add(req->unit(), req->vid(), pbmp, ubmp);
+    auto lock = config_lock(req->unit());
+    auto ret = SDK_CALL(opennsl_vlan_port_add, req->unit(), req->vid(), pbmp, ubmp);
     if (ret != OPENNSL_E_NONE) {
         std::ostringstream err;
         err << "opennsl_vlan_port_add() failed " << opennsl_errmsg(ret);
         return grpc::Status(grpc::UNAVAILABLE, err.str());
     }
+    table_.port_add(req->unit(), req->vid(), pbmp, ubmp);
     return grpc::Status::OK;
 }
 
 grpc::Status VLANServiceImpl::PortRemove(::grpc::ServerContext* context, const ::vlan::PortRemoveRequest* req, ::vlan::PortRemoveRequest* res){
+    RPC_TIMER("VLAN");
+    RPC_ADMIT("VLAN", RPC_CLASS_NORMAL);
     auto pbmp = get_port_config(req->pbmp());
-    auto ret = opennsl_vlan_port_remove(req->unit(), req->vid(), pbmp);
+    auto lock = config_lock(req->unit());
+    auto ret = SDK_CALL(opennsl_vlan_port_remove, req->unit(), req->vid(), pbmp);
     if (ret != OPENNSL_E_NONE) {
         std::ostringstream err;
         err << "opennsl_vlan_port_remove() failed " << opennsl_errmsg(ret);
         return grpc::Status(grpc::UNAVAILABLE, err.str());
     }
+    table_.port_remove(req->unit(), req->vid(), pbmp);
+    return grpc::Status::OK;
+}
+
+grpc::Status VLANServiceImpl::PortAddMulti(::grpc::ServerContext* context, const ::vlan::PortAddMultiRequest* req, ::vlan::PortAddMultiResponse* res){
+    RPC_TIMER("VLAN");
+    RPC_ADMIT("VLAN", RPC_CLASS_BULK);
+    for (auto& entry : req->entries()) {
+        if (!valid_vid_range(entry.range())) {
+            return grpc::Status(grpc::INVALID_ARGUMENT, "invalid vid range");
+        }
+    }
+    for (auto& entry : req->entries()) {
+        auto pbmp = get_port_config(entry.pbmp());
+        auto ubmp = get_port_config(entry.ut_pbmp());
+        for (auto vid = entry.range().first(); vid <= entry.range().last(); vid++) {
+            auto lock = config_lock(req->unit());
+            auto ret = SDK_CALL(opennsl_vlan_port_add, req->unit(), vid, pbmp, ubmp);
+            if (ret != OPENNSL_E_NONE) {
+                add_vid_error(res->mutable_errors(), vid, ret, "opennsl_vlan_port_add()");
+                continue;
+            }
+            table_.port_add(req->unit(), vid, pbmp, ubmp);
+        }
+    }
     return grpc::Status::OK;
 }
 
 grpc::Status VLANServiceImpl::GPortAdd(::grpc::ServerContext* context, const ::vlan::GPortAddRequest* req, ::vlan::GPortAddResponse* res){
-    auto ret = opennsl_vlan_gport_add(req->unit(), req->vid(), req->port(), req->flags());
+    RPC_TIMER("VLAN");
+    RPC_ADMIT("VLAN", RPC_CLASS_NORMAL);
+    auto lock = config_lock(req->unit());
+    auto ret = SDK_CALL(opennsl_vlan_gport_add, req->unit(), req->vid(), req->port(), req->flags());
     if (ret != OPENNSL_E_NONE) {
         std::ostringstream err;
         err << "opennsl_vlan_gport_add() failed " << opennsl_errmsg(ret);
         return grpc::Status(grpc::UNAVAILABLE, err.str());
     }
+    table_.refresh(req->unit(), req->vid());
     return grpc::Status::OK;
 }
 
 grpc::Status VLANServiceImpl::GPortDelete(::grpc::ServerContext* context, const ::vlan::GPortDeleteRequest* req, ::vlan::GPortDeleteResponse* res){
-    auto ret = opennsl_vlan_gport_delete(req->unit(), req->vid(), req->port());
+    RPC_TIMER("VLAN");
+    RPC_ADMIT("VLAN", RPC_CLASS_NORMAL);
+    auto lock = config_lock(req->unit());
+    auto ret = SDK_CALL(opennsl_vlan_gport_delete, req->unit(), req->vid(), req->port());
     if (ret != OPENNSL_E_NONE) {
         std::ostringstream err;
         err << "opennsl_vlan_gport_delete() failed " << opennsl_errmsg(ret);
         return grpc::Status(grpc::UNAVAILABLE, err.str());
     }
+    table_.refresh(req->unit(), req->vid());
     return grpc::Status::OK;
 }
 
 grpc::Status VLANServiceImpl::GPortDeleteAll(::grpc::ServerContext* context, const ::vlan::GPortDeleteAllRequest* req, ::vlan::GPortDeleteAllResponse* res){
-    auto ret = opennsl_vlan_gport_delete_all(req->unit(), req->vid());
+    RPC_TIMER("VLAN");
+    RPC_ADMIT("VLAN", RPC_CLASS_NORMAL);
+    auto lock = config_lock(req->unit());
+    auto ret = SDK_CALL(opennsl_vlan_gport_delete_all, req->unit(), req->vid());
     if (ret != OPENNSL_E_NONE) {
         std::ostringstream err;
         err << "opennsl_vlan_gport_delete_all() failed " << opennsl_errmsg(ret);
         return grpc::Status(grpc::UNAVAILABLE, err.str());
     }
+    table_.refresh(req->unit(), req->vid());
     return grpc::Status::OK;
 }
 
 grpc::Status VLANServiceImpl::List(::grpc::ServerContext* context, const ::vlan::ListRequest* req, ::vlan::ListResponse* res){
-    opennsl_vlan_data_t *p;
-    int count;
-    auto ret = opennsl_vlan_list(req->unit(), &p, &count);
+    RPC_TIMER("VLAN");
+    RPC_ADMIT("VLAN", RPC_CLASS_BULK);
+    auto ret = table_.sync(req->unit());
+    if (ret != OPENNSL_E_NONE) {
+        std::ostringstream err;
+        err << "opennsl_vlan_list() failed " << opennsl_errmsg(ret);
+        return grpc::Status(grpc::UNAVAILABLE, err.str());
+    }
+    std::vector<vlan_entry> entries;
+    table_.list(req->unit(), &entries);
+    for (auto& e : entries) {
+        set_protobuf_vlan_data(res->add_list(), e);
+    }
+    return grpc::Status::OK;
+}
+
+grpc::Status VLANServiceImpl::ListStream(::grpc::ServerContext* context, const ::vlan::ListStreamRequest* req, ::grpc::ServerWriter< ::vlan::ListStreamResponse>* writer){
+    RPC_TIMER("VLAN");
+    RPC_ADMIT("VLAN", RPC_CLASS_BULK);
+    auto ret = table_.sync(req->unit());
+    if (ret != OPENNSL_E_NONE) {
+        std::ostringstream err;
+        err << "opennsl_vlan_list() failed " << opennsl_errmsg(ret);
+        return grpc::Status(grpc::UNAVAILABLE, err.str());
+    }
+    std::vector<vlan_entry> entries;
+    auto version = table_.list(req->unit(), &entries);
+    auto epoch = table_.epoch();
+    size_t i = 0;
+    do {
+        vlan::ListStreamResponse res;
+        res.set_version(version);
+        res.set_epoch(epoch);
+        for (; i < entries.size() && res.list_size() < VLAN_LIST_CHUNK_SIZE; i++) {
+            set_protobuf_vlan_data(res.add_list(), entries[i]);
+        }
+        if (!writer->Write(res)) {
+            return grpc::Status(grpc::CANCELLED, "client went away");
+        }
+    } while (i < entries.size());
+    return grpc::Status::OK;
+}
+
+grpc::Status VLANServiceImpl::ListChanges(::grpc::ServerContext* context, const ::vlan::ListChangesRequest* req, ::vlan::ListChangesResponse* res){
+    RPC_TIMER("VLAN");
+    RPC_ADMIT("VLAN", RPC_CLASS_BULK);
+    auto ret = table_.sync(req->unit());
+    if (ret != OPENNSL_E_NONE) {
+        std::ostringstream err;
+        err << "opennsl_vlan_list() failed " << opennsl_errmsg(ret);
+        return grpc::Status(grpc::UNAVAILABLE, err.str());
+    }
+    std::vector<vlan_entry> entries;
+    auto since = req->since_version();
+    auto epoch = table_.epoch();
+    auto version = table_.changes(req->unit(), since, &entries);
+    // a version of another epoch, or newer than ours, comes from before a
+    // server restart and says nothing about what changed since
+    if (since == 0 || since > version || req->epoch() != epoch) {
+        entries.clear();
+        version = table_.list(req->unit(), &entries);
+        res->set_full(true);
+    }
+    res->set_version(version);
+    res->set_epoch(epoch);
+    for (auto& e : entries) {
+        if (e.exists) {
+            set_protobuf_vlan_data(res->add_list(), e);
+        } else {
+            res->add_removed(e.vid);
+        }
+    }
+    return grpc::Status::OK;
+}
+
+grpc::Status VLANServiceImpl::GetVlan(::grpc::ServerContext* context, const ::vlan::GetVlanRequest* req, ::vlan::GetVlanResponse* res){
+    RPC_TIMER("VLAN");
+    RPC_ADMIT("VLAN", RPC_CLASS_NORMAL);
+    auto ret = table_.sync(req->unit());
     if (ret != OPENNSL_E_NONE) {
         std::ostringstream err;
         err << "opennsl_vlan_list() failed " << opennsl_errmsg(ret);
         return grpc::Status(grpc::UNAVAILABLE, err.str());
     }
-    for (auto i = 0 ; i < count; i++) {
-        res->add_list();
-        auto data = res->mutable_list(i);
-        data->set_vid(p[i].vlan_tag);
-        set_protobuf_port_config(data->mutable_pbmp(), p[i].port_bitmap);
-        set_protobuf_port_config(data->mutable_ut_pbmp(), p[i].ut_port_bitmap);
+    vlan_entry e;
+    if (!table_.vlan(req->unit(), req->vid(), &e)) {
+        return grpc::Status(grpc::NOT_FOUND, "no such vlan");
     }
-    ret = opennsl_vlan_list_destroy(req->unit(), p, count);
+    set_protobuf_vlan_data(res->mutable_vlan(), e);
+    return grpc::Status::OK;
+}
+
+grpc::Status VLANServiceImpl::GetPortVlans(::grpc::ServerContext* context, const ::vlan::GetPortVlansRequest* req, ::vlan::GetPortVlansResponse* res){
+    RPC_TIMER("VLAN");
+    RPC_ADMIT("VLAN", RPC_CLASS_NORMAL);
+    if (req->port() < 0 || req->port() >= _SHR_PBMP_WORD_MAX * 32) {
+        return grpc::Status(grpc::INVALID_ARGUMENT, "invalid port");
+    }
+    auto ret = table_.sync(req->unit());
     if (ret != OPENNSL_E_NONE) {
-        return grpc::Status(grpc::UNAVAILABLE, "opennsl_vlan_list_destroy() failed");
+        std::ostringstream err;
+        err << "opennsl_vlan_list() failed " << opennsl_errmsg(ret);
+        return grpc::Status(grpc::UNAVAILABLE, err.str());
+    }
+    std::vector<vlan_entry> entries;
+    res->set_version(table_.port_vlans(req->unit(), req->port(), &entries));
+    for (auto& e : entries) {
+        res->add_vids(e.vid);
+        if (OPENNSL_PBMP_MEMBER(e.ut_pbmp, req->port())) {
+            res->add_ut_vids(e.vid);
+        }
     }
     return grpc::Status::OK;
 }
 
 grpc::Status VLANServiceImpl::DefaultGet(::grpc::ServerContext* context, const ::vlan::DefaultGetRequest* req, ::vlan::DefaultGetResponse* res){
-    opennsl_vlan_t vid;
-    auto ret = opennsl_vlan_default_get(req->unit(), &vid);
+    RPC_TIMER("VLAN");
+    RPC_ADMIT("VLAN", RPC_CLASS_NORMAL);
+    auto ret = table_.sync(req->unit());
     if (ret != OPENNSL_E_NONE) {
         std::ostringstream err;
         err << "opennsl_vlan_default_get() failed " << opennsl_errmsg(ret);
         return grpc::Status(grpc::UNAVAILABLE, err.str());
     }
-    res->set_vid(vid);
+    res->set_vid(table_.default_vid(req->unit()));
     return grpc::Status::OK;
 }
 
 grpc::Status VLANServiceImpl::DefaultSet(::grpc::ServerContext* context, const ::vlan::DefaultSetRequest* req, ::vlan::DefaultSetResponse* res){
-    auto ret = opennsl_vlan_default_set(req->unit(), req->vid());
+    RPC_TIMER("VLAN");
+    RPC_ADMIT("VLAN", RPC_CLASS_NORMAL);
+    auto lock = config_lock(req->unit());
+    auto ret = SDK_CALL(opennsl_vlan_default_set, req->unit(), req->vid());
     if (ret != OPENNSL_E_NONE) {
         std::ostringstream err;
         err << "opennsl_vlan_default_set() failed " << opennsl_errmsg(ret);
         return grpc::Status(grpc::UNAVAILABLE, err.str());
     }
+    table_.set_default(req->unit(), req->vid());
     return grpc::Status::OK;
 }
 
+void add_control_error(google::protobuf::RepeatedPtrField<vlan::ControlError>* errors, int index, int ret, const char* fn) {
+    std::ostringstream err;
+    err << fn << " failed " << opennsl_errmsg(ret);
+    auto e = errors->Add();
+    e->set_index(index);
+    e->set_code(ret);
+    e->set_message(err.str());
+}
+
 grpc::Status VLANServiceImpl::ControlSet(::grpc::ServerContext* context, const ::vlan::ControlSetRequest* req, ::vlan::ControlSetResponse* res){
+    RPC_TIMER("VLAN");
+    RPC_ADMIT("VLAN", RPC_CLASS_NORMAL);
+    if (req->controls_size() == 0) {
+        auto ret = SDK_CALL(opennsl_vlan_control_set, req->unit(), static_cast<opennsl_vlan_control_t>(req->type()), req->value());
+        if (ret != OPENNSL_E_NONE) {
+            std::ostringstream err;
+            err << "opennsl_vlan_control_set() failed " << opennsl_errmsg(ret);
+            return grpc::Status(grpc::UNAVAILABLE, err.str());
+        }
+        return grpc::Status::OK;
+    }
+    for (auto i = 0; i < req->controls_size(); i++) {
+        auto& c = req->controls(i);
+        auto ret = SDK_CALL(opennsl_vlan_control_set, req->unit(), static_cast<opennsl_vlan_control_t>(c.type()), c.value());
+        if (ret != OPENNSL_E_NONE) {
+            add_control_error(res->mutable_errors(), i, ret, "opennsl_vlan_control_set()");
+        }
+    }
     return grpc::Status::OK;
 }
 
 grpc::Status VLANServiceImpl::ControlPortSet(::grpc::ServerContext* context, const ::vlan::ControlPortSetRequest* req, ::vlan::ControlPortSetResponse* res){
+    RPC_TIMER("VLAN");
+    RPC_ADMIT("VLAN", RPC_CLASS_NORMAL);
+    if (req->controls_size() == 0) {
+        auto ret = SDK_CALL(opennsl_vlan_control_port_set, req->unit(), req->port(), static_cast<opennsl_vlan_control_port_t>(req->type()), req->value());
+        if (ret != OPENNSL_E_NONE) {
+            std::ostringstream err;
+            err << "opennsl_vlan_control_port_set() failed " << opennsl_errmsg(ret);
+            return grpc::Status(grpc::UNAVAILABLE, err.str());
+        }
+        return grpc::Status::OK;
+    }
+    for (auto i = 0; i < req->controls_size(); i++) {
+        auto& c = req->controls(i);
+        auto ret = SDK_CALL(opennsl_vlan_control_port_set, req->unit(), c.port(), static_cast<opennsl_vlan_control_port_t>(c.type()), c.value());
+        if (ret != OPENNSL_E_NONE) {
+            add_control_error(res->mutable_errors(), i, ret, "opennsl_vlan_control_port_set()");
+        }
+    }
     return grpc::Status::OK;
 }
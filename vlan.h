@@ -1,20 +1,93 @@
+#ifndef VLAN_H
+#define VLAN_H
+
+#include <map>
+#include <mutex>
+#include <set>
+#include <utility>
+#include <vector>
+
 #include <grpc++/server.h>
 
 #include "vlanservice.grpc.pb.h"
 
+extern "C" {
+#include "opennsl/vlan.h"
+}
+
+struct vlan_entry {
+    opennsl_vlan_t vid;
+    opennsl_pbmp_t pbmp;
+    opennsl_pbmp_t ut_pbmp;
+    uint64_t version; // table version of the last change
+    bool exists;      // false for a destroyed VLAN kept as a tombstone
+};
+
+// VLANTable mirrors the VLAN membership of each unit, indexed both by VID and
+// by port. A unit is loaded from the SDK on first use and then kept up to date
+// by the mutating VLAN RPCs, so that readers can be served without walking the
+// hardware tables.
+class VLANTable {
+    public:
+        VLANTable();
+        int sync(int unit);
+        int reconcile(int unit, std::vector<opennsl_vlan_t>* changed);
+        void restore(int unit, const std::vector<vlan_entry>& entries, uint64_t version);
+        uint64_t entries(std::vector<std::pair<int, vlan_entry> >* entries);
+        uint64_t version();
+        // epoch identifies the run of the server versions were handed out
+        // by. It is random per run and drawn again by restore().
+        uint64_t epoch();
+        void create(int unit, opennsl_vlan_t vid);
+        void destroy(int unit, opennsl_vlan_t vid);
+        void destroy_all(int unit);
+        void port_add(int unit, opennsl_vlan_t vid, const opennsl_pbmp_t& pbmp, const opennsl_pbmp_t& ubmp);
+        void port_remove(int unit, opennsl_vlan_t vid, const opennsl_pbmp_t& pbmp);
+        void refresh(int unit, opennsl_vlan_t vid);
+        void set_default(int unit, opennsl_vlan_t vid);
+        opennsl_vlan_t default_vid(int unit);
+        bool vlan(int unit, opennsl_vlan_t vid, vlan_entry* entry);
+        uint64_t port_vlans(int unit, opennsl_port_t port, std::vector<vlan_entry>* entries);
+        uint64_t list(int unit, std::vector<vlan_entry>* entries);
+        uint64_t changes(int unit, uint64_t since, std::vector<vlan_entry>* entries);
+    private:
+        int load(int unit, std::vector<opennsl_vlan_t>* changed);
+        vlan_entry* get(int unit, opennsl_vlan_t vid);
+        void reindex(int unit, const vlan_entry& e, const opennsl_pbmp_t& before);
+        std::mutex mutex_;
+        uint64_t version_;
+        uint64_t epoch_;
+        std::set<int> synced_;
+        std::map<int, std::map<opennsl_vlan_t, vlan_entry> > units_;
+        std::map<int, std::map<opennsl_port_t, std::set<opennsl_vlan_t> > > ports_;
+        std::map<int, opennsl_vlan_t> default_vids_;
+};
+
 class VLANServiceImpl final : public vlanservice::VLAN::Service {
     public:
         grpc::Status Create(::grpc::ServerContext* context, const ::vlan::CreateRequest* request, ::vlan::CreateResponse* response);
         grpc::Status Destroy(::grpc::ServerContext* context, const ::vlan::DestroyRequest* request, ::vlan::DestroyResponse* response);
         grpc::Status DestroyAll(::grpc::ServerContext* context, const ::vlan::DestroyAllRequest* request, ::vlan::DestroyAllResponse* response);
+        grpc::Status CreateRange(::grpc::ServerContext* context, const ::vlan::CreateRangeRequest* request, ::vlan::CreateRangeResponse* response);
+        grpc::Status DestroyRange(::grpc::ServerContext* context, const ::vlan::DestroyRangeRequest* request, ::vlan::DestroyRangeResponse* response);
         grpc::Status PortAdd(::grpc::ServerContext* context, const ::vlan::PortAddRequest* request, ::vlan::PortAddResponse* response);
         grpc::Status PortRemove(::grpc::ServerContext* context, const ::vlan::PortRemoveRequest* request, ::vlan::PortRemoveRequest* response);
+        grpc::Status PortAddMulti(::grpc::ServerContext* context, const ::vlan::PortAddMultiRequest* request, ::vlan::PortAddMultiResponse* response);
         grpc::Status GPortAdd(::grpc::ServerContext* context, const ::vlan::GPortAddRequest* request, ::vlan::GPortAddResponse* response);
         grpc::Status GPortDelete(::grpc::ServerContext* context, const ::vlan::GPortDeleteRequest* request, ::vlan::GPortDeleteResponse* response);
         grpc::Status GPortDeleteAll(::grpc::ServerContext* context, const ::vlan::GPortDeleteAllRequest* request, ::vlan::GPortDeleteAllResponse* response);
         grpc::Status List(::grpc::ServerContext* context, const ::vlan::ListRequest* request, ::vlan::ListResponse* response);
+        grpc::Status ListStream(::grpc::ServerContext* context, const ::vlan::ListStreamRequest* request, ::grpc::ServerWriter< ::vlan::ListStreamResponse>* writer);
+        grpc::Status ListChanges(::grpc::ServerContext* context, const ::vlan::ListChangesRequest* request, ::vlan::ListChangesResponse* response);
+        grpc::Status GetVlan(::grpc::ServerContext* context, const ::vlan::GetVlanRequest* request, ::vlan::GetVlanResponse* response);
+        grpc::Status GetPortVlans(::grpc::ServerContext* context, const ::vlan::GetPortVlansRequest* request, ::vlan::GetPortVlansResponse* response);
         grpc::Status DefaultGet(::grpc::ServerContext* context, const ::vlan::DefaultGetRequest* request, ::vlan::DefaultGetResponse* response);
         grpc::Status DefaultSet(::grpc::ServerContext* context, const ::vlan::DefaultSetRequest* request, ::vlan::DefaultSetResponse* response);
         grpc::Status ControlSet(::grpc::ServerContext* context, const ::vlan::ControlSetRequest* request, ::vlan::ControlSetResponse* response);
         grpc::Status ControlPortSet(::grpc::ServerContext* context, const ::vlan::ControlPortSetRequest* request, ::vlan::ControlPortSetResponse* response);
+        VLANTable* table() { return &table_; }
+    private:
+        VLANTable table_;
 };
+
+#endif // VLAN_H